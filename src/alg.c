@@ -178,7 +178,7 @@ void alg_draw_location(struct coord *cent, struct images *imgs, int width, unsig
     out = imgs->img_motion.image_norm;
 
     /* Debug image always gets a 'normal' box. */
-    if ((mode == LOCATE_BOTH) && process_thisframe) {
+    if ((mode != LOCATE_NORMAL) && process_thisframe) {
         int width_miny = width * cent->miny;
         int width_maxy = width * cent->maxy;
 
@@ -198,7 +198,18 @@ void alg_draw_location(struct coord *cent, struct images *imgs, int width, unsig
             out[width_maxx_y] =~out[width_maxx_y];
         }
     }
-    if (style == LOCATE_BOX) { /* Draw a box on normal images. */
+    if (mode == LOCATE_MOTION) {
+        /* Only the debug image */
+        if (style == LOCATE_CROSS) {
+            int centy = cent->y * width;
+
+            for (x = cent->x - 10;  x <= cent->x + 10; x++)
+                out[centy + x] =~out[centy + x];
+
+            for (y = cent->y - 10; y <= cent->y + 10; y++)
+                out[cent->x + y * width] =~out[cent->x + y * width];
+        }
+    } else if (style == LOCATE_BOX) { /* Draw a box on normal images. */
         int width_miny = width * cent->miny;
         int width_maxy = width * cent->maxy;
 
@@ -222,12 +233,14 @@ void alg_draw_location(struct coord *cent, struct images *imgs, int width, unsig
 
         for (x = cent->x - 10;  x <= cent->x + 10; x++) {
             new[centy + x] =~new[centy + x];
-            out[centy + x] =~out[centy + x];
+            if (mode == LOCATE_BOTH)
+                out[centy + x] =~out[centy + x];
         }
 
         for (y = cent->y - 10; y <= cent->y + 10; y++) {
             new[cent->x + y * width] =~new[cent->x + y * width];
-            out[cent->x + y * width] =~out[cent->x + y * width];
+            if (mode == LOCATE_BOTH)
+                out[cent->x + y * width] =~out[cent->x + y * width];
         }
     }
 }
@@ -253,7 +266,7 @@ void alg_draw_red_location(struct coord *cent, struct images *imgs, int width, u
     new_v = new + v;
 
     /* Debug image always gets a 'normal' box. */
-    if ((mode == LOCATE_BOTH) && process_thisframe) {
+    if ((mode != LOCATE_NORMAL) && process_thisframe) {
         int width_miny = width * cent->miny;
         int width_maxy = width * cent->maxy;
 
@@ -274,6 +287,10 @@ void alg_draw_red_location(struct coord *cent, struct images *imgs, int width, u
         }
     }
 
+    /* Only the debug image */
+    if (mode == LOCATE_MOTION)
+        return;
+
     if (style == LOCATE_REDBOX) { /* Draw a red box on normal images. */
         int width_miny = width * cent->miny;
         int width_maxy = width * cent->maxy;
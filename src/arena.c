@@ -0,0 +1,263 @@
+/*
+ *    arena.c
+ *
+ *    Per camera memory arena for Motion
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    The ring images and the detection buffers of a camera are carved out
+ *    of a single mapping made when the camera starts.  Every block starts on
+ *    a 64 byte boundary, the mapping can be backed by huge pages to reduce
+ *    TLB misses while the frames are scanned, and it can be bound to the
+ *    NUMA node of the CPU the camera thread is pinned to.  The pages are
+ *    touched up front so the memory of the camera is committed at start up
+ *    rather than while the first events are recorded.
+ */
+
+#include "motion.h"
+#include "translate.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <dirent.h>
+
+#ifndef MPOL_PREFERRED
+    #define MPOL_PREFERRED  1
+#endif
+
+static size_t arena_round(size_t size, size_t unit){
+    return (size + unit - 1) & ~(unit - 1);
+}
+
+size_t arena_size(size_t size){
+    /* Bytes used in the arena by a block of the given size */
+    return arena_round(size, ARENA_ALIGN);
+}
+
+static int arena_cpu_node(int cpu){
+    /* NUMA node of a CPU as listed in sysfs, -1 when it is not known */
+    char path[PATH_MAX];
+    DIR *dir;
+    struct dirent *ent;
+    int node;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (dir == NULL) return -1;
+
+    node = -1;
+    while ((ent = readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "node%d", &node) == 1) break;
+        node = -1;
+    }
+    closedir(dir);
+
+    return node;
+}
+
+static int arena_thread_node(void){
+    /*
+     * Node of the CPUs the thread may run on.  A thread that is free to
+     * move between nodes has no node of its own and -1 is returned.
+     */
+#if defined(__linux__) && defined(CPU_COUNT)
+    cpu_set_t cpus;
+    int cpu, node, cpu_node;
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) return -1;
+
+    node = -1;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &cpus)) continue;
+        cpu_node = arena_cpu_node(cpu);
+        if ((cpu_node < 0) || ((node >= 0) && (cpu_node != node))) return -1;
+        node = cpu_node;
+    }
+
+    return node;
+#else
+    return -1;
+#endif
+}
+
+static int arena_bind(struct image_arena *arena){
+    /* Prefer the node of the camera thread for the pages of the arena */
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long nodemask;
+    int node;
+
+    node = arena_thread_node();
+    if ((node < 0) || (node >= (int)(sizeof(nodemask) * 8))) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            ,_("Camera thread is not pinned to the CPUs of a single NUMA node"));
+        return -1;
+    }
+
+    nodemask = 1UL << node;
+    if (syscall(SYS_mbind, arena->base, arena->size, MPOL_PREFERRED
+            , &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+        MOTION_LOG(WRN, TYPE_ALL, SHOW_ERRNO
+            ,_("Unable to bind the frame memory to NUMA node %d"), node);
+        return -1;
+    }
+
+    return node;
+#else
+    (void)arena;
+    MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+        ,_("NUMA placement of the frame memory is not supported on this system"));
+    return -1;
+#endif
+}
+
+/**
+ * arena_init
+ *
+ *   Maps the memory of the arena.  When the mapping cannot be made the arena
+ *   is left empty and all the blocks come from the heap.
+ *
+ * Parameters:
+ *
+ *      arena     The arena
+ *      size      Bytes to reserve, the sum of arena_size() of the blocks
+ *      hugepages Back the arena with huge pages
+ *      numa      Bind the arena to the NUMA node of the camera thread
+ *
+ * Returns:     nothing
+ */
+void arena_init(struct image_arena *arena, size_t size, int hugepages, int numa){
+
+    void *base;
+
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->heap = 0;
+    arena->hugepages = FALSE;
+    arena->node = -1;
+
+    if (size == 0) return;
+
+    base = MAP_FAILED;
+    if (hugepages) {
+        #ifdef MAP_HUGETLB
+            base = mmap(NULL, arena_round(size, ARENA_HUGEPAGE), PROT_READ | PROT_WRITE
+                , MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        #endif
+        if (base != MAP_FAILED) {
+            arena->hugepages = TRUE;
+            size = arena_round(size, ARENA_HUGEPAGE);
+        } else {
+            MOTION_LOG(WRN, TYPE_ALL, SHOW_ERRNO
+                ,_("No huge pages available for the frame memory, using regular pages"));
+        }
+    }
+
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE
+            , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                ,_("Unable to map %llu bytes of frame memory")
+                ,(unsigned long long)size);
+            return;
+        }
+        #ifdef MADV_HUGEPAGE
+            /* Let the kernel use transparent huge pages when it can */
+            if (hugepages) madvise(base, size, MADV_HUGEPAGE);
+        #endif
+    }
+
+    arena->base = base;
+    arena->size = size;
+
+    if (numa) arena->node = arena_bind(arena);
+
+    /* Commit the pages now, on the node of the camera thread */
+    memset(arena->base, 0, arena->size);
+
+}
+
+void arena_deinit(struct image_arena *arena){
+    /* All heap blocks must have been released with arena_free by now */
+
+    if (arena->base != NULL) munmap(arena->base, arena->size);
+
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->heap = 0;
+
+}
+
+/**
+ * arena_alloc
+ *
+ *   Returns a zeroed block aligned on ARENA_ALIGN bytes.  When the arena is
+ *   exhausted the block is taken from the heap instead.
+ *
+ * Parameters:
+ *
+ *      arena    The arena
+ *      size     Bytes wanted
+ *
+ * Returns:     pointer to the block
+ */
+void *arena_alloc(struct image_arena *arena, size_t size){
+
+    void *ptr;
+
+    size = arena_size(size);
+
+    if ((arena->base != NULL) && (size <= arena->size - arena->used)) {
+        ptr = arena->base + arena->used;
+        arena->used += size;
+        return ptr;
+    }
+
+    ptr = mymemalign(ARENA_ALIGN, size);
+    arena->heap += size;
+
+    return ptr;
+}
+
+int arena_contains(const struct image_arena *arena, const void *ptr){
+    /* Whether the block was handed out from the mapping */
+    const unsigned char *block = ptr;
+
+    return ((arena->base != NULL) && (block >= arena->base) &&
+        (block < arena->base + arena->size));
+}
+
+void arena_free(struct image_arena *arena, void *ptr){
+    /* Blocks of the mapping are released with the arena */
+
+    if (ptr == NULL) return;
+
+    if (arena_contains(arena, ptr)) return;
+
+    free(ptr);
+
+}
+
+void arena_report(struct image_arena *arena){
+
+    if (arena->base == NULL) {
+        MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO
+            ,_("Frame memory: %llu kB allocated from the heap")
+            ,(unsigned long long)(arena->heap / 1024));
+    } else if (arena->node >= 0) {
+        MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO
+            ,_("Frame memory: %llu kB reserved%s on NUMA node %d")
+            ,(unsigned long long)(arena->size / 1024)
+            ,arena->hugepages ? _(" in huge pages") : ""
+            ,arena->node);
+    } else {
+        MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO
+            ,_("Frame memory: %llu kB reserved%s")
+            ,(unsigned long long)(arena->size / 1024)
+            ,arena->hugepages ? _(" in huge pages") : "");
+    }
+
+}
@@ -0,0 +1,45 @@
+/*
+ *    arena.h
+ *
+ *    Include file for arena.c
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ */
+#ifndef _INCLUDE_ARENA_H_
+#define _INCLUDE_ARENA_H_
+
+/* Alignment of every block so the image loops can use aligned vector loads */
+#define ARENA_ALIGN         64
+
+/* Size the arena is rounded up to when huge pages are requested */
+#define ARENA_HUGEPAGE      (2 * 1024 * 1024)
+
+/*
+ * Per camera region holding the ring images and the work buffers of the
+ * motion detection.  It is sized and mapped once when the camera starts and
+ * handed out in aligned blocks that are never returned individually.  When
+ * a camera needs more than was reserved the extra blocks come from the heap
+ * and are freed on their own.  Only used by the camera thread, except for
+ * arena_contains and arena_free which only read the mapping and are also
+ * called by the output workers releasing a frame.
+ */
+struct image_arena {
+    unsigned char  *base;
+    size_t          size;               /* Bytes mapped */
+    size_t          used;               /* Bytes handed out from the mapping */
+    size_t          heap;               /* Bytes handed out from the heap */
+    int             hugepages;          /* Mapping uses explicit huge pages */
+    int             node;               /* NUMA node the mapping is bound to or -1 */
+};
+
+size_t arena_size(size_t size);
+void arena_init(struct image_arena *arena, size_t size, int hugepages, int numa);
+void arena_deinit(struct image_arena *arena);
+void *arena_alloc(struct image_arena *arena, size_t size);
+int arena_contains(const struct image_arena *arena, const void *ptr);
+void arena_free(struct image_arena *arena, void *ptr);
+void arena_report(struct image_arena *arena);
+
+#endif /* _INCLUDE_ARENA_H_ */
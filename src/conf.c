@@ -43,6 +43,10 @@ struct config conf_template = {
     .log_type =                        NULL,
     .quiet =                           TRUE,
     .native_language =                 TRUE,
+    .output_workers =                  2,
+    .output_queue_depth =              90,
+    .memory_hugepages =                FALSE,
+    .memory_numa =                     FALSE,
     .camera_name =                     NULL,
     .camera_id =                       0,
     .camera_dir =                      NULL,
@@ -78,6 +82,9 @@ struct config conf_template = {
     .height =                          DEF_HEIGHT,
     .framerate =                       DEF_MAXFRAMERATE,
     .minimum_frame_time =              0,
+    .idle_framerate =                  0,
+    .idle_delay =                      60,
+    .idle_threshold =                  0,
     .rotate =                          0,
     .flip_axis =                       "none",
     .locate_motion_mode =              "off",
@@ -87,6 +94,10 @@ struct config conf_template = {
     .text_changes =                    FALSE,
     .text_scale =                      1,
     .text_event =                      DEF_EVENTSTAMP,
+    .picture_overlay =                 "all",
+    .movie_overlay =                   "all",
+    .stream_overlay =                  "all",
+    .video_pipe_overlay =              "all",
 
     /* Motion detection configuration parameters */
     .emulate_motion =                  FALSE,
@@ -105,6 +116,7 @@ struct config conf_template = {
     .minimum_motion_frames =           1,
     .event_gap =                       DEF_EVENT_GAP,
     .pre_capture =                     0,
+    .pre_capture_quality =             0,
     .post_capture =                    0,
 
     /* Script execution configuration parameters */
@@ -123,8 +135,10 @@ struct config conf_template = {
     .picture_output_motion =           FALSE,
     .picture_type =                    "jpeg",
     .picture_quality =                 75,
+    .picture_webp_method =             4,
     .picture_exif =                    NULL,
     .picture_filename =                DEF_IMAGEPATH,
+    .picture_passthrough =             FALSE,
 
     /* Snapshot configuration parameters */
     .snapshot_interval =               0,
@@ -139,7 +153,15 @@ struct config conf_template = {
     .movie_codec =                     "mkv",
     .movie_duplicate_frames =          FALSE,
     .movie_passthrough =               FALSE,
+    .movie_encoder_queue =             4,
+    .movie_encoder_threads =           1,
+    .movie_encoder_params =            NULL,
     .movie_filename =                  DEF_MOVIEPATH,
+    .movie_segment_time =              0,
+    .movie_segment_filename =          "%t-segments/%Y%m%d%H%M%S",
+    .movie_segment_index =             "%t-segments/index",
+    .movie_segment_files =             0,
+    .movie_segment_prealloc =          0,
     .movie_extpipe_use =               FALSE,
     .movie_extpipe =                   NULL,
 
@@ -148,6 +170,7 @@ struct config conf_template = {
     .timelapse_mode =                  DEF_TIMELAPSE_MODE,
     .timelapse_fps =                   30,
     .timelapse_codec =                 "mpg",
+    .timelapse_flush =                 60,
     .timelapse_filename =              DEF_TIMEPATH,
 
     /* Loopback device configuration parameters */
@@ -179,9 +202,14 @@ struct config conf_template = {
     .stream_preview_method =           0,
     .stream_quality =                  50,
     .stream_grey =                     FALSE,
+    .stream_sizes =                    "1/2",
     .stream_motion =                   FALSE,
     .stream_maxrate =                  1,
     .stream_limit =                    0,
+    .stream_threads =                  2,
+    .stream_mosaic_width =             640,
+    .stream_mosaic_height =            480,
+    .stream_mosaic_rate =              2,
 
     /* Database and SQL configuration parameters */
     .database_type =                   NULL,
@@ -309,6 +337,42 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "output_workers",
+    "# Number of threads writing pictures and movies for all cameras (0 writes them in the camera threads).",
+    1,
+    CONF_OFFSET(output_workers),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
+    "output_queue_depth",
+    "# Maximum number of images queued for the output workers per camera (0 for no limit).",
+    1,
+    CONF_OFFSET(output_queue_depth),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
+    "memory_hugepages",
+    "# Use huge pages for the images and detection buffers of the camera.",
+    0,
+    CONF_OFFSET(memory_hugepages),
+    copy_bool,
+    print_bool,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
+    "memory_numa",
+    "# Place the images and detection buffers on the NUMA node the camera thread is pinned to.",
+    0,
+    CONF_OFFSET(memory_numa),
+    copy_bool,
+    print_bool,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "camera_name",
     "# User defined name for the camera.",
     0,
@@ -565,6 +629,33 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "idle_framerate",
+    "# Frames per second while nothing has moved for idle_delay seconds (0 = off)",
+    0,
+    CONF_OFFSET(idle_framerate),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "idle_delay",
+    "# Seconds without motion before dropping to the idle_framerate",
+    0,
+    CONF_OFFSET(idle_delay),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "idle_threshold",
+    "# Changed pixels that return an idle camera to full framerate (0 = half of threshold)",
+    0,
+    CONF_OFFSET(idle_threshold),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
     "rotate",
     "# Number of degrees to rotate image.",
     0,
@@ -646,6 +737,43 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "picture_overlay",
+    "# Text and locate overlays drawn on pictures (all, none or a list of\n"
+    "# text_left, text_right, text_changes, locate)",
+    0,
+    CONF_OFFSET(picture_overlay),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "movie_overlay",
+    "# Text and locate overlays drawn on movies",
+    0,
+    CONF_OFFSET(movie_overlay),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "stream_overlay",
+    "# Text and locate overlays drawn on the stream",
+    0,
+    CONF_OFFSET(stream_overlay),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "video_pipe_overlay",
+    "# Text and locate overlays drawn on the video loopback",
+    0,
+    CONF_OFFSET(video_pipe_overlay),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
     "emulate_motion",
     "############################################################\n"
     "# Motion detection configuration parameters\n"
@@ -793,6 +921,15 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "pre_capture_quality",
+    "# JPEG quality of the pre-captured pictures kept in memory (0 keeps them uncompressed).",
+    0,
+    CONF_OFFSET(pre_capture_quality),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "post_capture",
     "# Number of frames to capture after motion is no longer detected.",
     0,
@@ -925,6 +1062,15 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "picture_webp_method",
+    "# WebP compression method, 0 is the fastest and 6 the smallest",
+    0,
+    CONF_OFFSET(picture_webp_method),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "picture_exif",
     "# Text to include in a JPEG EXIF comment",
     0,
@@ -943,6 +1089,15 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "picture_passthrough",
+    "# Use the JPEG images of MJPEG cameras as is when nothing is drawn on them",
+    0,
+    CONF_OFFSET(picture_passthrough),
+    copy_bool,
+    print_bool,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "snapshot_interval",
     "############################################################\n"
     "# Snapshot output configuration parameters\n"
@@ -1039,6 +1194,33 @@ config_param config_params[] = {
     WEBUI_LEVEL_ADVANCED
     },
     {
+    "movie_encoder_queue",
+    "# Number of frames queued for the encoder thread of each movie (0 encodes without a thread).",
+    0,
+    CONF_OFFSET(movie_encoder_queue),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
+    "movie_encoder_threads",
+    "# Number of threads the codec of the movies may use (0 lets the codec decide).",
+    0,
+    CONF_OFFSET(movie_encoder_threads),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
+    "movie_encoder_params",
+    "# Comma separated list of key=value options for the codec of the movies.",
+    0,
+    CONF_OFFSET(movie_encoder_params),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "movie_filename",
     "# File name(without extension) for movies relative to target directory",
     0,
@@ -1048,6 +1230,51 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "movie_segment_time",
+    "# Seconds per file of the continuous recording of the camera, 0 to not record.",
+    0,
+    CONF_OFFSET(movie_segment_time),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "movie_segment_filename",
+    "# File name(without extension) for the continuous recording relative to target directory",
+    0,
+    CONF_OFFSET(movie_segment_filename),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "movie_segment_index",
+    "# File name of the index of the events in the continuous recording relative to target directory",
+    0,
+    CONF_OFFSET(movie_segment_index),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "movie_segment_files",
+    "# Number of files reused in turn by the continuous recording, 0 for a new file per segment.",
+    0,
+    CONF_OFFSET(movie_segment_files),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "movie_segment_prealloc",
+    "# MiB of disk reserved for each file of the continuous recording when it is started.",
+    0,
+    CONF_OFFSET(movie_segment_prealloc),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "movie_extpipe_use",
     "# Use pipe and external encoder for creating movies.",
     0,
@@ -1105,6 +1332,15 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "timelapse_flush",
+    "# Seconds between writes of the buffered mpg timelapse file to disk.",
+    0,
+    CONF_OFFSET(timelapse_flush),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
     "timelapse_filename",
     "# File name(without extension) for timelapse movies relative to target directory",
     0,
@@ -1340,6 +1576,15 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "stream_sizes",
+    "# Comma separated sizes of the substreams, 1/N of the image or a width in pixels.",
+    0,
+    CONF_OFFSET(stream_sizes),
+    copy_string,
+    print_string,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
     "stream_motion",
     "# Output frames at 1 fps when no motion is detected.",
     0,
@@ -1367,6 +1612,43 @@ config_param config_params[] = {
     WEBUI_LEVEL_LIMITED
     },
     {
+    "stream_threads",
+    "# Number of threads serving the stream connections of each port.\n"
+    "# 0 uses a thread per connection.",
+    1,
+    CONF_OFFSET(stream_threads),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_ADVANCED
+    },
+    {
+    "stream_mosaic_width",
+    "# Width in pixels of the mosaic of all cameras on the stream port.",
+    1,
+    CONF_OFFSET(stream_mosaic_width),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "stream_mosaic_height",
+    "# Height in pixels of the mosaic of all cameras on the stream port.",
+    1,
+    CONF_OFFSET(stream_mosaic_height),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
+    "stream_mosaic_rate",
+    "# Images per second of the mosaic of all cameras on the stream port.",
+    1,
+    CONF_OFFSET(stream_mosaic_rate),
+    copy_int,
+    print_int,
+    WEBUI_LEVEL_LIMITED
+    },
+    {
     "database_type",
     "############################################################\n"
     "# Database and SQL Configuration parameters\n"
@@ -3175,6 +3457,10 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","log_type",_("log_type"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","quiet",_("quiet"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","native_language",_("native_language"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","output_workers",_("output_workers"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","output_queue_depth",_("output_queue_depth"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","memory_hugepages",_("memory_hugepages"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","memory_numa",_("memory_numa"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","camera_name",_("camera_name"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","camera_id",_("camera_id"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","target_dir",_("target_dir"));
@@ -3203,6 +3489,9 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","height",_("height"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","framerate",_("framerate"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","minimum_frame_time",_("minimum_frame_time"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","idle_framerate",_("idle_framerate"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","idle_delay",_("idle_delay"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","idle_threshold",_("idle_threshold"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","rotate",_("rotate"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","flip_axis",_("flip_axis"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","locate_motion_mode",_("locate_motion_mode"));
@@ -3212,6 +3501,10 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","text_changes",_("text_changes"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","text_scale",_("text_scale"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","text_event",_("text_event"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_overlay",_("picture_overlay"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_overlay",_("movie_overlay"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_overlay",_("stream_overlay"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","video_pipe_overlay",_("video_pipe_overlay"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","emulate_motion",_("emulate_motion"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","threshold",_("threshold"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","threshold_maximum",_("threshold_maximum"));
@@ -3228,6 +3521,7 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","minimum_motion_frames",_("minimum_motion_frames"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","event_gap",_("event_gap"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","pre_capture",_("pre_capture"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","pre_capture_quality",_("pre_capture_quality"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","post_capture",_("post_capture"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","on_event_start",_("on_event_start"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","on_event_end",_("on_event_end"));
@@ -3242,8 +3536,10 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_output_motion",_("picture_output_motion"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_type",_("picture_type"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_quality",_("picture_quality"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_webp_method",_("picture_webp_method"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_exif",_("picture_exif"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_filename",_("picture_filename"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","picture_passthrough",_("picture_passthrough"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","snapshot_interval",_("snapshot_interval"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","snapshot_filename",_("snapshot_filename"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_output",_("movie_output"));
@@ -3254,13 +3550,22 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_codec",_("movie_codec"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_duplicate_frames",_("movie_duplicate_frames"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_passthrough",_("movie_passthrough"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_encoder_queue",_("movie_encoder_queue"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_encoder_threads",_("movie_encoder_threads"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_encoder_params",_("movie_encoder_params"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_filename",_("movie_filename"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_segment_time",_("movie_segment_time"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_segment_filename",_("movie_segment_filename"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_segment_index",_("movie_segment_index"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_segment_files",_("movie_segment_files"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_segment_prealloc",_("movie_segment_prealloc"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_extpipe_use",_("movie_extpipe_use"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","movie_extpipe",_("movie_extpipe"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","timelapse_interval",_("timelapse_interval"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","timelapse_mode",_("timelapse_mode"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","timelapse_fps",_("timelapse_fps"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","timelapse_codec",_("timelapse_codec"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","timelapse_flush",_("timelapse_flush"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","timelapse_filename",_("timelapse_filename"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","video_pipe",_("video_pipe"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","video_pipe_motion",_("video_pipe_motion"));
@@ -3286,9 +3591,14 @@ static void config_parms_intl(){
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_preview_method",_("stream_preview_method"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_quality",_("stream_quality"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_grey",_("stream_grey"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_sizes",_("stream_sizes"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_motion",_("stream_motion"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_maxrate",_("stream_maxrate"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_limit",_("stream_limit"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_threads",_("stream_threads"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_mosaic_width",_("stream_mosaic_width"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_mosaic_height",_("stream_mosaic_height"));
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_mosaic_rate",_("stream_mosaic_rate"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","database_type",_("database_type"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","database_dbname",_("database_dbname"));
         MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","database_host",_("database_host"));
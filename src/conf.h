@@ -28,6 +28,10 @@ struct config {
     char            *log_type;
     int             quiet;
     int             native_language;
+    int             output_workers;
+    int             output_queue_depth;
+    int             memory_hugepages;
+    int             memory_numa;
     const char      *camera_name;
     int             camera_id;
     const char      *camera_dir;
@@ -63,6 +67,9 @@ struct config {
     int             height;
     int             framerate;
     int             minimum_frame_time;
+    int             idle_framerate;
+    int             idle_delay;
+    int             idle_threshold;
     int             rotate;
     const char      *flip_axis;
     const char      *locate_motion_mode;
@@ -72,6 +79,10 @@ struct config {
     int             text_changes;
     int             text_scale;
     const char      *text_event;
+    const char      *picture_overlay;
+    const char      *movie_overlay;
+    const char      *stream_overlay;
+    const char      *video_pipe_overlay;
 
     /* Motion detection configuration parameters */
     int             emulate_motion;
@@ -90,6 +101,7 @@ struct config {
     int             minimum_motion_frames;
     int             event_gap;
     int             pre_capture;
+    int             pre_capture_quality;
     int             post_capture;
 
     /* Script execution configuration parameters */
@@ -108,8 +120,10 @@ struct config {
     int             picture_output_motion;
     const char      *picture_type;
     int             picture_quality;
+    int             picture_webp_method;
     const char      *picture_exif;
     const char      *picture_filename;
+    int             picture_passthrough;
 
     /* Snapshot configuration parameters */
     int             snapshot_interval;
@@ -124,7 +138,15 @@ struct config {
     const char      *movie_codec;
     int             movie_duplicate_frames;
     int             movie_passthrough;
+    int             movie_encoder_queue;
+    int             movie_encoder_threads;
+    const char      *movie_encoder_params;
     const char      *movie_filename;
+    int             movie_segment_time;
+    const char      *movie_segment_filename;
+    const char      *movie_segment_index;
+    int             movie_segment_files;
+    int             movie_segment_prealloc;
     int             movie_extpipe_use;
     const char      *movie_extpipe;
 
@@ -133,6 +155,7 @@ struct config {
     const char      *timelapse_mode;
     int             timelapse_fps;
     const char      *timelapse_codec;
+    int             timelapse_flush;
     const char      *timelapse_filename;
 
     /* Loopback device configuration parameters */
@@ -164,9 +187,14 @@ struct config {
     int             stream_preview_method;
     int             stream_quality;
     int             stream_grey;
+    const char      *stream_sizes;
     int             stream_motion;
     int             stream_maxrate;
     int             stream_limit;
+    int             stream_threads;
+    int             stream_mosaic_width;
+    int             stream_mosaic_height;
+    int             stream_mosaic_rate;
 
     /* Database and SQL configuration parameters */
     const char      *database_type;
@@ -14,6 +14,8 @@
 #include "event.h"
 #include "video_loopback.h"
 #include "video_common.h"
+#include "webu.h"
+#include "webu_stream.h"
 
 /* Various functions (most doing the actual action)
  * TODO Items:
@@ -50,6 +52,8 @@ const char *eventList[] = {
     "EVENT_CAMERA_LOST",
     "EVENT_CAMERA_FOUND",
     "EVENT_FFMPEG_PUT",
+    "EVENT_FFMPEG_RESUME",
+    "EVENT_SEGMENT_PUT",
     "EVENT_LAST"
 };
 
@@ -77,7 +81,7 @@ static const char *eventToString(motion_event e)
 static void exec_command(struct context *cnt, char *command, char *filename, int filetype)
 {
     char stamp[PATH_MAX];
-    mystrftime(cnt, stamp, sizeof(stamp), command, &cnt->current_image->timestamp_tv, filename, filetype);
+    mystrftime(cnt, stamp, sizeof(stamp), command, &outpool_image(cnt)->timestamp_tv, filename, filetype);
 
     if (!fork()) {
         int i;
@@ -296,7 +300,7 @@ static void event_sqlfirstmotion(struct context *cnt, motion_event type  ATTRIBU
         char sqlquery[PATH_MAX];
 
         mystrftime(cnt, sqlquery, sizeof(sqlquery), cnt->conf.sql_query_start,
-                   &cnt->current_image->timestamp_tv, NULL, 0);
+                   &outpool_image(cnt)->timestamp_tv, NULL, 0);
 
         do_sql_query(sqlquery, cnt, 1);
     }
@@ -382,105 +386,241 @@ static void on_event_end_command(struct context *cnt,
         exec_command(cnt, cnt->conf.on_event_end, NULL, 0);
 }
 
+/* Shallow copy of an image whose normal size pixels carry the overlay items */
+static void event_overlay_image(struct context *cnt, struct image_data *dst
+            , struct image_data *src, int items)
+{
+    memcpy(dst, src, sizeof(struct image_data));
+    dst->image_norm = overlay_image(cnt, src, items);
+}
+
+static void event_stream_jpeg(struct context *cnt, struct stream_data *stream
+            , struct image_data *img, int items, int size)
+{
+    /*
+     * Compress the frame into an image the clients can not see yet and then
+     * publish it, so mutex_stream is only held to swap the pointers.
+     */
+    struct stream_jpeg *jpeg;
+
+    jpeg = webu_stream_jpeg_claim(cnt, stream, cnt->imgs.size_norm);
+    jpeg->size = overlay_jpeg(cnt, img, items, size
+        ,cnt->conf.stream_quality
+        ,cnt->conf.stream_grey
+        ,FALSE
+        ,jpeg->data
+        ,jpeg->alloc);
+    webu_stream_jpeg_publish(cnt, stream, jpeg);
+}
+
+static void event_stream_scaled(struct context *cnt, struct image_data *img_data)
+{
+    /*
+     * Scale the frame to the sizes of the substreams that have clients.  The
+     * sizes are sorted from the largest down, so a size another one is made
+     * from is always scaled first.
+     */
+    struct stream_scaled *scaled;
+    struct stream_jpeg *jpeg;
+    unsigned char *image, *source;
+    int indx;
+
+    for (indx = 0; indx < cnt->stream_scaled_count; indx++)
+        cnt->stream_scaled[indx].needed = FALSE;
+
+    for (indx = cnt->stream_scaled_count - 1; indx >= 0; indx--) {
+        scaled = &cnt->stream_scaled[indx];
+        if ((scaled->stream.cnct_count > 0) || scaled->needed) {
+            scaled->needed = TRUE;
+            if (scaled->source >= 0)
+                cnt->stream_scaled[scaled->source].needed = TRUE;
+        }
+    }
+
+    image = NULL;
+    for (indx = 0; indx < cnt->stream_scaled_count; indx++) {
+        scaled = &cnt->stream_scaled[indx];
+        if (!scaled->needed) continue;
+
+        if (scaled->source >= 0) {
+            source = cnt->stream_scaled[scaled->source].image;
+            pic_scale_img(scaled->width * 2, scaled->height * 2, source
+                , scaled->width, scaled->height, scaled->image);
+        } else {
+            if (image == NULL) image = overlay_image(cnt, img_data, cnt->overlay_stream);
+            pic_scale_img(cnt->imgs.width, cnt->imgs.height, image
+                , scaled->width, scaled->height, scaled->image);
+        }
+
+        if (scaled->stream.cnct_count > 0) {
+            jpeg = webu_stream_jpeg_claim(cnt, &scaled->stream, cnt->imgs.size_norm);
+            jpeg->size = put_picture_memory(cnt, jpeg->data, jpeg->alloc, scaled->image
+                , cnt->conf.stream_quality, scaled->width, scaled->height);
+            webu_stream_jpeg_publish(cnt, &scaled->stream, jpeg);
+        }
+    }
+}
+
+static void event_stream_mpegts_frame(void *opaque, int iskey)
+{
+    /* Called by the muxer, possibly on its encoder thread, after each frame */
+    struct context *cnt = opaque;
+
+    webu_stream_mpegts_publish(cnt, &cnt->stream_mpegts, iskey);
+}
+
+static int event_stream_mpegts_open(struct context *cnt, struct timeval *tv1)
+{
+    /*
+     * Open the muxer of the MPEG-TS stream.  With pass-through the packets of
+     * the camera are sent as they are, otherwise the frames are encoded once
+     * for all the clients of the stream.
+     */
+    struct ffmpeg *ffmpeg;
+
+    ffmpeg = mymalloc(sizeof(struct ffmpeg));
+    if (cnt->imgs.size_high > 0){
+        ffmpeg->width  = cnt->imgs.width_high;
+        ffmpeg->height = cnt->imgs.height_high;
+        ffmpeg->high_resolution = TRUE;
+        ffmpeg->rtsp_data = cnt->rtsp_high;
+    } else {
+        ffmpeg->width  = cnt->imgs.width;
+        ffmpeg->height = cnt->imgs.height;
+        ffmpeg->high_resolution = FALSE;
+        ffmpeg->rtsp_data = cnt->rtsp;
+    }
+    snprintf(cnt->streamfilename, PATH_MAX, "%s", "stream");
+    ffmpeg->tlapse = TIMELAPSE_NONE;
+    /* movie_fps is only known once an event started, the stream uses the capture rate */
+    ffmpeg->fps = cnt->lastrate;
+    if (ffmpeg->fps < 2) ffmpeg->fps = 2;
+    ffmpeg->bps = cnt->conf.movie_bps;
+    ffmpeg->filename = cnt->streamfilename;
+    ffmpeg->quality = cnt->conf.movie_quality;
+    ffmpeg->start_time.tv_sec = tv1->tv_sec;
+    ffmpeg->start_time.tv_usec = tv1->tv_usec;
+    ffmpeg->last_pts = -1;
+    ffmpeg->base_pts = 0;
+    ffmpeg->gop_cnt = 0;
+    ffmpeg->codec_name = "mpegts";
+    ffmpeg->test_mode = FALSE;
+    ffmpeg->motion_images = 0;
+    ffmpeg->passthrough = util_check_passthrough(cnt);
+    ffmpeg->live_write = webu_stream_mpegts_write;
+    ffmpeg->live_opaque = &cnt->stream_mpegts;
+    ffmpeg->live_frame = event_stream_mpegts_frame;
+    ffmpeg->live_frame_opaque = cnt;
+    ffmpeg->encoder_queue = cnt->conf.movie_encoder_queue;
+    ffmpeg->encoder_threads = cnt->conf.movie_encoder_threads;
+    ffmpeg->encoder_params = cnt->conf.movie_encoder_params;
+
+    if (ffmpeg_open(ffmpeg) < 0){
+        MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO
+            ,_("Error opening context for MPEG-TS stream."));
+        free(ffmpeg);
+        webu_stream_mpegts_free(cnt, &cnt->stream_mpegts);
+        return -1;
+    }
+    webu_stream_mpegts_header(cnt, &cnt->stream_mpegts);
+
+    cnt->ffmpeg_stream = ffmpeg;
+
+    return 0;
+}
+
+static void event_stream_mpegts(struct context *cnt, struct image_data *img_data
+            , struct timeval *tv1)
+{
+    /*
+     * Feed the frame to the muxer of the MPEG-TS stream, opening it for the
+     * first client and closing it after the last.  A muxer that failed to
+     * open is retried every ten seconds.
+     */
+    struct image_data img_stream;
+
+    if (cnt->stream_mpegts.cnct_count <= 0) {
+        if (cnt->ffmpeg_stream != NULL) {
+            ffmpeg_close(cnt->ffmpeg_stream);
+            free(cnt->ffmpeg_stream);
+            cnt->ffmpeg_stream = NULL;
+            webu_stream_mpegts_free(cnt, &cnt->stream_mpegts);
+        }
+        cnt->ffmpeg_stream_fail = 0;
+        return;
+    }
+
+    if (cnt->ffmpeg_stream == NULL) {
+        if (tv1->tv_sec < cnt->ffmpeg_stream_fail + 10) return;
+        if (event_stream_mpegts_open(cnt, tv1) < 0) {
+            cnt->ffmpeg_stream_fail = tv1->tv_sec;
+            return;
+        }
+    }
+
+    if (!cnt->ffmpeg_stream->passthrough) {
+        event_overlay_image(cnt, &img_stream, img_data, cnt->overlay_stream);
+        img_data = &img_stream;
+    }
+    if (ffmpeg_put_image(cnt->ffmpeg_stream, img_data, tv1) == -1){
+        MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
+    }
+}
+
 static void event_stream_put(struct context *cnt,
             motion_event type ATTRIBUTE_UNUSED,
             struct image_data *img_data, char *dummy1 ATTRIBUTE_UNUSED,
-            void *dummy2 ATTRIBUTE_UNUSED, struct timeval *tv1 ATTRIBUTE_UNUSED)
+            void *dummy2 ATTRIBUTE_UNUSED, struct timeval *tv1)
 {
-    int subsize;
+    struct image_data *source;
 
     if (cnt->conf.stream_preview_method == 99){
         if (cnt->conf.stream_port)
-            stream_put(cnt, &cnt->stream, &cnt->stream_count, img_data->image_norm, 0);
+            stream_put(cnt, &cnt->stream, &cnt->stream_count
+                , overlay_image(cnt, img_data, cnt->overlay_stream), 0);
     } else {
-        pthread_mutex_lock(&cnt->mutex_stream);
-            /* Normal stream processing */
-            if (cnt->stream_norm.cnct_count > 0){
-                if (cnt->stream_norm.jpeg_data == NULL){
-                    cnt->stream_norm.jpeg_data = mymalloc(cnt->imgs.size_norm);
-                }
-                if (img_data->image_norm != NULL){
-                    cnt->stream_norm.jpeg_size = put_picture_memory(cnt
-                        ,cnt->stream_norm.jpeg_data
-                        ,cnt->imgs.size_norm
-                        ,img_data->image_norm
-                        ,cnt->conf.stream_quality
-                        ,cnt->imgs.width
-                        ,cnt->imgs.height);
-                }
-            }
+        /*
+         * The JPEG images come from the cache of the frame so a stream
+         * compressed like a picture or another stream reuses its JPEG.
+         */
 
-            /* Substream processing */
-            if (cnt->stream_sub.cnct_count > 0){
-                if (cnt->stream_sub.jpeg_data == NULL){
-                    cnt->stream_sub.jpeg_data = mymalloc(cnt->imgs.size_norm);
-                }
-                if (img_data->image_norm != NULL){
-                    /* Resulting substream image must be multiple of 8 */
-                    if (((cnt->imgs.width  % 16) == 0)  &&
-                        ((cnt->imgs.height % 16) == 0)) {
-
-                        subsize = ((cnt->imgs.width / 2) * (cnt->imgs.height / 2) * 3 / 2);
-                        if (cnt->imgs.substream_image == NULL){
-                            cnt->imgs.substream_image = mymalloc(subsize);
-                        }
-                        pic_scale_img(cnt->imgs.width
-                            ,cnt->imgs.height
-                            ,img_data->image_norm
-                            ,cnt->imgs.substream_image);
-                        cnt->stream_sub.jpeg_size = put_picture_memory(cnt
-                            ,cnt->stream_sub.jpeg_data
-                            ,subsize
-                            ,cnt->imgs.substream_image
-                            ,cnt->conf.stream_quality
-                            ,(cnt->imgs.width / 2)
-                            ,(cnt->imgs.height / 2));
-                    } else {
-                        /* Substream was not multiple of 8 so send full image*/
-                        cnt->stream_sub.jpeg_size = put_picture_memory(cnt
-                            ,cnt->stream_sub.jpeg_data
-                            ,cnt->imgs.size_norm
-                            ,img_data->image_norm
-                            ,cnt->conf.stream_quality
-                            ,cnt->imgs.width
-                            ,cnt->imgs.height);
-                    }
-                }
-            }
+        /* Normal stream processing */
+        if ((cnt->stream_norm.cnct_count > 0) && (img_data->image_norm != NULL)){
+            event_stream_jpeg(cnt, &cnt->stream_norm, img_data
+                , cnt->overlay_stream, OVERLAY_JPEG_NORM);
+        }
 
-            /* Motion stream processing */
-            if (cnt->stream_motion.cnct_count > 0){
-                if (cnt->stream_motion.jpeg_data == NULL){
-                    cnt->stream_motion.jpeg_data = mymalloc(cnt->imgs.size_norm);
-                }
-                if (cnt->imgs.img_motion.image_norm != NULL){
-                    cnt->stream_motion.jpeg_size = put_picture_memory(cnt
-                        ,cnt->stream_motion.jpeg_data
-                        ,cnt->imgs.size_norm
-                        ,cnt->imgs.img_motion.image_norm
-                        ,cnt->conf.stream_quality
-                        ,cnt->imgs.width
-                        ,cnt->imgs.height);
-                }
-            }
+        /* Substream processing */
+        if ((cnt->stream_scaled_count > 0) && (img_data->image_norm != NULL)){
+            event_stream_scaled(cnt, img_data);
+        }
 
-            /* Source stream processing */
-            if (cnt->stream_source.cnct_count > 0){
-                if (cnt->stream_source.jpeg_data == NULL){
-                    cnt->stream_source.jpeg_data = mymalloc(cnt->imgs.size_norm);
-                }
-                if (cnt->imgs.image_virgin.image_norm != NULL){
-                    cnt->stream_source.jpeg_size = put_picture_memory(cnt
-                        ,cnt->stream_source.jpeg_data
-                        ,cnt->imgs.size_norm
-                        ,cnt->imgs.image_virgin.image_norm
-                        ,cnt->conf.stream_quality
-                        ,cnt->imgs.width
-                        ,cnt->imgs.height);
-                }
+        /* Motion stream processing */
+        if ((cnt->stream_motion.cnct_count > 0) && (cnt->imgs.img_motion.image_norm != NULL)){
+            event_stream_jpeg(cnt, &cnt->stream_motion, &cnt->imgs.img_motion
+                , 0, OVERLAY_JPEG_NORM);
+        }
+
+        /* Source stream processing */
+        if (cnt->stream_source.cnct_count > 0){
+            /* When the virgin image was not copied at capture it is the frame itself */
+            source = &cnt->imgs.image_virgin;
+            if ((source->buffer != NULL) && (source->buffer == img_data->buffer))
+                source = img_data;
+            if (source->image_norm != NULL){
+                event_stream_jpeg(cnt, &cnt->stream_source, source
+                    , 0, OVERLAY_JPEG_NORM);
             }
-        pthread_mutex_unlock(&cnt->mutex_stream);
+        }
+    }
+
+    /* MPEG-TS stream processing */
+    if ((cnt->stream_mpegts.cnct_count > 0) || (cnt->ffmpeg_stream != NULL)){
+        event_stream_mpegts(cnt, img_data, tv1);
     }
+
+    /* Cell of the camera in the mosaic of the stream port of motion.conf */
+    mosaic_put(cnt, img_data, tv1);
 }
 
 
@@ -491,7 +631,8 @@ static void event_vlp_putpipe(struct context *cnt,
             struct timeval *tv1 ATTRIBUTE_UNUSED)
 {
     if (*(int *)devpipe >= 0) {
-        if (vlp_putpipe(*(int *)devpipe, img_data->image_norm, cnt->imgs.size_norm) == -1)
+        if (vlp_putpipe(*(int *)devpipe, overlay_image(cnt, img_data, cnt->overlay_video_pipe)
+                , cnt->imgs.size_norm) == -1)
             MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
                 ,_("Failed to put image into video pipe"));
     }
@@ -516,7 +657,6 @@ static void event_image_detect(struct context *cnt,
 {
     char fullfilename[PATH_MAX];
     char filename[PATH_MAX];
-    int  passthrough;
 
     if (cnt->new_img & NEWIMG_ON) {
         const char *imagepath;
@@ -537,19 +677,14 @@ static void event_image_detect(struct context *cnt,
             , (int)(PATH_MAX-2-strlen(cnt->conf.target_dir)-strlen(imageext(cnt)))
             , filename, imageext(cnt));
 
-        passthrough = util_check_passthrough(cnt);
-        if ((cnt->imgs.size_high > 0) && (!passthrough)) {
-            put_picture(cnt, fullfilename,img_data->image_high, FTYPE_IMAGE);
-        } else {
-            put_picture(cnt, fullfilename,img_data->image_norm, FTYPE_IMAGE);
-        }
+        put_picture_image(cnt, fullfilename, img_data, cnt->overlay_picture, FTYPE_IMAGE);
         event(cnt, EVENT_FILECREATE, NULL, fullfilename, (void *)FTYPE_IMAGE, currenttime_tv);
     }
 }
 
 static void event_imagem_detect(struct context *cnt,
             motion_event type ATTRIBUTE_UNUSED,
-            struct image_data *img_data ATTRIBUTE_UNUSED, char *dummy1 ATTRIBUTE_UNUSED,
+            struct image_data *img_data, char *dummy1 ATTRIBUTE_UNUSED,
             void *dummy2 ATTRIBUTE_UNUSED, struct timeval *currenttime_tv)
 {
     struct config *conf = &cnt->conf;
@@ -580,7 +715,7 @@ static void event_imagem_detect(struct context *cnt,
             , cnt->conf.target_dir
             , (int)(PATH_MAX-2-strlen(cnt->conf.target_dir)-strlen(imageext(cnt)))
             , filenamem, imageext(cnt));
-        put_picture(cnt, fullfilenamem, cnt->imgs.img_motion.image_norm, FTYPE_IMAGE_MOTION);
+        put_picture(cnt, fullfilenamem, img_data->image_norm, FTYPE_IMAGE_MOTION);
         event(cnt, EVENT_FILECREATE, NULL, fullfilenamem, (void *)FTYPE_IMAGE, currenttime_tv);
     }
 }
@@ -620,7 +755,7 @@ static void event_image_snapshot(struct context *cnt,
             , cnt->conf.target_dir
             , (int)(PATH_MAX-1-strlen(cnt->conf.target_dir))
             , filename);
-        put_picture(cnt, fullfilename, img_data->image_norm, FTYPE_IMAGE_SNAPSHOT);
+        put_picture_image(cnt, fullfilename, img_data, cnt->overlay_picture, FTYPE_IMAGE_SNAPSHOT);
         event(cnt, EVENT_FILECREATE, NULL, fullfilename, (void *)FTYPE_IMAGE_SNAPSHOT, currenttime_tv);
 
         /*
@@ -649,11 +784,9 @@ static void event_image_snapshot(struct context *cnt,
             , (int)(PATH_MAX-1-strlen(cnt->conf.target_dir))
             , filename);
         remove(fullfilename);
-        put_picture(cnt, fullfilename, img_data->image_norm, FTYPE_IMAGE_SNAPSHOT);
+        put_picture_image(cnt, fullfilename, img_data, cnt->overlay_picture, FTYPE_IMAGE_SNAPSHOT);
         event(cnt, EVENT_FILECREATE, NULL, fullfilename, (void *)FTYPE_IMAGE_SNAPSHOT, currenttime_tv);
     }
-
-    cnt->snapshot = 0;
 }
 
 /**
@@ -664,20 +797,20 @@ static void event_image_snapshot(struct context *cnt,
  */
 static void event_image_preview(struct context *cnt,
             motion_event type ATTRIBUTE_UNUSED,
-            struct image_data *img_data ATTRIBUTE_UNUSED, char *dummy1 ATTRIBUTE_UNUSED,
+            struct image_data *img_data, char *dummy1 ATTRIBUTE_UNUSED,
             void *dummy2 ATTRIBUTE_UNUSED, struct timeval *currenttime_tv)
 {
     int use_imagepath;
     const char *imagepath;
     char previewname[PATH_MAX];
     char filename[PATH_MAX];
-    struct image_data *saved_current_image;
-    int passthrough, retcd;
-
-    if (cnt->imgs.preview_image.diffs) {
-        saved_current_image = cnt->current_image;
-        cnt->current_image = &cnt->imgs.preview_image;
+    int retcd;
 
+    /*
+     * img_data is the preview image.  It is also the image used for the
+     * format specifiers of the file name while this event is processed.
+     */
+    if (img_data->diffs) {
         /* Use filename of movie i.o. jpeg_filename when set to 'preview'. */
         use_imagepath = strcmp(cnt->conf.picture_filename, "preview");
 
@@ -714,12 +847,7 @@ static void event_image_preview(struct context *cnt,
                 }
             }
 
-            passthrough = util_check_passthrough(cnt);
-            if ((cnt->imgs.size_high > 0) && (!passthrough)) {
-                put_picture(cnt, previewname, cnt->imgs.preview_image.image_high , FTYPE_IMAGE);
-            } else {
-                put_picture(cnt, previewname, cnt->imgs.preview_image.image_norm , FTYPE_IMAGE);
-            }
+            put_picture_image(cnt, previewname, img_data, cnt->overlay_picture, FTYPE_IMAGE);
             event(cnt, EVENT_FILECREATE, NULL, previewname, (void *)FTYPE_IMAGE, currenttime_tv);
         } else {
             /*
@@ -736,24 +864,16 @@ static void event_image_preview(struct context *cnt,
             else
                 imagepath = (char *)DEF_IMAGEPATH;
 
-            mystrftime(cnt, filename, sizeof(filename), imagepath, &cnt->imgs.preview_image.timestamp_tv, NULL, 0);
+            mystrftime(cnt, filename, sizeof(filename), imagepath, &img_data->timestamp_tv, NULL, 0);
             snprintf(previewname, PATH_MAX, "%.*s/%.*s.%s"
                 , (int)(PATH_MAX-2-strlen(filename)-strlen(imageext(cnt)))
                 , cnt->conf.target_dir
                 , (int)(PATH_MAX-2-strlen(cnt->conf.target_dir)-strlen(imageext(cnt)))
                 , filename, imageext(cnt));
 
-            passthrough = util_check_passthrough(cnt);
-            if ((cnt->imgs.size_high > 0) && (!passthrough)) {
-                put_picture(cnt, previewname, cnt->imgs.preview_image.image_high , FTYPE_IMAGE);
-            } else {
-                put_picture(cnt, previewname, cnt->imgs.preview_image.image_norm, FTYPE_IMAGE);
-            }
+            put_picture_image(cnt, previewname, img_data, cnt->overlay_picture, FTYPE_IMAGE);
             event(cnt, EVENT_FILECREATE, NULL, previewname, (void *)FTYPE_IMAGE, currenttime_tv);
         }
-
-        /* Restore global context values. */
-        cnt->current_image = saved_current_image;
     }
 }
 
@@ -794,6 +914,7 @@ static void event_extpipe_end(struct context *cnt,
 {
     if (cnt->extpipe_open) {
         cnt->extpipe_open = 0;
+        extpipe_stop(cnt);
         fflush(cnt->extpipe);
         MOTION_LOG(NTC, TYPE_EVENTS, NO_ERRNO
             ,_("CLOSING: extpipe file desc %d, error state %d")
@@ -879,6 +1000,7 @@ static void event_create_extpipe(struct context *cnt,
 
         setbuf(cnt->extpipe, NULL);
         cnt->extpipe_open = 1;
+        extpipe_start(cnt);
     }
 }
 
@@ -887,23 +1009,12 @@ static void event_extpipe_put(struct context *cnt,
             struct image_data *img_data, char *dummy1 ATTRIBUTE_UNUSED,
             void *dummy2 ATTRIBUTE_UNUSED, struct timeval *tv1 ATTRIBUTE_UNUSED)
 {
-    int passthrough;
-
     /* Check use_extpipe enabled and ext_pipe not NULL */
     if ((cnt->conf.movie_extpipe_use) && (cnt->extpipe != NULL)) {
         MOTION_LOG(DBG, TYPE_EVENTS, NO_ERRNO, _("Using extpipe"));
-        passthrough = util_check_passthrough(cnt);
         /* Check that is open */
         if ((cnt->extpipe_open) && (fileno(cnt->extpipe) > 0)) {
-            if ((cnt->imgs.size_high > 0) && (!passthrough)){
-                if (!fwrite(img_data->image_high, cnt->imgs.size_high, 1, cnt->extpipe))
-                    MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
-                        ,_("Error writing in pipe , state error %d"), ferror(cnt->extpipe));
-            } else {
-                if (!fwrite(img_data->image_norm, cnt->imgs.size_norm, 1, cnt->extpipe))
-                    MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
-                        ,_("Error writing in pipe , state error %d"), ferror(cnt->extpipe));
-           }
+            extpipe_put(cnt, img_data);
         } else {
             MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO
                 ,_("pipe %s not created or closed already "), cnt->extpipecmdline);
@@ -912,22 +1023,6 @@ static void event_extpipe_put(struct context *cnt,
 }
 
 
-static void event_new_video(struct context *cnt,
-            motion_event type ATTRIBUTE_UNUSED,
-            struct image_data *dummy ATTRIBUTE_UNUSED, char *dummy1 ATTRIBUTE_UNUSED,
-            void *dummy2 ATTRIBUTE_UNUSED, struct timeval *tv1 ATTRIBUTE_UNUSED)
-{
-    cnt->movie_last_shot = -1;
-
-    cnt->movie_fps = cnt->lastrate;
-
-    MOTION_LOG(INF, TYPE_EVENTS, NO_ERRNO, _("Source FPS %d"), cnt->movie_fps);
-
-    if (cnt->movie_fps < 2) cnt->movie_fps = 2;
-
-}
-
-
 static void event_ffmpeg_newfile(struct context *cnt,
             motion_event type ATTRIBUTE_UNUSED,
             struct image_data *dummy0 ATTRIBUTE_UNUSED,
@@ -1062,6 +1157,9 @@ static void event_ffmpeg_newfile(struct context *cnt,
         }
         cnt->ffmpeg_output->motion_images = 0;
         cnt->ffmpeg_output->passthrough =util_check_passthrough(cnt);
+        cnt->ffmpeg_output->encoder_queue = cnt->conf.movie_encoder_queue;
+        cnt->ffmpeg_output->encoder_threads = cnt->conf.movie_encoder_threads;
+        cnt->ffmpeg_output->encoder_params = cnt->conf.movie_encoder_params;
 
 
         retcd = ffmpeg_open(cnt->ffmpeg_output);
@@ -1100,6 +1198,9 @@ static void event_ffmpeg_newfile(struct context *cnt,
         cnt->ffmpeg_output_motion->passthrough = FALSE;
         cnt->ffmpeg_output_motion->high_resolution = FALSE;
         cnt->ffmpeg_output_motion->rtsp_data = NULL;
+        cnt->ffmpeg_output_motion->encoder_queue = cnt->conf.movie_encoder_queue;
+        cnt->ffmpeg_output_motion->encoder_threads = cnt->conf.movie_encoder_threads;
+        cnt->ffmpeg_output_motion->encoder_params = cnt->conf.movie_encoder_params;
 
         retcd = ffmpeg_open(cnt->ffmpeg_output_motion);
         if (retcd < 0){
@@ -1117,6 +1218,7 @@ static void event_ffmpeg_timelapse(struct context *cnt,
             char *dummy1 ATTRIBUTE_UNUSED, void *dummy2 ATTRIBUTE_UNUSED,
             struct timeval *currenttime_tv)
 {
+    struct image_data img_movie;
     int retcd;
     int passthrough;
 
@@ -1167,6 +1269,10 @@ static void event_ffmpeg_timelapse(struct context *cnt,
         cnt->ffmpeg_timelapse->motion_images = FALSE;
         cnt->ffmpeg_timelapse->passthrough = FALSE;
         cnt->ffmpeg_timelapse->rtsp_data = NULL;
+        cnt->ffmpeg_timelapse->encoder_queue = cnt->conf.movie_encoder_queue;
+        cnt->ffmpeg_timelapse->encoder_threads = cnt->conf.movie_encoder_threads;
+        cnt->ffmpeg_timelapse->encoder_params = cnt->conf.movie_encoder_params;
+        cnt->ffmpeg_timelapse->tlapse_flush = cnt->conf.timelapse_flush;
 
         if ((strcmp(cnt->conf.timelapse_codec,"mpg") == 0) ||
             (strcmp(cnt->conf.timelapse_codec,"swf") == 0) ){
@@ -1201,7 +1307,8 @@ static void event_ffmpeg_timelapse(struct context *cnt,
         event(cnt, EVENT_FILECREATE, NULL, cnt->timelapsefilename, (void *)FTYPE_MPEG_TIMELAPSE, currenttime_tv);
     }
 
-    if (ffmpeg_put_image(cnt->ffmpeg_timelapse, img_data, currenttime_tv) == -1) {
+    event_overlay_image(cnt, &img_movie, img_data, cnt->overlay_movie);
+    if (ffmpeg_put_image(cnt->ffmpeg_timelapse, &img_movie, currenttime_tv) == -1) {
         MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
     }
 
@@ -1210,20 +1317,45 @@ static void event_ffmpeg_timelapse(struct context *cnt,
 static void event_ffmpeg_put(struct context *cnt,
             motion_event type ATTRIBUTE_UNUSED,
             struct image_data *img_data, char *dummy1 ATTRIBUTE_UNUSED,
-            void *dummy2 ATTRIBUTE_UNUSED, struct timeval *currenttime_tv)
+            void *eventdata, struct timeval *currenttime_tv)
 {
+    struct image_data *img_motion;
+    struct image_data img_movie;
+
+    /* Queued events carry their own copy of the motion image */
+    if (eventdata != NULL) {
+        img_motion = (struct image_data *)eventdata;
+    } else {
+        img_motion = &cnt->imgs.img_motion;
+    }
+
     if (cnt->ffmpeg_output) {
-        if (ffmpeg_put_image(cnt->ffmpeg_output, img_data, currenttime_tv) == -1){
+        event_overlay_image(cnt, &img_movie, img_data, cnt->overlay_movie);
+        if (ffmpeg_put_image(cnt->ffmpeg_output, &img_movie, currenttime_tv) == -1){
             MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
         }
     }
     if (cnt->ffmpeg_output_motion) {
-        if (ffmpeg_put_image(cnt->ffmpeg_output_motion, &cnt->imgs.img_motion, currenttime_tv) == -1) {
+        if (ffmpeg_put_image(cnt->ffmpeg_output_motion, img_motion, currenttime_tv) == -1) {
             MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
         }
     }
 }
 
+static void event_ffmpeg_resume(struct context *cnt,
+            motion_event type ATTRIBUTE_UNUSED,
+            struct image_data *dummy1 ATTRIBUTE_UNUSED,
+            char *dummy2 ATTRIBUTE_UNUSED, void *dummy3 ATTRIBUTE_UNUSED,
+            struct timeval *currenttime_tv)
+{
+    /*
+     * Motion resumed during the post capture of a movie.  Reset the start
+     * time so that the movie does not get a pause.
+     */
+    if (cnt->ffmpeg_output)
+        ffmpeg_reset_movie_start_time(cnt->ffmpeg_output, currenttime_tv);
+}
+
 static void event_ffmpeg_closefile(struct context *cnt,
             motion_event type ATTRIBUTE_UNUSED,
             struct image_data *dummy1 ATTRIBUTE_UNUSED,
@@ -1262,6 +1394,32 @@ static void event_ffmpeg_timelapseend(struct context *cnt,
 }
 
 
+static void event_segment_put(struct context *cnt,
+            motion_event type ATTRIBUTE_UNUSED,
+            struct image_data *img_data, char *dummy1 ATTRIBUTE_UNUSED,
+            void *dummy2 ATTRIBUTE_UNUSED, struct timeval *currenttime_tv)
+{
+    segment_put(cnt, img_data, currenttime_tv);
+}
+
+static void event_segment_start(struct context *cnt,
+            motion_event type ATTRIBUTE_UNUSED,
+            struct image_data *dummy1 ATTRIBUTE_UNUSED,
+            char *dummy2 ATTRIBUTE_UNUSED, void *dummy3 ATTRIBUTE_UNUSED,
+            struct timeval *currenttime_tv)
+{
+    segment_event_start(cnt, currenttime_tv);
+}
+
+static void event_segment_end(struct context *cnt,
+            motion_event type ATTRIBUTE_UNUSED,
+            struct image_data *dummy1 ATTRIBUTE_UNUSED,
+            char *dummy2 ATTRIBUTE_UNUSED, void *dummy3 ATTRIBUTE_UNUSED,
+            struct timeval *currenttime_tv)
+{
+    segment_event_end(cnt, currenttime_tv);
+}
+
 
 /*
  * Starting point for all events
@@ -1345,10 +1503,6 @@ struct event_handlers event_handlers[] = {
     },
     {
     EVENT_FIRSTMOTION,
-    event_new_video
-    },
-    {
-    EVENT_FIRSTMOTION,
     event_ffmpeg_newfile
     },
     {
@@ -1360,6 +1514,10 @@ struct event_handlers event_handlers[] = {
     event_ffmpeg_put
     },
     {
+    EVENT_FFMPEG_RESUME,
+    event_ffmpeg_resume
+    },
+    {
     EVENT_ENDMOTION,
     event_ffmpeg_closefile
     },
@@ -1371,6 +1529,18 @@ struct event_handlers event_handlers[] = {
     EVENT_TIMELAPSEEND,
     event_ffmpeg_timelapseend
     },
+    {
+    EVENT_SEGMENT_PUT,
+    event_segment_put
+    },
+    {
+    EVENT_FIRSTMOTION,
+    event_segment_start
+    },
+    {
+    EVENT_ENDMOTION,
+    event_segment_end
+    },
 #if defined(HAVE_MYSQL) || defined(HAVE_PGSQL) || defined(HAVE_SQLITE3) || defined(HAVE_MARIADB)
     {
     EVENT_FILECLOSE,
@@ -1420,9 +1590,23 @@ struct event_handlers event_handlers[] = {
  *      - tm - A tm struct that carries a full time structure
  * The split between unsigned images and signed filenames was introduced in 3.2.2
  * as a code reading friendly solution to avoid a stream of compiler warnings in gcc 4.0.
+ * Events that write pictures and movies are passed to the output workers.
  */
 void event(struct context *cnt, motion_event type, struct image_data *img_data,
            char *filename, void *eventdata, struct timeval *tv1)
+{
+    if (outpool_event(cnt, type, img_data, filename, eventdata, tv1))
+        return;
+
+    event_dispatch(cnt, type, img_data, filename, eventdata, tv1);
+}
+
+/**
+ * event_dispatch
+ *   Calls the handlers of the event in the calling thread.
+ */
+void event_dispatch(struct context *cnt, motion_event type, struct image_data *img_data,
+           char *filename, void *eventdata, struct timeval *tv1)
 {
     int i=-1;
 
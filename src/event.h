@@ -32,6 +32,8 @@ typedef enum {
     EVENT_CAMERA_LOST,
     EVENT_CAMERA_FOUND,
     EVENT_FFMPEG_PUT,
+    EVENT_FFMPEG_RESUME,
+    EVENT_SEGMENT_PUT,
     EVENT_LAST,
 } motion_event;
 
@@ -39,6 +41,7 @@ typedef void(* event_handler)(struct context *, motion_event, struct image_data
              char *, void *, struct timeval *);
 
 void event(struct context *, motion_event, struct image_data *img_data, char *, void *, struct timeval *);
+void event_dispatch(struct context *, motion_event, struct image_data *img_data, char *, void *, struct timeval *);
 const char * imageext(struct context *);
 
 #endif /* _INCLUDE_EVENT_H_ */
@@ -0,0 +1,326 @@
+/*
+ *    extpipe.c
+ *
+ *    Writer of the raw frames sent to the movie_extpipe process
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    The frames of an event are written to the pipe by a thread of the pipe
+ *    so a slow external encoder only holds up that thread, not the output
+ *    worker of the camera and the pictures and movies queued behind it.
+ *    Frames are queued in a ring of movie_encoder_queue slots holding a
+ *    reference to their storage.  When the ring is full the oldest frame
+ *    is dropped, the process gets the latest frames rather than falling
+ *    further behind.  With movie_encoder_queue 0 the frames are written by
+ *    the caller.  The pipe is enlarged to hold a couple of frames where the
+ *    system allows it.
+ */
+
+#include "motion.h"
+#include "translate.h"
+#include "overlay.h"
+#include "extpipe.h"
+
+/* Guards cnt->extpipe_writer for the status page.  It is only changed by
+ * the output worker of the camera, which reads it without the lock */
+static pthread_mutex_t  extpipe_status_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define EXTPIPE_FRAMES      2           /* Frames the pipe is enlarged to hold */
+#define EXTPIPE_PIPE_MAX    (1024 * 1024)   /* Default limit for unprivileged users */
+
+struct extpipe_frame {
+    struct image_buffer *buffer;        /* Referenced storage of the image or NULL */
+    unsigned char      *image;          /* Image to write */
+    unsigned char      *copy;           /* Copy of an image without storage */
+};
+
+struct extpipe_writer {
+    pthread_t           thread;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;           /* Frame queued or finish */
+    struct extpipe_frame *frames;
+    int                 size;           /* Slots of frames */
+    int                 head;           /* Oldest queued frame */
+    int                 count;          /* Frames queued and not yet taken by the thread */
+    int                 fd;
+    int                 threadnr;       /* Camera the thread logs for */
+    int                 finish;
+    int                 error;          /* Writing failed, later frames are discarded */
+
+    /* Statistics */
+    unsigned long       cnt_frames;
+    unsigned long       drops;
+    int                 depth_max;
+};
+
+static int extpipe_frame_size(struct context *cnt){
+    /* Bytes of a frame sent to the pipe */
+
+    if ((cnt->imgs.size_high > 0) && (!util_check_passthrough(cnt))) {
+        return cnt->imgs.size_high;
+    }
+
+    return cnt->imgs.size_norm;
+}
+
+static unsigned char *extpipe_frame_image(struct context *cnt, struct image_data *img_data){
+    /* Image of the frame sent to the pipe */
+
+    if ((cnt->imgs.size_high > 0) && (!util_check_passthrough(cnt))) {
+        return img_data->image_high;
+    }
+
+    return overlay_image(cnt, img_data, cnt->overlay_movie);
+}
+
+static void extpipe_frame_release(struct extpipe_frame *frame){
+
+    outpool_buffer_unref(frame->buffer);
+    free(frame->copy);
+    frame->buffer = NULL;
+    frame->copy = NULL;
+    frame->image = NULL;
+
+}
+
+static int extpipe_write(int fd, const unsigned char *image, int len){
+    /* Write a whole frame, returns -1 when the pipe failed */
+    ssize_t written;
+    int done;
+
+    done = 0;
+    while (done < len) {
+        written = write(fd, image + done, len - done);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += written;
+    }
+
+    return 0;
+}
+
+static void *extpipe_handler(void *arg){
+    struct context *cnt = arg;
+    struct extpipe_writer *writer = cnt->extpipe_writer;
+    struct extpipe_frame frame;
+    int image_size, retcd;
+
+    pthread_setspecific(tls_key_threadnr, (void *)((unsigned long)writer->threadnr));
+    util_threadname_set("ep", writer->threadnr, NULL);
+
+    image_size = extpipe_frame_size(cnt);
+
+    pthread_mutex_lock(&writer->mutex);
+    while (TRUE) {
+        while ((writer->count == 0) && (!writer->finish)) {
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        }
+        if (writer->count == 0) break;
+
+        /* Take the frame out of the ring so it can not be dropped while written */
+        frame = writer->frames[writer->head];
+        memset(&writer->frames[writer->head], 0, sizeof(struct extpipe_frame));
+        writer->head = (writer->head + 1) % writer->size;
+        writer->count--;
+        pthread_mutex_unlock(&writer->mutex);
+
+        retcd = 0;
+        if (!writer->error) retcd = extpipe_write(writer->fd, frame.image, image_size);
+        extpipe_frame_release(&frame);
+
+        pthread_mutex_lock(&writer->mutex);
+        if ((retcd == -1) && (!writer->error)) {
+            MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
+                ,_("Error writing in pipe %s"), cnt->extpipecmdline);
+            writer->error = TRUE;
+        }
+    }
+    pthread_mutex_unlock(&writer->mutex);
+
+    return NULL;
+}
+
+static void extpipe_writer_free(struct extpipe_writer *writer){
+    int indx;
+
+    for (indx = 0; indx < writer->size; indx++) {
+        extpipe_frame_release(&writer->frames[indx]);
+    }
+    free(writer->frames);
+    pthread_mutex_destroy(&writer->mutex);
+    pthread_cond_destroy(&writer->cond);
+    free(writer);
+
+}
+
+static void extpipe_pipe_size(struct context *cnt){
+    /* Let the pipe hold a couple of frames rather than the default 64 kB */
+#ifdef F_SETPIPE_SZ
+    int fd, size;
+
+    fd = fileno(cnt->extpipe);
+    size = extpipe_frame_size(cnt) * EXTPIPE_FRAMES;
+
+    if (fcntl(fd, F_SETPIPE_SZ, size) == -1) {
+        if ((size <= EXTPIPE_PIPE_MAX) || (fcntl(fd, F_SETPIPE_SZ, EXTPIPE_PIPE_MAX) == -1)) {
+            MOTION_LOG(DBG, TYPE_EVENTS, SHOW_ERRNO
+                ,_("Unable to enlarge the pipe to %d bytes"), size);
+            return;
+        }
+    }
+    MOTION_LOG(DBG, TYPE_EVENTS, NO_ERRNO
+        ,_("Pipe holds %d bytes"), fcntl(fd, F_GETPIPE_SZ));
+#else
+    (void)cnt;
+#endif
+}
+
+void extpipe_start(struct context *cnt){
+    /* Start the thread writing the frames of the pipe just opened */
+    struct extpipe_writer *writer;
+    pthread_attr_t attr;
+    int retcd;
+
+    extpipe_pipe_size(cnt);
+
+    /* cnt->extpipe_writer is NULL while no pipe is open */
+    if (cnt->conf.movie_encoder_queue <= 0) return;
+
+    writer = mymalloc(sizeof(struct extpipe_writer));
+    memset(writer, 0, sizeof(struct extpipe_writer));
+    writer->size = cnt->conf.movie_encoder_queue;
+    writer->frames = mymalloc(sizeof(struct extpipe_frame) * writer->size);
+    memset(writer->frames, 0, sizeof(struct extpipe_frame) * writer->size);
+    writer->fd = fileno(cnt->extpipe);
+    writer->threadnr = (int)(unsigned long)pthread_getspecific(tls_key_threadnr);
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    pthread_mutex_lock(&extpipe_status_mutex);
+        cnt->extpipe_writer = writer;
+    pthread_mutex_unlock(&extpipe_status_mutex);
+
+    pthread_attr_init(&attr);
+    retcd = pthread_create(&writer->thread, &attr, &extpipe_handler, cnt);
+    pthread_attr_destroy(&attr);
+    if (retcd != 0) {
+        MOTION_LOG(WRN, TYPE_EVENTS, SHOW_ERRNO
+            ,_("Unable to start the pipe thread, writing in the caller"));
+        pthread_mutex_lock(&extpipe_status_mutex);
+            cnt->extpipe_writer = NULL;
+        pthread_mutex_unlock(&extpipe_status_mutex);
+        extpipe_writer_free(writer);
+    }
+
+}
+
+void extpipe_put(struct context *cnt, struct image_data *img_data){
+    /* Queue a frame for the pipe, dropping the oldest one when the ring is full */
+    struct extpipe_writer *writer = cnt->extpipe_writer;
+    struct extpipe_frame queued, dropped;
+    unsigned char *image;
+    int image_size;
+
+    image = extpipe_frame_image(cnt, img_data);
+    image_size = extpipe_frame_size(cnt);
+
+    if (writer == NULL) {
+        if (!fwrite(image, image_size, 1, cnt->extpipe))
+            MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
+                ,_("Error writing in pipe , state error %d"), ferror(cnt->extpipe));
+        return;
+    }
+
+    /* Ring images are queued by reference and other images copied */
+    memset(&queued, 0, sizeof(struct extpipe_frame));
+    if (img_data->buffer != NULL) {
+        outpool_buffer_ref(img_data->buffer);
+        queued.buffer = img_data->buffer;
+        queued.image = image;
+    } else {
+        queued.copy = mymalloc(image_size);
+        memcpy(queued.copy, image, image_size);
+        queued.image = queued.copy;
+    }
+
+    memset(&dropped, 0, sizeof(struct extpipe_frame));
+
+    pthread_mutex_lock(&writer->mutex);
+        if (writer->error) {
+            pthread_mutex_unlock(&writer->mutex);
+            extpipe_frame_release(&queued);
+            return;
+        }
+
+        if (writer->count == writer->size) {
+            dropped = writer->frames[writer->head];
+            memset(&writer->frames[writer->head], 0, sizeof(struct extpipe_frame));
+            writer->head = (writer->head + 1) % writer->size;
+            writer->count--;
+            writer->drops++;
+            if ((writer->drops % 100) == 1) {
+                MOTION_LOG(WRN, TYPE_EVENTS, NO_ERRNO
+                    ,_("Pipe queue full, %lu frames dropped"), writer->drops);
+            }
+        }
+
+        writer->frames[(writer->head + writer->count) % writer->size] = queued;
+        writer->count++;
+        writer->cnt_frames++;
+        if (writer->count > writer->depth_max) writer->depth_max = writer->count;
+        pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    extpipe_frame_release(&dropped);
+
+}
+
+void extpipe_stop(struct context *cnt){
+    /* Let the thread write the queued frames and stop it */
+    struct extpipe_writer *writer = cnt->extpipe_writer;
+
+    if (writer == NULL) return;
+
+    pthread_mutex_lock(&writer->mutex);
+        writer->finish = TRUE;
+        pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+
+    if (writer->cnt_frames > 0) {
+        MOTION_LOG(INF, TYPE_EVENTS, NO_ERRNO
+            ,_("Pipe queue: %lu frames, max depth %d, dropped %lu")
+            ,writer->cnt_frames, writer->depth_max, writer->drops);
+    }
+
+    pthread_mutex_lock(&extpipe_status_mutex);
+        cnt->extpipe_writer = NULL;
+    pthread_mutex_unlock(&extpipe_status_mutex);
+    extpipe_writer_free(writer);
+
+}
+
+int extpipe_status(struct context *cnt, int *depth, int *depth_max, unsigned long *drops){
+    /* Queue of the open pipe for the status page, FALSE when no thread writes the pipe */
+    struct extpipe_writer *writer;
+    int retcd;
+
+    retcd = FALSE;
+    pthread_mutex_lock(&extpipe_status_mutex);
+        writer = cnt->extpipe_writer;
+        if (writer != NULL) {
+            pthread_mutex_lock(&writer->mutex);
+                *depth = writer->count;
+                *depth_max = writer->depth_max;
+                *drops = writer->drops;
+            pthread_mutex_unlock(&writer->mutex);
+            retcd = TRUE;
+        }
+    pthread_mutex_unlock(&extpipe_status_mutex);
+
+    return retcd;
+}
@@ -0,0 +1,21 @@
+/*
+ *    extpipe.h
+ *
+ *    Include file for extpipe.c
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ */
+#ifndef _INCLUDE_EXTPIPE_H_
+#define _INCLUDE_EXTPIPE_H_
+
+struct context;
+struct image_data;
+
+void extpipe_start(struct context *cnt);
+void extpipe_put(struct context *cnt, struct image_data *img_data);
+void extpipe_stop(struct context *cnt);
+int extpipe_status(struct context *cnt, int *depth, int *depth_max, unsigned long *drops);
+
+#endif /* _INCLUDE_EXTPIPE_H_ */
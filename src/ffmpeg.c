@@ -80,6 +80,9 @@
 
 #endif
 
+/* Size of the buffer the muxer of a live stream writes through */
+#define FFMPEG_LIVE_BUFSIZE         (64 * 1024)
+
 /*********************************************/
 AVFrame *my_frame_alloc(void){
     AVFrame *pic;
@@ -215,29 +218,108 @@ static int ffmpeg_encode_nal(struct ffmpeg *ffmpeg){
 }
 
 static int ffmpeg_timelapse_exists(const char *fname){
-    FILE *file;
-    file = fopen(fname, "r");
-    if (file)
-    {
-        fclose(file);
-        return 1;
-    }
+    struct stat statbuf;
+
+    if (stat(fname, &statbuf) == 0) return 1;
+
+    return 0;
+}
+
+/*
+ * The appended timelapse file is kept open with a large buffer for as long as
+ * the timelapse movie is, so each frame costs a memory copy rather than an
+ * open, a write and a close.  The buffer goes to the file every tlapse_flush
+ * seconds and when the movie is closed.
+ */
+static int ffmpeg_timelapse_open(struct ffmpeg *ffmpeg){
+
+    ffmpeg->tlapse_file = myfopen(ffmpeg->filename, "a");
+    if (ffmpeg->tlapse_file == NULL) return -1;
+
+    ffmpeg->tlapse_buf = mymalloc(TIMELAPSE_BUFFER_SIZE);
+    setvbuf(ffmpeg->tlapse_file, ffmpeg->tlapse_buf, _IOFBF, TIMELAPSE_BUFFER_SIZE);
+    ffmpeg->tlapse_flushed = 0;
+
     return 0;
 }
 
-static int ffmpeg_timelapse_append(struct ffmpeg *ffmpeg, AVPacket pkt){
-    FILE *file;
+static void ffmpeg_timelapse_close(struct ffmpeg *ffmpeg){
+
+    if (ffmpeg->tlapse_file == NULL) return;
+
+    if (myfclose(ffmpeg->tlapse_file) != 0) {
+        MOTION_LOG(ERR, TYPE_ENCODER, SHOW_ERRNO
+            ,_("Error closing timelapse file %s"), ffmpeg->filename);
+    }
+    ffmpeg->tlapse_file = NULL;
+
+    free(ffmpeg->tlapse_buf);
+    ffmpeg->tlapse_buf = NULL;
+}
 
-    file = fopen(ffmpeg->filename, "a");
-    if (!file) return -1;
+static int ffmpeg_timelapse_append(struct ffmpeg *ffmpeg, AVPacket pkt, const struct timeval *tv1){
 
-    fwrite(pkt.data,1,pkt.size,file);
+    if (ffmpeg->tlapse_file == NULL) return -1;
 
-    fclose(file);
+    if (fwrite(pkt.data, 1, pkt.size, ffmpeg->tlapse_file) != (size_t)pkt.size) {
+        MOTION_LOG(ERR, TYPE_ENCODER, SHOW_ERRNO
+            ,_("Error writing timelapse file %s"), ffmpeg->filename);
+        return -1;
+    }
+
+    if ((tv1->tv_sec - ffmpeg->tlapse_flushed) >= ffmpeg->tlapse_flush) {
+        if (fflush(ffmpeg->tlapse_file) != 0) {
+            MOTION_LOG(ERR, TYPE_ENCODER, SHOW_ERRNO
+                ,_("Error flushing timelapse file %s"), ffmpeg->filename);
+            return -1;
+        }
+        ffmpeg->tlapse_flushed = tv1->tv_sec;
+    }
 
     return 0;
 }
 
+static int ffmpeg_segment_file(struct ffmpeg *ffmpeg){
+    /* Continue the recording in the file of segment_next */
+    AVIOContext *pb;
+
+    if (avio_open(&pb, ffmpeg->segment_next, MY_FLAG_WRITE) < 0) {
+        if ((errno != ENOENT) || (create_path(ffmpeg->segment_next) == -1) ||
+            (avio_open(&pb, ffmpeg->segment_next, MY_FLAG_WRITE) < 0)) {
+            MOTION_LOG(ERR, TYPE_ENCODER, SHOW_ERRNO
+                ,_("Error opening file %s"), ffmpeg->segment_next);
+            return -1;
+        }
+    }
+
+    /* Write what the muxer holds for the frames before the split */
+    av_write_frame(ffmpeg->oc, NULL);
+    avio_close(ffmpeg->oc->pb);
+    ffmpeg->oc->pb = pb;
+
+    return 0;
+}
+
+static void ffmpeg_segment_key(struct ffmpeg *ffmpeg, const struct timeval *tv1){
+    /*
+     * A key frame is about to be written to a continuous recording.  A file
+     * that is due is started with it, and the tables of the stream are sent
+     * again ahead of it so the recording can be cut at any key frame.
+     */
+    if (!ffmpeg->segment) return;
+
+    if (ffmpeg->segment_next != NULL) {
+        if (ffmpeg_segment_file(ffmpeg) == 0) ffmpeg->segment_split = TRUE;
+        ffmpeg->segment_next = NULL;
+    }
+
+    av_opt_set(ffmpeg->oc->priv_data, "mpegts_flags", "+resend_headers", 0);
+
+    ffmpeg->key_offset = avio_tell(ffmpeg->oc->pb);
+    ffmpeg->key_tv.tv_sec = tv1->tv_sec;
+    ffmpeg->key_tv.tv_usec = tv1->tv_usec;
+}
+
 #if (LIBAVFORMAT_VERSION_MAJOR < 58)
 /* TODO Determine if this is even needed for old versions. Per
  * documentation for version 58, 'av_lockmgr_register This function does nothing'
@@ -405,6 +487,12 @@ static int ffmpeg_get_oformat(struct ffmpeg *ffmpeg){
         if (ffmpeg->oc->oformat) ffmpeg->oc->oformat->video_codec = MY_CODEC_ID_HEVC;
     }
 
+    if (strcmp(codec_name, "mpegts") == 0) {
+        ffmpeg->oc->oformat = av_guess_format("mpegts", NULL, NULL);
+        retcd = snprintf(ffmpeg->filename,PATH_MAX,"%s.ts",basename);
+        if (ffmpeg->oc->oformat) ffmpeg->oc->oformat->video_codec = MY_CODEC_ID_H264;
+    }
+
     //Check for valid results
     if ((retcd < 0) || (retcd >= PATH_MAX)){
         MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO
@@ -758,6 +846,7 @@ static int ffmpeg_set_codec(struct ffmpeg *ffmpeg){
     int retcd;
     char errstr[128];
     int chkrate;
+    AVDictionaryEntry *entry;
 
     retcd = ffmpeg_set_codec_preferred(ffmpeg);
     if (retcd != 0) return retcd;
@@ -850,6 +939,19 @@ static int ffmpeg_set_codec(struct ffmpeg *ffmpeg){
         return -1;
     }
 
+    /* Timelapse frames must not be held back by frame threading */
+    if ((ffmpeg->tlapse == TIMELAPSE_NONE) && (ffmpeg->encoder_threads >= 0)) {
+        ffmpeg->ctx_codec->thread_count = ffmpeg->encoder_threads;
+    }
+    if ((ffmpeg->encoder_params != NULL) && (ffmpeg->encoder_params[0] != '\0')) {
+        retcd = av_dict_parse_string(&ffmpeg->opts, ffmpeg->encoder_params, "=", ",", 0);
+        if (retcd < 0) {
+            av_strerror(retcd, errstr, sizeof(errstr));
+            MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO
+                ,_("Invalid encoder parameters %s: %s"), ffmpeg->encoder_params, errstr);
+        }
+    }
+
     retcd = avcodec_open2(ffmpeg->ctx_codec, ffmpeg->codec, &ffmpeg->opts);
     if (retcd < 0) {
         if (ffmpeg->codec->supported_framerates) {
@@ -875,6 +977,12 @@ static int ffmpeg_set_codec(struct ffmpeg *ffmpeg){
         }
 
     }
+    /* The codec takes the options it knows out of the dictionary */
+    entry = NULL;
+    while ((entry = av_dict_get(ffmpeg->opts, "", entry, AV_DICT_IGNORE_SUFFIX)) != NULL) {
+        MOTION_LOG(WRN, TYPE_ENCODER, NO_ERRNO
+            ,_("Encoder parameter %s not used by %s"), entry->key, ffmpeg->codec->name);
+    }
     av_dict_free(&ffmpeg->opts);
 
     return 0;
@@ -998,6 +1106,69 @@ static int ffmpeg_set_picture(struct ffmpeg *ffmpeg){
 
 }
 
+#if (LIBAVFORMAT_VERSION_MAJOR >= 61)
+static int ffmpeg_live_write(void *opaque, const uint8_t *buf, int buf_size){
+#else
+static int ffmpeg_live_write(void *opaque, uint8_t *buf, int buf_size){
+#endif
+    /* Hand the output of the muxer to the live stream */
+    struct ffmpeg *ffmpeg = opaque;
+
+    return ffmpeg->live_write(ffmpeg->live_opaque, buf, buf_size);
+}
+
+static void ffmpeg_live_free(struct ffmpeg *ffmpeg){
+    /* Release the I/O context of a live stream */
+
+    if (ffmpeg->oc->pb == NULL) return;
+
+    av_freep(&ffmpeg->oc->pb->buffer);
+#if (LIBAVFORMAT_VERSION_MAJOR >= 58)
+    avio_context_free(&ffmpeg->oc->pb);
+#else
+    av_freep(&ffmpeg->oc->pb);
+#endif
+
+}
+
+static int ffmpeg_set_outputlive(struct ffmpeg *ffmpeg){
+    /* Send the output of the muxer to live_write instead of a file */
+    unsigned char *buf;
+    int retcd;
+    char errstr[128];
+
+    buf = av_malloc(FFMPEG_LIVE_BUFSIZE);
+    if (buf == NULL) {
+        MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO, _("Could not allocate live stream buffer"));
+        ffmpeg_free_context(ffmpeg);
+        return -1;
+    }
+
+    ffmpeg->oc->pb = avio_alloc_context(buf, FFMPEG_LIVE_BUFSIZE, 1, ffmpeg
+        , NULL, ffmpeg_live_write, NULL);
+    if (ffmpeg->oc->pb == NULL) {
+        MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO, _("Could not allocate live stream context"));
+        av_free(buf);
+        ffmpeg_free_context(ffmpeg);
+        return -1;
+    }
+    ffmpeg->oc->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    retcd = avformat_write_header(ffmpeg->oc, NULL);
+    if (retcd < 0){
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO
+            ,_("Could not write ffmpeg header %s"),errstr);
+        ffmpeg_live_free(ffmpeg);
+        ffmpeg_free_context(ffmpeg);
+        return -1;
+    }
+    avio_flush(ffmpeg->oc->pb);
+
+    return 0;
+
+}
+
 static int ffmpeg_set_outputfile(struct ffmpeg *ffmpeg){
 
     int retcd;
@@ -1007,6 +1178,8 @@ static int ffmpeg_set_outputfile(struct ffmpeg *ffmpeg){
     snprintf(ffmpeg->oc->filename, sizeof(ffmpeg->oc->filename), "%s", ffmpeg->filename);
 #endif
 
+    if (ffmpeg->live_write != NULL) return ffmpeg_set_outputlive(ffmpeg);
+
     /* Open the output file, if needed. */
     if ((ffmpeg_timelapse_exists(ffmpeg->filename) == 0) || (ffmpeg->tlapse != TIMELAPSE_APPEND)) {
         if (!(ffmpeg->oc->oformat->flags & AVFMT_NOFILE)) {
@@ -1056,6 +1229,13 @@ static int ffmpeg_set_outputfile(struct ffmpeg *ffmpeg){
 
     }
 
+    if (ffmpeg->tlapse == TIMELAPSE_APPEND) {
+        if (ffmpeg_timelapse_open(ffmpeg) < 0) {
+            ffmpeg_free_context(ffmpeg);
+            return -1;
+        }
+    }
+
     return 0;
 
 }
@@ -1147,8 +1327,13 @@ static int ffmpeg_put_frame(struct ffmpeg *ffmpeg, const struct timeval *tv1){
         return retcd;
     }
 
+    if (ffmpeg->pkt.flags & AV_PKT_FLAG_KEY) {
+        ffmpeg->live_key = TRUE;
+        ffmpeg_segment_key(ffmpeg, tv1);
+    }
+
     if (ffmpeg->tlapse == TIMELAPSE_APPEND) {
-        retcd = ffmpeg_timelapse_append(ffmpeg, ffmpeg->pkt);
+        retcd = ffmpeg_timelapse_append(ffmpeg, ffmpeg->pkt, tv1);
     } else {
         retcd = av_write_frame(ffmpeg->oc, &ffmpeg->pkt);
     }
@@ -1184,7 +1369,14 @@ static void ffmpeg_passthru_write(struct ffmpeg *ffmpeg, int indx){
     ffmpeg->pkt.size = 0;
 
 
-    ffmpeg->rtsp_data->pktarray[indx].iswritten = TRUE;
+    /* Live streams and continuous recordings leave the flags to the movies of the camera */
+    if ((ffmpeg->live_write == NULL) && (!ffmpeg->segment)) {
+        ffmpeg->rtsp_data->pktarray[indx].iswritten = TRUE;
+    }
+    if (ffmpeg->rtsp_data->pktarray[indx].iskey) {
+        ffmpeg->live_key = TRUE;
+        ffmpeg_segment_key(ffmpeg, &ffmpeg->rtsp_data->pktarray[indx].timestamp_tv);
+    }
 
     retcd = my_copy_packet(&ffmpeg->pkt, &ffmpeg->rtsp_data->pktarray[indx].packet);
     if (retcd < 0) {
@@ -1213,6 +1405,51 @@ static void ffmpeg_passthru_write(struct ffmpeg *ffmpeg, int indx){
 
 }
 
+static void ffmpeg_passthru_live(struct ffmpeg *ffmpeg, int64_t idnbr_image){
+    /* Write the packets up to the image to a live stream or a continuous
+     * recording.  The packets are followed by number since the written flags
+     * belong to the movies.  The stream starts at the latest key frame and
+     * starts over at the latest key frame when packets it had not written
+     * yet have left the buffer.
+     */
+    struct packet_item *item;
+    int64_t idnbr_next, idnbr_key;
+    int indx, indx_next, indx_key;
+
+    pthread_mutex_lock(&ffmpeg->rtsp_data->mutex_pktarray);
+        while (TRUE) {
+            indx_next = -1;
+            indx_key = -1;
+            idnbr_next = 0;
+            idnbr_key = 0;
+            for(indx = 0; indx < ffmpeg->rtsp_data->pktarray_size; indx++) {
+                item = &ffmpeg->rtsp_data->pktarray[indx];
+                if ((item->packet.size <= 0) || (item->idnbr > idnbr_image)) continue;
+                if ((item->iskey) && (item->idnbr > idnbr_key)) {
+                    idnbr_key = item->idnbr;
+                    indx_key = indx;
+                }
+                if ((item->idnbr > ffmpeg->live_idnbr) &&
+                    ((indx_next == -1) || (item->idnbr < idnbr_next))) {
+                    idnbr_next = item->idnbr;
+                    indx_next = indx;
+                }
+            }
+
+            if ((ffmpeg->live_idnbr == 0) ||
+                ((indx_next != -1) && (idnbr_next != ffmpeg->live_idnbr + 1) &&
+                 (idnbr_key > ffmpeg->live_idnbr))) {
+                indx_next = indx_key;
+            }
+            if (indx_next == -1) break;
+
+            ffmpeg_passthru_write(ffmpeg, indx_next);
+            ffmpeg->live_idnbr = ffmpeg->rtsp_data->pktarray[indx_next].idnbr;
+        }
+    pthread_mutex_unlock(&ffmpeg->rtsp_data->mutex_pktarray);
+
+}
+
 static int ffmpeg_passthru_put(struct ffmpeg *ffmpeg, struct image_data *img_data){
 
     int idnbr_image, idnbr_lastwritten, idnbr_stop, idnbr_firstkey;
@@ -1231,6 +1468,11 @@ static int ffmpeg_passthru_put(struct ffmpeg *ffmpeg, struct image_data *img_dat
         idnbr_image = img_data->idnbr_norm;
     }
 
+    if ((ffmpeg->live_write != NULL) || (ffmpeg->segment)) {
+        ffmpeg_passthru_live(ffmpeg, idnbr_image);
+        return 0;
+    }
+
     pthread_mutex_lock(&ffmpeg->rtsp_data->mutex_pktarray);
         idnbr_lastwritten = 0;
         idnbr_firstkey = idnbr_image;
@@ -1303,7 +1545,8 @@ static int ffmpeg_passthru_codec(struct ffmpeg *ffmpeg){
             return -1;
         }
 
-        if (strcmp(ffmpeg->codec_name, "mp4") != 0){
+        if ((strcmp(ffmpeg->codec_name, "mp4") != 0) &&
+            (strcmp(ffmpeg->codec_name, "mpegts") != 0)){
             MOTION_LOG(NTC, TYPE_ENCODER, NO_ERRNO
                 ,_("pass-through mode enabled.  Changing to MP4 container."));
             ffmpeg->codec_name = "mp4";
@@ -1392,16 +1635,10 @@ void ffmpeg_avcodec_log(void *ignoreme ATTRIBUTE_UNUSED, int errno_flag ATTRIBUT
     }
 }
 
-static void ffmpeg_put_pix_nv21(struct ffmpeg *ffmpeg, struct image_data *img_data){
-    unsigned char *image,*imagecr, *imagecb;
+static void ffmpeg_put_pix_nv21(struct ffmpeg *ffmpeg, unsigned char *image){
+    unsigned char *imagecr, *imagecb;
     int cr_len, x, y;
 
-    if (ffmpeg->high_resolution){
-        image = img_data->image_high;
-    } else {
-        image = img_data->image_norm;
-    }
-
     cr_len = ffmpeg->ctx_codec->width * ffmpeg->ctx_codec->height / 4;
     imagecr = image + (ffmpeg->ctx_codec->width * ffmpeg->ctx_codec->height);
     imagecb = image + (ffmpeg->ctx_codec->width * ffmpeg->ctx_codec->height) + cr_len;
@@ -1418,20 +1655,304 @@ static void ffmpeg_put_pix_nv21(struct ffmpeg *ffmpeg, struct image_data *img_da
 
 }
 
-static void ffmpeg_put_pix_yuv420(struct ffmpeg *ffmpeg, struct image_data *img_data){
-    unsigned char *image;
+#if (LIBAVFORMAT_VERSION_MAJOR >= 55)
+static void ffmpeg_buffer_release(void *opaque, uint8_t *data ATTRIBUTE_UNUSED){
+    /* The codec dropped its last reference to the storage of a frame */
+    outpool_buffer_unref((struct image_buffer *)opaque);
+}
+#endif
 
-    if (ffmpeg->high_resolution){
-        image = img_data->image_high;
-    } else {
-        image = img_data->image_norm;
-    }
+static void ffmpeg_put_pix_yuv420(struct ffmpeg *ffmpeg, unsigned char *image
+            , struct image_buffer *buffer){
 
     // Usual setup for image pointers
     ffmpeg->picture->data[0] = image;
     ffmpeg->picture->data[1] = image + (ffmpeg->ctx_codec->width * ffmpeg->ctx_codec->height);
     ffmpeg->picture->data[2] = ffmpeg->picture->data[1] + ((ffmpeg->ctx_codec->width * ffmpeg->ctx_codec->height) / 4);
 
+#if (LIBAVFORMAT_VERSION_MAJOR >= 55)
+    /*
+     * A frame without buffers is copied by a codec that holds on to it.
+     * Frames of the ring are lent to the codec instead with a reference to
+     * their storage, which returns to the pool once the codec lets go.
+     */
+    if (buffer != NULL) {
+        outpool_buffer_ref(buffer);
+        ffmpeg->picture->buf[0] = av_buffer_create(image
+            , (ffmpeg->ctx_codec->width * ffmpeg->ctx_codec->height * 3) / 2
+            , ffmpeg_buffer_release, buffer, AV_BUFFER_FLAG_READONLY);
+        if (ffmpeg->picture->buf[0] == NULL) outpool_buffer_unref(buffer);
+    }
+#else
+    /* Older versions always copy the frame.  This kills compiler warnings. */
+    if (buffer != NULL) return;
+#endif
+
+}
+
+static void ffmpeg_live_frame(struct ffmpeg *ffmpeg){
+    /* Hand what the muxer wrote for the frame over to the live stream */
+
+    if (ffmpeg->live_write == NULL) return;
+
+    avio_flush(ffmpeg->oc->pb);
+    if (ffmpeg->live_frame != NULL) {
+        ffmpeg->live_frame(ffmpeg->live_frame_opaque, ffmpeg->live_key);
+    }
+
+}
+
+static int ffmpeg_put_picture(struct ffmpeg *ffmpeg, unsigned char *image
+            , struct image_buffer *buffer, const struct timeval *tv1){
+    /* Encode the image, kept in buffer when not NULL, and write it to the movie */
+    int retcd = 0;
+    int cnt = 0;
+
+    ffmpeg->live_key = FALSE;
+
+    if (ffmpeg->picture) {
+
+        if (ffmpeg->preferred_codec == USER_CODEC_V4L2M2M) {
+            ffmpeg_put_pix_nv21(ffmpeg, image);
+        } else {
+            ffmpeg_put_pix_yuv420(ffmpeg, image, buffer);
+        }
+
+        /* A continuous recording due for its next file starts it with a key frame */
+        if (ffmpeg->segment_next != NULL) ffmpeg->gop_cnt = ffmpeg->ctx_codec->gop_size - 1;
+
+        ffmpeg->gop_cnt ++;
+        if (ffmpeg->gop_cnt == ffmpeg->ctx_codec->gop_size ){
+            ffmpeg->picture->pict_type = AV_PICTURE_TYPE_I;
+            ffmpeg->picture->key_frame = 1;
+            ffmpeg->gop_cnt = 0;
+        } else {
+            ffmpeg->picture->pict_type = AV_PICTURE_TYPE_P;
+            ffmpeg->picture->key_frame = 0;
+        }
+
+        /* A return code of -2 is thrown by the put_frame
+         * when a image is buffered.  For timelapse, we absolutely
+         * never want a frame buffered so we keep sending back the
+         * the same pic until it flushes or fails in a different way
+         */
+        retcd = ffmpeg_put_frame(ffmpeg, tv1);
+        while ((retcd == -2) && (ffmpeg->tlapse != TIMELAPSE_NONE)) {
+            retcd = ffmpeg_put_frame(ffmpeg, tv1);
+            cnt++;
+            if (cnt > 50){
+                MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO
+                    ,_("Excessive attempts to clear buffered packet"));
+                retcd = -1;
+            }
+        }
+        //non timelapse buffered is ok
+        if (retcd == -2){
+            retcd = 0;
+            MOTION_LOG(DBG, TYPE_ENCODER, NO_ERRNO, _("Buffered packet"));
+        }
+
+#if (LIBAVFORMAT_VERSION_MAJOR >= 55)
+        /* A codec holding on to the frame has taken its own reference */
+        if (ffmpeg->preferred_codec != USER_CODEC_V4L2M2M) {
+            av_buffer_unref(&ffmpeg->picture->buf[0]);
+        }
+#endif
+    }
+
+    ffmpeg_live_frame(ffmpeg);
+
+    return retcd;
+}
+
+/*
+ * Encoder thread of a movie.  The caller queues each frame in a bounded
+ * ring and goes on while the thread runs the codec.  Frames of the ring are
+ * queued with a reference to their storage and only other images are copied.
+ * When the ring is full a movie file waits for a free slot, which only holds
+ * up the output worker writing it, while a live stream drops the frame so
+ * the camera thread feeding it never waits on the codec.
+ */
+struct ffmpeg_frame {
+    struct image_buffer *buffer;        /* Referenced storage of the image or NULL */
+    unsigned char      *image;          /* Image to encode */
+    unsigned char      *copy;           /* Copy of an image without storage, allocated on first use */
+    struct timeval      tv;
+};
+
+struct ffmpeg_encoder {
+    pthread_t           thread;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;           /* Frame queued, frame encoded or finish */
+    struct ffmpeg_frame *frames;
+    int                 size;           /* Slots of frames */
+    int                 head;           /* Oldest queued frame */
+    int                 count;          /* Frames queued, including the one being encoded */
+    int                 image_size;
+    int                 threadnr;       /* Camera the thread logs for */
+    int                 finish;
+    int                 error;          /* A frame failed since the last put */
+    unsigned long       drops;
+};
+
+static void *ffmpeg_encoder_handler(void *arg){
+    struct ffmpeg *ffmpeg = arg;
+    struct ffmpeg_encoder *encoder = ffmpeg->encoder;
+    struct ffmpeg_frame *frame;
+    int retcd;
+
+    pthread_setspecific(tls_key_threadnr, (void *)((unsigned long)encoder->threadnr));
+    util_threadname_set("en", encoder->threadnr, NULL);
+
+    pthread_mutex_lock(&encoder->mutex);
+    while (TRUE) {
+        while ((encoder->count == 0) && (!encoder->finish)) {
+            pthread_cond_wait(&encoder->cond, &encoder->mutex);
+        }
+        if (encoder->count == 0) break;
+
+        frame = &encoder->frames[encoder->head];
+        pthread_mutex_unlock(&encoder->mutex);
+
+        retcd = ffmpeg_put_picture(ffmpeg, frame->image, frame->buffer, &frame->tv);
+        outpool_buffer_unref(frame->buffer);
+        frame->buffer = NULL;
+
+        pthread_mutex_lock(&encoder->mutex);
+        if (retcd == -1) encoder->error = TRUE;
+        encoder->head = (encoder->head + 1) % encoder->size;
+        encoder->count--;
+        pthread_cond_broadcast(&encoder->cond);
+    }
+    pthread_mutex_unlock(&encoder->mutex);
+
+    return NULL;
+}
+
+static void ffmpeg_encoder_free(struct ffmpeg_encoder *encoder){
+    int indx;
+
+    for (indx = 0; indx < encoder->size; indx++) {
+        free(encoder->frames[indx].copy);
+    }
+    free(encoder->frames);
+    pthread_mutex_destroy(&encoder->mutex);
+    pthread_cond_destroy(&encoder->cond);
+    free(encoder);
+
+}
+
+static void ffmpeg_encoder_start(struct ffmpeg *ffmpeg){
+    /* Start the thread encoding the frames of the movie */
+    struct ffmpeg_encoder *encoder;
+    pthread_attr_t attr;
+    int retcd;
+
+    encoder = mymalloc(sizeof(struct ffmpeg_encoder));
+    encoder->size = ffmpeg->encoder_queue;
+    encoder->frames = mymalloc(sizeof(struct ffmpeg_frame) * encoder->size);
+    encoder->image_size = (ffmpeg->width * ffmpeg->height * 3) / 2;
+    encoder->threadnr = (int)(unsigned long)pthread_getspecific(tls_key_threadnr);
+    pthread_mutex_init(&encoder->mutex, NULL);
+    pthread_cond_init(&encoder->cond, NULL);
+    ffmpeg->encoder = encoder;
+
+    pthread_attr_init(&attr);
+    retcd = pthread_create(&encoder->thread, &attr, &ffmpeg_encoder_handler, ffmpeg);
+    pthread_attr_destroy(&attr);
+    if (retcd != 0) {
+        MOTION_LOG(WRN, TYPE_ENCODER, SHOW_ERRNO
+            ,_("Unable to start the encoder thread, encoding in the caller"));
+        ffmpeg->encoder = NULL;
+        ffmpeg_encoder_free(encoder);
+    }
+
+}
+
+static void ffmpeg_encoder_stop(struct ffmpeg *ffmpeg){
+    /* Let the thread encode the queued frames and stop it */
+    struct ffmpeg_encoder *encoder = ffmpeg->encoder;
+
+    if (encoder == NULL) return;
+
+    pthread_mutex_lock(&encoder->mutex);
+        encoder->finish = TRUE;
+        pthread_cond_broadcast(&encoder->cond);
+    pthread_mutex_unlock(&encoder->mutex);
+
+    pthread_join(encoder->thread, NULL);
+
+    if (encoder->drops > 0) {
+        MOTION_LOG(NTC, TYPE_ENCODER, NO_ERRNO
+            ,_("Encoder queue dropped %lu frames of %s"), encoder->drops, ffmpeg->filename);
+    }
+
+    ffmpeg->encoder = NULL;
+    ffmpeg_encoder_free(encoder);
+
+}
+
+static void ffmpeg_encoder_wait(struct ffmpeg *ffmpeg){
+    /* Wait until the queued frames have been encoded */
+    struct ffmpeg_encoder *encoder = ffmpeg->encoder;
+
+    if (encoder == NULL) return;
+
+    pthread_mutex_lock(&encoder->mutex);
+        while (encoder->count > 0) {
+            pthread_cond_wait(&encoder->cond, &encoder->mutex);
+        }
+    pthread_mutex_unlock(&encoder->mutex);
+
+}
+
+static int ffmpeg_encoder_put(struct ffmpeg *ffmpeg, unsigned char *image
+            , struct image_buffer *buffer, const struct timeval *tv1){
+    /*
+     * Queue a copy of the image for the encoder thread.  Returns -1 when a
+     * frame queued earlier failed to encode so the caller reports it.
+     */
+    struct ffmpeg_encoder *encoder = ffmpeg->encoder;
+    struct ffmpeg_frame *frame;
+    int retcd;
+
+    pthread_mutex_lock(&encoder->mutex);
+        retcd = (encoder->error) ? -1 : 0;
+        encoder->error = FALSE;
+
+        if ((encoder->count == encoder->size) && (ffmpeg->live_write != NULL)) {
+            encoder->drops++;
+            if ((encoder->drops % 100) == 1) {
+                MOTION_LOG(WRN, TYPE_ENCODER, NO_ERRNO
+                    ,_("Encoder queue full, %lu frames dropped"), encoder->drops);
+            }
+            pthread_mutex_unlock(&encoder->mutex);
+            return retcd;
+        }
+        while (encoder->count == encoder->size) {
+            pthread_cond_wait(&encoder->cond, &encoder->mutex);
+        }
+        frame = &encoder->frames[(encoder->head + encoder->count) % encoder->size];
+    pthread_mutex_unlock(&encoder->mutex);
+
+    /* Only this caller uses the free slots so they are filled unlocked */
+    if (buffer != NULL) {
+        outpool_buffer_ref(buffer);
+        frame->buffer = buffer;
+        frame->image = image;
+    } else {
+        if (frame->copy == NULL) frame->copy = mymalloc(encoder->image_size);
+        memcpy(frame->copy, image, encoder->image_size);
+        frame->image = frame->copy;
+    }
+    frame->tv = *tv1;
+
+    pthread_mutex_lock(&encoder->mutex);
+        encoder->count++;
+        pthread_cond_broadcast(&encoder->cond);
+    pthread_mutex_unlock(&encoder->mutex);
+
+    return retcd;
 }
 
 
@@ -1523,7 +2044,10 @@ int ffmpeg_open(struct ffmpeg *ffmpeg){
             return -1;
         }
 
-        ffmpeg_passthru_reset(ffmpeg);
+        if (ffmpeg->live_write == NULL) {
+            ffmpeg_passthru_reset(ffmpeg);
+        }
+        ffmpeg->live_idnbr = 0;
 
     } else {
         retcd = ffmpeg_get_oformat(ffmpeg);
@@ -1560,6 +2084,10 @@ int ffmpeg_open(struct ffmpeg *ffmpeg){
         return -1;
     }
 
+    if ((!ffmpeg->passthrough) && (ffmpeg->encoder_queue > 0)) {
+        ffmpeg_encoder_start(ffmpeg);
+    }
+
     return 0;
 
 #else /* No FFMPEG */
@@ -1578,14 +2106,19 @@ void ffmpeg_close(struct ffmpeg *ffmpeg){
 
     if (ffmpeg != NULL) {
 
+        ffmpeg_encoder_stop(ffmpeg);
+
         if (ffmpeg_flush_codec(ffmpeg) < 0){
             MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO, _("Error flushing codec"));
         }
+        ffmpeg_timelapse_close(ffmpeg);
         if (ffmpeg->oc->pb != NULL){
             if (ffmpeg->tlapse != TIMELAPSE_APPEND) {
                 av_write_trailer(ffmpeg->oc);
             }
-            if (!(ffmpeg->oc->oformat->flags & AVFMT_NOFILE)) {
+            if (ffmpeg->live_write != NULL) {
+                ffmpeg_live_free(ffmpeg);
+            } else if (!(ffmpeg->oc->oformat->flags & AVFMT_NOFILE)) {
                 if (ffmpeg->tlapse != TIMELAPSE_APPEND) {
                     avio_close(ffmpeg->oc->pb);
                 }
@@ -1603,59 +2136,46 @@ void ffmpeg_close(struct ffmpeg *ffmpeg){
 
 int ffmpeg_put_image(struct ffmpeg *ffmpeg, struct image_data *img_data, const struct timeval *tv1){
 #ifdef HAVE_FFMPEG
-    int retcd = 0;
-    int cnt = 0;
-
+    int retcd;
+    unsigned char *image;
 
     if (ffmpeg->passthrough) {
+        ffmpeg->live_key = FALSE;
         retcd = ffmpeg_passthru_put(ffmpeg, img_data);
+        ffmpeg_live_frame(ffmpeg);
         return retcd;
     }
 
-    if (ffmpeg->picture) {
+    if (ffmpeg->high_resolution){
+        image = img_data->image_high;
+    } else {
+        image = img_data->image_norm;
+    }
 
-        if (ffmpeg->preferred_codec == USER_CODEC_V4L2M2M) {
-            ffmpeg_put_pix_nv21(ffmpeg, img_data);
-        } else {
-            ffmpeg_put_pix_yuv420(ffmpeg, img_data);
-        }
+    if (ffmpeg->encoder != NULL) {
+        return ffmpeg_encoder_put(ffmpeg, image, img_data->buffer, tv1);
+    }
 
-        ffmpeg->gop_cnt ++;
-        if (ffmpeg->gop_cnt == ffmpeg->ctx_codec->gop_size ){
-            ffmpeg->picture->pict_type = AV_PICTURE_TYPE_I;
-            ffmpeg->picture->key_frame = 1;
-            ffmpeg->gop_cnt = 0;
-        } else {
-            ffmpeg->picture->pict_type = AV_PICTURE_TYPE_P;
-            ffmpeg->picture->key_frame = 0;
-        }
+    return ffmpeg_put_picture(ffmpeg, image, img_data->buffer, tv1);
 
-        /* A return code of -2 is thrown by the put_frame
-         * when a image is buffered.  For timelapse, we absolutely
-         * never want a frame buffered so we keep sending back the
-         * the same pic until it flushes or fails in a different way
-         */
-        retcd = ffmpeg_put_frame(ffmpeg, tv1);
-        while ((retcd == -2) && (ffmpeg->tlapse != TIMELAPSE_NONE)) {
-            retcd = ffmpeg_put_frame(ffmpeg, tv1);
-            cnt++;
-            if (cnt > 50){
-                MOTION_LOG(ERR, TYPE_ENCODER, NO_ERRNO
-                    ,_("Excessive attempts to clear buffered packet"));
-                retcd = -1;
-            }
-        }
-        //non timelapse buffered is ok
-        if (retcd == -2){
-            retcd = 0;
-            MOTION_LOG(DBG, TYPE_ENCODER, NO_ERRNO, _("Buffered packet"));
-        }
+#else
+    if (ffmpeg && img_data && tv1) {
+        MOTION_LOG(DBG, TYPE_ENCODER, NO_ERRNO, _("No ffmpeg support"));
     }
+    return 0;
+#endif // HAVE_FFMPEG
+}
 
-    return retcd;
+int64_t ffmpeg_segment_offset(struct ffmpeg *ffmpeg){
+    /* Offset at which the next frame will be written to the file */
+#ifdef HAVE_FFMPEG
+
+    if (ffmpeg->oc->pb == NULL) return 0;
+
+    return avio_tell(ffmpeg->oc->pb);
 
 #else
-    if (ffmpeg && img_data && tv1) {
+    if (ffmpeg) {
         MOTION_LOG(DBG, TYPE_ENCODER, NO_ERRNO, _("No ffmpeg support"));
     }
     return 0;
@@ -1664,7 +2184,12 @@ int ffmpeg_put_image(struct ffmpeg *ffmpeg, struct image_data *img_data, const s
 
 void ffmpeg_reset_movie_start_time(struct ffmpeg *ffmpeg, const struct timeval *tv1){
 #ifdef HAVE_FFMPEG
-    int64_t one_frame_interval = av_rescale_q(1,(AVRational){1, ffmpeg->fps},ffmpeg->video_st->time_base);
+    int64_t one_frame_interval;
+
+    /* The queued frames keep the start time they were taken with */
+    ffmpeg_encoder_wait(ffmpeg);
+
+    one_frame_interval = av_rescale_q(1,(AVRational){1, ffmpeg->fps},ffmpeg->video_st->time_base);
     if (one_frame_interval <= 0)
         one_frame_interval = 1;
     ffmpeg->base_pts = ffmpeg->last_pts + one_frame_interval;
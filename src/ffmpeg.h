@@ -8,6 +8,7 @@
 #include "config.h"
 struct image_data; /* forward declare for functions */
 struct rtsp_context;
+struct ffmpeg_encoder;
 
 enum TIMELAPSE_TYPE {
     TIMELAPSE_NONE,         /* No timelapse, regular processing */
@@ -15,6 +16,9 @@ enum TIMELAPSE_TYPE {
     TIMELAPSE_NEW           /* Use create new file version of timelapse */
 };
 
+/* Buffer of the file the append version of timelapse writes to */
+#define TIMELAPSE_BUFFER_SIZE   (256 * 1024)
+
 /* Enumeration of the user requested codecs that need special handling */
 enum USER_CODEC {
     USER_CODEC_V4L2M2M,    /* Requested codec for movie is h264_v4l2m2m */
@@ -30,6 +34,7 @@ enum USER_CODEC {
 #include <libavutil/imgutils.h>
 #include <libavutil/mathematics.h>
 #include <libavdevice/avdevice.h>
+#include <libavutil/opt.h>
 
 #if (LIBAVFORMAT_VERSION_MAJOR >= 56)
 #define MY_PIX_FMT_YUV420P   AV_PIX_FMT_YUV420P
@@ -69,9 +74,32 @@ struct ffmpeg {
     int            high_resolution;
     int            motion_images;
     int            passthrough;
+    /* Output of the muxer for a live stream, used instead of the file when set */
+    int (*live_write)(void *opaque, const unsigned char *buf, int buf_size);
+    void          *live_opaque;     /* Passed to live_write */
+    int            live_key;        /* A key frame was written by the last put */
+    int64_t        live_idnbr;      /* Last pass-through packet written to the live stream */
+    /* Called once the muxer has written a frame to live_write */
+    void (*live_frame)(void *opaque, int iskey);
+    void          *live_frame_opaque;   /* Passed to live_frame */
+    int            encoder_queue;   /* Frames queued for the encoder thread, 0 to encode in the caller */
+    int            encoder_threads; /* Threads of the codec, 0 to let the codec decide */
+    const char    *encoder_params;  /* Comma separated key=value options for the codec */
+    int            tlapse_flush;    /* Seconds between flushes of the appended timelapse file */
+    /* Continuous recording: the packets of the camera are followed by number
+     * and the file is switched to segment_next at the next key frame */
+    int            segment;
+    const char    *segment_next;    /* Name of the file to continue in, NULL to stay in the file */
+    int            segment_split;   /* Set when a put switched the file to segment_next */
+    int64_t        key_offset;      /* Offset in the file of the last key frame written */
+    struct timeval key_tv;          /* Time of the last key frame written */
+    FILE          *tlapse_file;     /* Appended timelapse file, open until the movie is closed */
+    char          *tlapse_buf;      /* Buffer of tlapse_file */
+    time_t         tlapse_flushed;  /* Time of the last flush of tlapse_file */
     enum USER_CODEC     preferred_codec;
     char *nal_info;
     int  nal_info_len;
+    struct ffmpeg_encoder *encoder; /* Encoder thread, NULL when encoding in the caller */
 };
 #else
 struct ffmpeg {
@@ -92,6 +120,25 @@ struct ffmpeg {
     int            high_resolution;
     int            motion_images;
     int            passthrough;
+    /* Output of the muxer for a live stream, used instead of the file when set */
+    int (*live_write)(void *opaque, const unsigned char *buf, int buf_size);
+    void          *live_opaque;     /* Passed to live_write */
+    int            live_key;        /* A key frame was written by the last put */
+    int64_t        live_idnbr;      /* Last pass-through packet written to the live stream */
+    /* Called once the muxer has written a frame to live_write */
+    void (*live_frame)(void *opaque, int iskey);
+    void          *live_frame_opaque;   /* Passed to live_frame */
+    int            encoder_queue;   /* Frames queued for the encoder thread, 0 to encode in the caller */
+    int            encoder_threads; /* Threads of the codec, 0 to let the codec decide */
+    const char    *encoder_params;  /* Comma separated key=value options for the codec */
+    int            tlapse_flush;    /* Seconds between flushes of the appended timelapse file */
+    /* Continuous recording: the packets of the camera are followed by number
+     * and the file is switched to segment_next at the next key frame */
+    int            segment;
+    const char    *segment_next;    /* Name of the file to continue in, NULL to stay in the file */
+    int            segment_split;   /* Set when a put switched the file to segment_next */
+    int64_t        key_offset;      /* Offset in the file of the last key frame written */
+    struct timeval key_tv;          /* Time of the last key frame written */
 };
 #endif // HAVE_FFMPEG
 
@@ -118,5 +165,6 @@ int ffmpeg_open(struct ffmpeg *ffmpeg);
 int ffmpeg_put_image(struct ffmpeg *ffmpeg, struct image_data *img_data, const struct timeval *tv1);
 void ffmpeg_close(struct ffmpeg *ffmpeg);
 void ffmpeg_reset_movie_start_time(struct ffmpeg *ffmpeg, const struct timeval *tv1);
+int64_t ffmpeg_segment_offset(struct ffmpeg *ffmpeg);
 
 #endif /* _INCLUDE_FFMPEG_H_ */
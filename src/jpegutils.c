@@ -85,6 +85,10 @@
 
 static const uint8_t EOI_data[2] = { 0xFF, 0xD9 };
 
+#define JPGUTL_STRIP_PIXELS     (1920 * 1080)   /* Smallest image compressed in strips */
+#define JPGUTL_STRIP_MAX        8               /* Most strips and threads for an image */
+#define JPGUTL_STRIP_SLACK      (64 * 1024)     /* Room beyond the raw size for the headers of a strip */
+
 struct jpgutl_error_mgr {
     struct jpeg_error_mgr pub;   /* "public" fields */
     jmp_buf setjmp_buffer;       /* For return to caller */
@@ -122,69 +126,70 @@ static void add_huff_table(j_decompress_ptr dinfo, JHUFF_TBL **htblptr, const UI
     memcpy((*htblptr)->huffval, val, nsymbols * sizeof(UINT8));
 }
 
-static void std_huff_tables (j_decompress_ptr dinfo){
-/* Set up the standard Huffman tables (cf. JPEG standard section K.3) */
+/* The standard Huffman tables (cf. JPEG standard section K.3) */
 /* IMPORTANT: these are only valid for 8-bit data precision! */
+static const UINT8 bits_dc_luminance[17] =
+{ /* 0-base */ 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const UINT8 val_dc_luminance[] =
+{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const UINT8 bits_dc_chrominance[17] =
+{ /* 0-base */ 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const UINT8 val_dc_chrominance[] =
+{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const UINT8 bits_ac_luminance[17] =
+{ /* 0-base */ 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const UINT8 val_ac_luminance[] =
+{ 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+  0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+  0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+  0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+  0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+  0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+  0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+  0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+  0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+  0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+  0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa };
+
+static const UINT8 bits_ac_chrominance[17] =
+{ /* 0-base */ 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const UINT8 val_ac_chrominance[] =
+{ 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+  0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+  0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+  0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+  0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+  0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+  0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+  0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+  0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+  0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+  0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa };
 
-    static const UINT8 bits_dc_luminance[17] =
-    { /* 0-base */ 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
-    static const UINT8 val_dc_luminance[] =
-    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
-
-    static const UINT8 bits_dc_chrominance[17] =
-    { /* 0-base */ 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
-    static const UINT8 val_dc_chrominance[] =
-    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
-
-    static const UINT8 bits_ac_luminance[17] =
-    { /* 0-base */ 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
-    static const UINT8 val_ac_luminance[] =
-    { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
-      0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
-      0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
-      0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
-      0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
-      0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
-      0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
-      0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
-      0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
-      0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
-      0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
-      0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
-      0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
-      0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
-      0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
-      0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
-      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
-      0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
-      0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
-      0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
-      0xf9, 0xfa };
-
-    static const UINT8 bits_ac_chrominance[17] =
-    { /* 0-base */ 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
-    static const UINT8 val_ac_chrominance[] =
-    { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
-      0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
-      0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
-      0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
-      0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
-      0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
-      0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
-      0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
-      0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
-      0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
-      0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
-      0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
-      0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
-      0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
-      0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
-      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
-      0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
-      0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
-      0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
-      0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
-      0xf9, 0xfa };
+static void std_huff_tables (j_decompress_ptr dinfo){
+/* Set up the standard Huffman tables */
 
     add_huff_table(dinfo, &dinfo->dc_huff_tbl_ptrs[0],
                    bits_dc_luminance, val_dc_luminance);
@@ -206,6 +211,39 @@ static void guarantee_huff_tables(j_decompress_ptr dinfo)
     }
 }
 
+static int jpgutl_dht_table(unsigned char *dest, int class_id, const UINT8 *bits, const UINT8 *val)
+{
+    int indx, nsymbols;
+
+    dest[0] = class_id;
+    nsymbols = 0;
+    for (indx = 1; indx <= 16; indx++) {
+        dest[indx] = bits[indx];
+        nsymbols += bits[indx];
+    }
+    memcpy(dest + 17, val, nsymbols);
+
+    return 17 + nsymbols;
+}
+
+static int jpgutl_dht_segment(unsigned char *dest)
+{
+    /* Write a DHT marker segment holding the standard Huffman tables */
+    int len;
+
+    dest[0] = 0xFF;
+    dest[1] = 0xC4;
+    len = 4;
+    len += jpgutl_dht_table(dest + len, 0x00, bits_dc_luminance, val_dc_luminance);
+    len += jpgutl_dht_table(dest + len, 0x10, bits_ac_luminance, val_ac_luminance);
+    len += jpgutl_dht_table(dest + len, 0x01, bits_dc_chrominance, val_dc_chrominance);
+    len += jpgutl_dht_table(dest + len, 0x11, bits_ac_chrominance, val_ac_chrominance);
+    dest[2] = (len - 2) >> 8;
+    dest[3] = (len - 2) & 0xFF;
+
+    return len;
+}
+
 /*
  * Initialize source --- called by jpeg_read_header
  * before any data is actually read.
@@ -425,7 +463,12 @@ static void put_jpeg_exif(j_compress_ptr cinfo,
               const struct coord *box)
 {
     unsigned char *exif = NULL;
-    unsigned exif_len = prepare_exif(&exif, cnt, tv1, box);
+    unsigned exif_len;
+
+    /* Images kept only in memory are compressed without a context */
+    if (cnt == NULL) return;
+
+    exif_len = prepare_exif(&exif, cnt, tv1, box);
 
     if(exif_len > 0) {
         /* EXIF data lives in a JPEG APP1 marker */
@@ -435,6 +478,68 @@ static void put_jpeg_exif(j_compress_ptr cinfo,
 }
 
 
+/**
+ * jpgutl_copy_jpeg
+ *  Purpose:  Copy a JPEG received from a camera so it can be passed on as is.
+ *            Anything after the end of image marker is dropped and the
+ *            standard Huffman tables are added when the JPEG leaves them
+ *            out as the frames of many MJPEG cameras do.
+ *
+ *  Parameters:
+ *  dest             Buffer for the copy
+ *  dest_size        Size of dest, jpeg_len + JPGUTL_DHT_SIZE always fits
+ *  jpeg             The JPEG data starting with its start of image marker
+ *  jpeg_len         The length of the jpeg data
+ *
+ *  Return Values
+ *    Length of the copy, 0 when the data is not a complete JPEG image
+ */
+int jpgutl_copy_jpeg(unsigned char *dest, int dest_size, const unsigned char *jpeg, int jpeg_len)
+{
+    int pos, eoi, sos, dht, seglen;
+
+    if ((jpeg_len < 4) || (jpeg[0] != 0xFF) || (jpeg[1] != 0xD8)) return 0;
+
+    eoi = jpeg_len - 2;
+    while ((eoi > 2) && ((jpeg[eoi] != 0xFF) || (jpeg[eoi + 1] != 0xD9))) eoi--;
+    if (eoi <= 2) return 0;
+    eoi += 2;
+
+    /* Walk the marker segments up to the start of scan */
+    sos = 0;
+    dht = 0;
+    pos = 2;
+    while (pos + 4 <= eoi) {
+        if (jpeg[pos] != 0xFF) return 0;
+        if (jpeg[pos + 1] == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (jpeg[pos + 1] == 0xDA) {
+            sos = pos;
+            break;
+        }
+        if (jpeg[pos + 1] == 0xC4) dht = 1;
+        seglen = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (seglen < 2) return 0;
+        pos += 2 + seglen;
+    }
+    if (sos == 0) return 0;
+
+    if (dht) {
+        if (eoi > dest_size) return 0;
+        memcpy(dest, jpeg, eoi);
+        return eoi;
+    }
+
+    if (eoi + JPGUTL_DHT_SIZE > dest_size) return 0;
+    memcpy(dest, jpeg, sos);
+    pos = sos + jpgutl_dht_segment(dest + sos);
+    memcpy(dest + pos, jpeg + sos, eoi - sos);
+
+    return pos + eoi - sos;
+}
+
 /**
  * jpgutl_decode_jpeg
  *  Purpose:  Decompress the jpeg data_in into the img_out buffer.
@@ -546,8 +651,115 @@ int jpgutl_decode_jpeg (unsigned char *jpeg_data_in, int jpeg_data_len,
 
 }
 
-int jpgutl_put_yuv420p(unsigned char *dest_image, int image_size,
-                   unsigned char *input_image, int width, int height, int quality,
+/*
+ * Compressor kept by a thread from one image to the next.  The defaults,
+ * sampling factors and Huffman tables are set up once and the quantization
+ * tables only again when the quality changes, so an image only costs the
+ * compression itself.  Images are compressed by the motion, output and
+ * stream threads of every camera, so each thread keeps its own compressors
+ * rather than sharing one per camera behind a lock.
+ */
+struct jpgutl_encoder {
+    struct jpeg_compress_struct cinfo;
+    struct jpgutl_error_mgr     jerr;
+    int                         ready;      /* cinfo is created and set up */
+    int                         quality;    /* Quality of the quantization tables */
+};
+
+struct jpgutl_encoders {
+    struct jpgutl_encoder       yuv;
+    struct jpgutl_encoder       grey;
+};
+
+static pthread_once_t   jpgutl_once = PTHREAD_ONCE_INIT;
+static pthread_key_t    jpgutl_key;
+
+static void jpgutl_encoders_free(void *arg)
+{
+    struct jpgutl_encoders *encoders = arg;
+
+    if (encoders->yuv.ready) jpeg_destroy_compress(&encoders->yuv.cinfo);
+    if (encoders->grey.ready) jpeg_destroy_compress(&encoders->grey.cinfo);
+    free(encoders);
+}
+
+static void jpgutl_key_create(void)
+{
+    pthread_key_create(&jpgutl_key, jpgutl_encoders_free);
+}
+
+/**
+ * jpgutl_encoder_get
+ *  Purpose:
+ *    Return the compressor of the calling thread, creating it on first use
+ *  Parameters:
+ *    grey       Compressor for greyscale rather than YUV420P images
+ *    quality    JPEG quality the images are compressed with
+ *  Return values:
+ *    The compressor, ready for jpeg_start_compress
+ */
+static struct jpgutl_encoder *jpgutl_encoder_get(int grey, int quality)
+{
+    struct jpgutl_encoders *encoders;
+    struct jpgutl_encoder *enc;
+
+    pthread_once(&jpgutl_once, jpgutl_key_create);
+
+    encoders = pthread_getspecific(jpgutl_key);
+    if (encoders == NULL) {
+        encoders = mymalloc(sizeof(struct jpgutl_encoders));
+        memset(encoders, 0, sizeof(struct jpgutl_encoders));
+        pthread_setspecific(jpgutl_key, encoders);
+    }
+    enc = (grey ? &encoders->grey : &encoders->yuv);
+
+    if (!enc->ready) {
+        enc->cinfo.err = jpeg_std_error(&enc->jerr.pub);
+        enc->jerr.pub.error_exit = jpgutl_error_exit;
+        /* Also hook the emit_message routine to note corrupt-data warnings. */
+        enc->jerr.original_emit_message = enc->jerr.pub.emit_message;
+        enc->jerr.pub.emit_message = jpgutl_emit_message;
+
+        jpeg_create_compress(&enc->cinfo);
+
+        if (grey) {
+            enc->cinfo.input_components = 1; /* One colour component */
+            enc->cinfo.in_color_space = JCS_GRAYSCALE;
+            jpeg_set_defaults(&enc->cinfo);
+        } else {
+            enc->cinfo.input_components = 3;
+            jpeg_set_defaults(&enc->cinfo);
+
+            jpeg_set_colorspace(&enc->cinfo, JCS_YCbCr);
+
+            enc->cinfo.raw_data_in = TRUE; // Supply downsampled data
+#if JPEG_LIB_VERSION >= 70
+            enc->cinfo.do_fancy_downsampling = FALSE;  // Fix segfault with v7
+#endif
+            enc->cinfo.comp_info[0].h_samp_factor = 2;
+            enc->cinfo.comp_info[0].v_samp_factor = 2;
+            enc->cinfo.comp_info[1].h_samp_factor = 1;
+            enc->cinfo.comp_info[1].v_samp_factor = 1;
+            enc->cinfo.comp_info[2].h_samp_factor = 1;
+            enc->cinfo.comp_info[2].v_samp_factor = 1;
+        }
+        enc->cinfo.dct_method = JDCT_FASTEST;
+        enc->quality = -1;
+        enc->ready = TRUE;
+    }
+
+    if (enc->quality != quality) {
+        jpeg_set_quality(&enc->cinfo, quality, TRUE);
+        enc->quality = quality;
+    }
+    enc->jerr.warning_seen = 0;
+
+    return enc;
+}
+
+static int jpgutl_put_yuv420p_planes(unsigned char *dest_image, int image_size,
+                   unsigned char *plane_y, unsigned char *plane_u, unsigned char *plane_v,
+                   int width, int height, int quality,
                    struct context *cnt, struct timeval *tv1, struct coord *box)
 
 {
@@ -556,67 +768,40 @@ int jpgutl_put_yuv420p(unsigned char *dest_image, int image_size,
     JSAMPROW y[16],cb[16],cr[16]; // y[2][5] = color sample of row 2 and pixel column 5; (one plane)
     JSAMPARRAY data[3]; // t[0][2][5] = color sample 0 of row 2 and column 5
 
-    struct jpeg_compress_struct cinfo;
-    struct jpgutl_error_mgr jerr;
+    struct jpgutl_encoder *enc;
 
     data[0] = y;
     data[1] = cb;
     data[2] = cr;
 
-    cinfo.err = jpeg_std_error (&jerr.pub);
-    jerr.pub.error_exit = jpgutl_error_exit;
-    /* Also hook the emit_message routine to note corrupt-data warnings. */
-    jerr.original_emit_message = jerr.pub.emit_message;
-    jerr.pub.emit_message = jpgutl_emit_message;
-    jerr.warning_seen = 0;
-
-    jpeg_create_compress(&cinfo);
+    enc = jpgutl_encoder_get(FALSE, quality);
 
     /* Establish the setjmp return context for jpgutl_error_exit to use. */
-    if (setjmp (jerr.setjmp_buffer)) {
+    if (setjmp (enc->jerr.setjmp_buffer)) {
         /* If we get here, the JPEG code has signaled an error. */
-        jpeg_destroy_compress (&cinfo);
+        jpeg_abort_compress(&enc->cinfo);
         return -1;
     }
 
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    jpeg_set_defaults(&cinfo);
+    enc->cinfo.image_width = width;
+    enc->cinfo.image_height = height;
 
-    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+    _jpeg_mem_dest(&enc->cinfo, dest_image, image_size);  // Data written to mem
 
-    cinfo.raw_data_in = TRUE; // Supply downsampled data
-#if JPEG_LIB_VERSION >= 70
-    cinfo.do_fancy_downsampling = FALSE;  // Fix segfault with v7
-#endif
-    cinfo.comp_info[0].h_samp_factor = 2;
-    cinfo.comp_info[0].v_samp_factor = 2;
-    cinfo.comp_info[1].h_samp_factor = 1;
-    cinfo.comp_info[1].v_samp_factor = 1;
-    cinfo.comp_info[2].h_samp_factor = 1;
-    cinfo.comp_info[2].v_samp_factor = 1;
-
-    jpeg_set_quality(&cinfo, quality, TRUE);
-    cinfo.dct_method = JDCT_FASTEST;
-
-    _jpeg_mem_dest(&cinfo, dest_image, image_size);  // Data written to mem
-
-
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_start_compress(&enc->cinfo, TRUE);
 
-    put_jpeg_exif(&cinfo, cnt, tv1, box);
+    put_jpeg_exif(&enc->cinfo, cnt, tv1, box);
 
     /* If the image is not a multiple of 16, this overruns the buffers
      * we'll just pad those last bytes with zeros
      */
     for (j = 0; j < height; j += 16) {
         for (i = 0; i < 16; i++) {
-            if ((width * (i + j)) < (width * height)) {
-                y[i] = input_image + width * (i + j);
+            if ((i + j) < height) {
+                y[i] = plane_y + width * (i + j);
                 if (i % 2 == 0) {
-                    cb[i / 2] = input_image + width * height + width / 2 * ((i + j) /2);
-                    cr[i / 2] = input_image + width * height + width * height / 4 + width / 2 * ((i + j) / 2);
+                    cb[i / 2] = plane_u + width / 2 * ((i + j) /2);
+                    cr[i / 2] = plane_v + width / 2 * ((i + j) / 2);
                 }
             } else {
                 y[i] = 0x00;
@@ -624,16 +809,335 @@ int jpgutl_put_yuv420p(unsigned char *dest_image, int image_size,
                 cr[i] = 0x00;
             }
         }
-        jpeg_write_raw_data(&cinfo, data, 16);
+        jpeg_write_raw_data(&enc->cinfo, data, 16);
     }
 
-    jpeg_finish_compress(&cinfo);
-    jpeg_image_size = _jpeg_mem_size(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    jpeg_finish_compress(&enc->cinfo);
+    jpeg_image_size = _jpeg_mem_size(&enc->cinfo);
 
     return jpeg_image_size;
 }
 
+/*
+ * Large YUV420P images are cut in horizontal strips of whole MCU rows that
+ * are compressed at the same time by a small pool of threads and the
+ * thread asking for the image.  Each strip is a JPEG of its own made with
+ * the same tables, so the entropy coded data of the strips can be joined
+ * with restart markers in between into a single baseline JPEG, the restart
+ * interval being the number of MCUs of a strip.
+ */
+struct jpgutl_strip {
+    unsigned char      *plane_y;
+    unsigned char      *plane_u;
+    unsigned char      *plane_v;
+    int                 height;
+    unsigned char      *dest;
+    int                 dest_size;
+    int                 len;            /* Size of the JPEG of the strip, -1 on error */
+    struct context     *cnt;            /* Only set for the first strip, which holds the EXIF data */
+    struct timeval     *tv1;
+    struct coord       *box;
+};
+
+struct jpgutl_batch {
+    struct jpgutl_batch *next;
+    struct jpgutl_strip *strips;
+    int                  count;
+    int                  claimed;       /* Strips taken by a thread */
+    int                  done;          /* Strips compressed */
+    int                  width;
+    int                  quality;
+    pthread_cond_t       cond_done;
+};
+
+static pthread_once_t       jpgutl_pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t      jpgutl_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       jpgutl_pool_cond = PTHREAD_COND_INITIALIZER;
+static struct jpgutl_batch *jpgutl_pool_head = NULL;
+static int                  jpgutl_pool_threads = 0;
+
+static void jpgutl_strip_run(struct jpgutl_batch *batch, int indx)
+{
+    struct jpgutl_strip *strip = &batch->strips[indx];
+
+    strip->len = jpgutl_put_yuv420p_planes(strip->dest, strip->dest_size
+        , strip->plane_y, strip->plane_u, strip->plane_v
+        , batch->width, strip->height, batch->quality
+        , strip->cnt, strip->tv1, strip->box);
+}
+
+static int jpgutl_batch_claim(struct jpgutl_batch *batch)
+{
+    /* Take the next strip of the batch.  Caller holds the pool mutex */
+    struct jpgutl_batch **link;
+
+    if (batch->claimed == batch->count) return -1;
+
+    /* Nothing left for the pool once the last strip is taken */
+    if (batch->claimed == batch->count - 1) {
+        for (link = &jpgutl_pool_head; *link != NULL; link = &(*link)->next) {
+            if (*link == batch) {
+                *link = batch->next;
+                break;
+            }
+        }
+    }
+
+    return batch->claimed++;
+}
+
+static void jpgutl_batch_done(struct jpgutl_batch *batch)
+{
+    /* Caller holds the pool mutex.  The batch may be gone once it is unlocked */
+    batch->done++;
+    if (batch->done == batch->count) pthread_cond_broadcast(&batch->cond_done);
+}
+
+static void *jpgutl_pool_handler(void *arg)
+{
+    /* Pool thread: compress strips of the queued images */
+    struct jpgutl_batch *batch;
+    int indx;
+
+    util_threadname_set("jp", (int)(unsigned long)arg, NULL);
+
+    pthread_mutex_lock(&jpgutl_pool_mutex);
+    while (TRUE) {
+        while (jpgutl_pool_head == NULL) {
+            pthread_cond_wait(&jpgutl_pool_cond, &jpgutl_pool_mutex);
+        }
+        batch = jpgutl_pool_head;
+        indx = jpgutl_batch_claim(batch);
+        pthread_mutex_unlock(&jpgutl_pool_mutex);
+
+        jpgutl_strip_run(batch, indx);
+
+        pthread_mutex_lock(&jpgutl_pool_mutex);
+        jpgutl_batch_done(batch);
+    }
+    pthread_mutex_unlock(&jpgutl_pool_mutex);
+
+    return NULL;
+}
+
+static void jpgutl_pool_start(void)
+{
+    /* Start one thread less than there are processors, the caller being the last */
+    pthread_t thread_id;
+    pthread_attr_t attr;
+    long nprocs;
+    int indx;
+
+    nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nprocs > JPGUTL_STRIP_MAX) nprocs = JPGUTL_STRIP_MAX;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (indx = 1; indx < nprocs; indx++) {
+        if (pthread_create(&thread_id, &attr, &jpgutl_pool_handler
+            , (void *)((unsigned long)indx)) != 0) {
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                ,_("Unable to start JPEG strip thread %d"), indx);
+            break;
+        }
+        jpgutl_pool_threads++;
+    }
+    pthread_attr_destroy(&attr);
+
+    if (jpgutl_pool_threads > 0) {
+        MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO
+            ,_("Started %d JPEG strip threads"), jpgutl_pool_threads);
+    }
+}
+
+static int jpgutl_strip_sos(const unsigned char *jpeg, int len, int *sof, int *sos, int *data)
+{
+    /* Find the frame header, the scan header and the start of the entropy coded data */
+    int pos, seglen;
+
+    if ((len < 4) || (jpeg[0] != 0xFF) || (jpeg[1] != 0xD8) ||
+        (jpeg[len - 2] != 0xFF) || (jpeg[len - 1] != 0xD9)) return -1;
+
+    *sof = -1;
+    pos = 2;
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) return -1;
+        seglen = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (jpeg[pos + 1] == 0xC0) *sof = pos;
+        if (jpeg[pos + 1] == 0xDA) {
+            if ((*sof < 0) || (pos + 2 + seglen > len - 2)) return -1;
+            *sos = pos;
+            *data = pos + 2 + seglen;
+            return 0;
+        }
+        pos += 2 + seglen;
+    }
+
+    return -1;
+}
+
+static int jpgutl_strip_join(unsigned char *dest_image, int image_size
+            , struct jpgutl_batch *batch, int height, int restart_interval)
+{
+    /*
+     * Put the headers of the first strip with the height of the whole image
+     * and a restart interval, followed by the data of every strip.  A strip
+     * ends on a byte boundary, as a restart interval does.
+     */
+    struct jpgutl_strip *strip;
+    int indx, sof, sos, data, len, pos;
+
+    strip = &batch->strips[0];
+    if (jpgutl_strip_sos(strip->dest, strip->len, &sof, &sos, &data) != 0) return -1;
+    if (sos + 6 + (data - sos) > image_size) return -1;
+
+    memcpy(dest_image, strip->dest, sos);
+    dest_image[sof + 5] = (height >> 8) & 0xFF;
+    dest_image[sof + 6] = height & 0xFF;
+    pos = sos;
+
+    dest_image[pos++] = 0xFF;
+    dest_image[pos++] = 0xDD;
+    dest_image[pos++] = 0x00;
+    dest_image[pos++] = 0x04;
+    dest_image[pos++] = (restart_interval >> 8) & 0xFF;
+    dest_image[pos++] = restart_interval & 0xFF;
+
+    memcpy(dest_image + pos, strip->dest + sos, data - sos);
+    pos += data - sos;
+
+    for (indx = 0; indx < batch->count; indx++) {
+        strip = &batch->strips[indx];
+        if (indx > 0) {
+            if (jpgutl_strip_sos(strip->dest, strip->len, &sof, &sos, &data) != 0) return -1;
+        }
+        len = strip->len - 2 - data;
+        if (pos + len + 2 > image_size) return -1;
+        memcpy(dest_image + pos, strip->dest + data, len);
+        pos += len;
+
+        dest_image[pos++] = 0xFF;
+        if (indx < batch->count - 1) {
+            dest_image[pos++] = 0xD0 + (indx % 8);
+        } else {
+            dest_image[pos++] = 0xD9;
+        }
+    }
+
+    return pos;
+}
+
+static int jpgutl_put_yuv420p_strips(unsigned char *dest_image, int image_size,
+                   unsigned char *input_image, int width, int height, int quality,
+                   struct context *cnt, struct timeval *tv1, struct coord *box, int strip_count)
+{
+    /* Strips the pool threads do not take are compressed by the caller */
+    struct jpgutl_batch batch, **link;
+    struct jpgutl_strip strips[JPGUTL_STRIP_MAX];
+    int indx, mcu_width, mcu_rows, strip_rows, row, retcd;
+
+    mcu_width = (width + 15) / 16;
+    mcu_rows = (height + 15) / 16;
+
+    /* Strips of whole MCU rows, each no more MCUs than a restart interval can hold */
+    strip_rows = (mcu_rows + strip_count - 1) / strip_count;
+    if (strip_rows * mcu_width > 65535) strip_rows = 65535 / mcu_width;
+    if ((strip_rows < 1) || (((mcu_rows + strip_rows - 1) / strip_rows) > JPGUTL_STRIP_MAX) ||
+        (strip_rows >= mcu_rows)) {
+        return -1;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    memset(strips, 0, sizeof(strips));
+    batch.strips = strips;
+    batch.width = width;
+    batch.quality = quality;
+
+    for (row = 0; row < height; row += strip_rows * 16) {
+        indx = batch.count++;
+        strips[indx].plane_y = input_image + width * row;
+        strips[indx].plane_u = input_image + width * height + (width / 2) * (row / 2);
+        strips[indx].plane_v = input_image + width * height + (width * height) / 4 + (width / 2) * (row / 2);
+        strips[indx].height = MIN(strip_rows * 16, height - row);
+        strips[indx].dest_size = (width * strips[indx].height * 3) / 2 + JPGUTL_STRIP_SLACK;
+        strips[indx].dest = mymalloc(strips[indx].dest_size);
+    }
+    strips[0].cnt = cnt;
+    strips[0].tv1 = tv1;
+    strips[0].box = box;
+
+    pthread_cond_init(&batch.cond_done, NULL);
+
+    pthread_mutex_lock(&jpgutl_pool_mutex);
+        for (link = &jpgutl_pool_head; *link != NULL; link = &(*link)->next);
+        *link = &batch;
+        pthread_cond_broadcast(&jpgutl_pool_cond);
+
+        while ((indx = jpgutl_batch_claim(&batch)) >= 0) {
+            pthread_mutex_unlock(&jpgutl_pool_mutex);
+            jpgutl_strip_run(&batch, indx);
+            pthread_mutex_lock(&jpgutl_pool_mutex);
+            jpgutl_batch_done(&batch);
+        }
+
+        while (batch.done < batch.count) {
+            pthread_cond_wait(&batch.cond_done, &jpgutl_pool_mutex);
+        }
+    pthread_mutex_unlock(&jpgutl_pool_mutex);
+
+    pthread_cond_destroy(&batch.cond_done);
+
+    retcd = 0;
+    for (indx = 0; indx < batch.count; indx++) {
+        if (strips[indx].len <= 0) retcd = -1;
+    }
+    if (retcd == 0) {
+        retcd = jpgutl_strip_join(dest_image, image_size, &batch, height, strip_rows * mcu_width);
+    }
+
+    for (indx = 0; indx < batch.count; indx++) free(strips[indx].dest);
+
+    return retcd;
+}
+
+/**
+ * jpgutl_put_yuv420p
+ *  Purpose:
+ *    Compress a YUV420P image into a JPEG image.  Images of at least
+ *    JPGUTL_STRIP_PIXELS are compressed in strips on several threads.
+ *  Parameters:
+ *    dest_image   Memory receiving the JPEG
+ *    image_size   Size of dest_image
+ *    input_image  The image
+ *    width        Width of the image
+ *    height       Height of the image
+ *    quality      JPEG quality
+ *    cnt, tv1, box  Context, time and motion location for the EXIF data.
+ *                 No EXIF data is written when cnt is NULL.
+ *  Return values:
+ *    Size of the JPEG, -1 on error
+ */
+int jpgutl_put_yuv420p(unsigned char *dest_image, int image_size,
+                   unsigned char *input_image, int width, int height, int quality,
+                   struct context *cnt, struct timeval *tv1, struct coord *box)
+{
+    int retcd;
+
+    if (width * height >= JPGUTL_STRIP_PIXELS) {
+        pthread_once(&jpgutl_pool_once, jpgutl_pool_start);
+        if (jpgutl_pool_threads > 0) {
+            retcd = jpgutl_put_yuv420p_strips(dest_image, image_size, input_image
+                , width, height, quality, cnt, tv1, box, jpgutl_pool_threads + 1);
+            if (retcd > 0) return retcd;
+        }
+    }
+
+    return jpgutl_put_yuv420p_planes(dest_image, image_size
+        , input_image, input_image + width * height
+        , input_image + width * height + (width * height) / 4
+        , width, height, quality, cnt, tv1, box);
+}
+
 
 int jpgutl_put_grey(unsigned char *dest_image, int image_size,
                    unsigned char *input_image, int width, int height, int quality,
@@ -641,51 +1145,35 @@ int jpgutl_put_grey(unsigned char *dest_image, int image_size,
 {
     int y, dest_image_size;
     JSAMPROW row_ptr[1];
-    struct jpeg_compress_struct cjpeg;
-    struct jpgutl_error_mgr jerr;
+    struct jpgutl_encoder *enc;
 
-    cjpeg.err = jpeg_std_error (&jerr.pub);
-    jerr.pub.error_exit = jpgutl_error_exit;
-    /* Also hook the emit_message routine to note corrupt-data warnings. */
-    jerr.original_emit_message = jerr.pub.emit_message;
-    jerr.pub.emit_message = jpgutl_emit_message;
-    jerr.warning_seen = 0;
-
-    jpeg_create_compress(&cjpeg);
+    enc = jpgutl_encoder_get(TRUE, quality);
 
     /* Establish the setjmp return context for jpgutl_error_exit to use. */
-    if (setjmp (jerr.setjmp_buffer)) {
+    if (setjmp (enc->jerr.setjmp_buffer)) {
         /* If we get here, the JPEG code has signaled an error. */
-        jpeg_destroy_compress (&cjpeg);
+        jpeg_abort_compress(&enc->cinfo);
         return -1;
     }
 
-    cjpeg.image_width = width;
-    cjpeg.image_height = height;
-    cjpeg.input_components = 1; /* One colour component */
-    cjpeg.in_color_space = JCS_GRAYSCALE;
+    enc->cinfo.image_width = width;
+    enc->cinfo.image_height = height;
 
-    jpeg_set_defaults(&cjpeg);
+    _jpeg_mem_dest(&enc->cinfo, dest_image, image_size);  // Data written to mem
 
-    jpeg_set_quality(&cjpeg, quality, TRUE);
-    cjpeg.dct_method = JDCT_FASTEST;
-    _jpeg_mem_dest(&cjpeg, dest_image, image_size);  // Data written to mem
+    jpeg_start_compress (&enc->cinfo, TRUE);
 
-    jpeg_start_compress (&cjpeg, TRUE);
-
-    put_jpeg_exif(&cjpeg, cnt, tv1, box);
+    put_jpeg_exif(&enc->cinfo, cnt, tv1, box);
 
     row_ptr[0] = input_image;
 
     for (y = 0; y < height; y++) {
-        jpeg_write_scanlines(&cjpeg, row_ptr, 1);
+        jpeg_write_scanlines(&enc->cinfo, row_ptr, 1);
         row_ptr[0] += width;
     }
 
-    jpeg_finish_compress(&cjpeg);
-    dest_image_size = _jpeg_mem_size(&cjpeg);
-    jpeg_destroy_compress(&cjpeg);
+    jpeg_finish_compress(&enc->cinfo);
+    dest_image_size = _jpeg_mem_size(&enc->cinfo);
 
     return dest_image_size;
 }
-
@@ -11,9 +11,14 @@
 #ifndef __JPEGUTILS_H__
 #define __JPEGUTILS_H__
 
+/* Size of the segment with the standard Huffman tables jpgutl_copy_jpeg may add */
+#define JPGUTL_DHT_SIZE 420
+
 int jpgutl_decode_jpeg (unsigned char *jpeg_data_in, int jpeg_data_len,
                      unsigned int width, unsigned int height, unsigned char *volatile img_out);
 
+int jpgutl_copy_jpeg(unsigned char *dest, int dest_size, const unsigned char *jpeg, int jpeg_len);
+
 int jpgutl_put_yuv420p(unsigned char *, int image, unsigned char *, int, int, int, struct context *, struct timeval *, struct coord *);
 int jpgutl_put_grey(unsigned char *, int image, unsigned char *, int, int, int, struct context *, struct timeval *, struct coord *);
 
@@ -0,0 +1,216 @@
+/*
+ *    jpegutils_test.c
+ *
+ *    Check of the JPEG images compressed in strips, run by make check
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    Large images are compressed in strips that are joined with restart
+ *    markers into a single JPEG.  Each image is compressed in strips and in
+ *    a single pass, both are decoded and the pixels must be the same.  The
+ *    joined JPEG must have the height of the whole image in its frame header,
+ *    a restart interval and restart markers numbered in sequence.
+ *
+ *    jpegutils.c is included so the strips can be asked for whatever the
+ *    number of processors of the machine running the check.
+ */
+
+#include "jpegutils.c"
+
+struct jpgtest_size {
+    int width;
+    int height;
+    int strips;
+};
+
+/* At least 2 MP, with heights that are and are not a multiple of the MCU */
+static const struct jpgtest_size jpgtest_sizes[] = {
+    {1920, 1080, 2},
+    {1920, 1088, 3},
+    {2592, 1944, 4},
+    {3264, 2448, 8},
+};
+
+/* The check runs without the rest of Motion */
+void motion_log(int level, unsigned int type, int errno_flag, int fncname, const char *fmt, ...){
+    va_list ap;
+
+    (void)level;
+    (void)type;
+    (void)errno_flag;
+    (void)fncname;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void *mymalloc(size_t nbytes){
+    void *dummy = calloc(nbytes, 1);
+
+    if (dummy == NULL) {
+        fprintf(stderr, "Could not allocate %llu bytes of memory!\n", (unsigned long long)nbytes);
+        exit(1);
+    }
+
+    return dummy;
+}
+
+char *translate_text(const char *msgid){
+    return (char *)msgid;
+}
+
+void util_threadname_set(const char *abbr, int threadnbr, const char *threadname){
+    (void)abbr;
+    (void)threadnbr;
+    (void)threadname;
+}
+
+unsigned prepare_exif(unsigned char **exif, const struct context *cnt
+            , const struct timeval *tv_in1, const struct coord *box){
+    (void)exif;
+    (void)cnt;
+    (void)tv_in1;
+    (void)box;
+    return 0;
+}
+
+static void jpgtest_image(unsigned char *image, int width, int height){
+    /* Gradients with some noise so the strips hold real data */
+    int indx, size;
+    unsigned int seed;
+
+    size = width * height;
+    seed = 12345;
+    for (indx = 0; indx < size; indx++) {
+        seed = seed * 1103515245 + 12345;
+        image[indx] = (unsigned char)(((indx % width) / 8) + ((indx / width) / 4) + ((seed >> 16) & 0x1F));
+    }
+    for (indx = size; indx < (size * 3) / 2; indx++) {
+        image[indx] = (unsigned char)(64 + ((indx - size) % (width / 2)) / 16);
+    }
+}
+
+static int jpgtest_markers(const unsigned char *jpeg, int len, const struct jpgtest_size *size){
+    /* Check the frame header, restart interval and restart markers of the joined JPEG */
+    int pos, seglen, marker, sof_width, sof_height, interval, mcus, expected, restarts;
+
+    sof_width = sof_height = -1;
+    interval = 0;
+    pos = 2;
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) {
+            printf("  bad segment at %d\n", pos);
+            return -1;
+        }
+        marker = jpeg[pos + 1];
+        seglen = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (marker == 0xC0) {
+            sof_height = (jpeg[pos + 5] << 8) | jpeg[pos + 6];
+            sof_width = (jpeg[pos + 7] << 8) | jpeg[pos + 8];
+        }
+        if (marker == 0xDD) {
+            if (seglen != 4) {
+                printf("  DRI of length %d\n", seglen);
+                return -1;
+            }
+            interval = (jpeg[pos + 4] << 8) | jpeg[pos + 5];
+        }
+        pos += 2 + seglen;
+        if (marker == 0xDA) break;
+    }
+
+    if ((sof_width != size->width) || (sof_height != size->height)) {
+        printf("  frame header is %dx%d\n", sof_width, sof_height);
+        return -1;
+    }
+
+    mcus = ((size->width + 15) / 16) * ((size->height + 15) / 16);
+    if ((interval <= 0) || (interval >= mcus)) {
+        printf("  restart interval %d for %d MCUs\n", interval, mcus);
+        return -1;
+    }
+    expected = (mcus + interval - 1) / interval - 1;
+
+    /* In the entropy coded data a 0xFF is followed by a stuffed zero or a marker */
+    restarts = 0;
+    for (; pos < len - 2; pos++) {
+        if ((jpeg[pos] != 0xFF) || (jpeg[pos + 1] == 0x00)) continue;
+        if (jpeg[pos + 1] != 0xD0 + (restarts % 8)) {
+            printf("  marker %02X at %d, expected %02X\n"
+                , jpeg[pos + 1], pos, 0xD0 + (restarts % 8));
+            return -1;
+        }
+        restarts++;
+        pos++;
+    }
+
+    if ((restarts != expected) || (jpeg[len - 2] != 0xFF) || (jpeg[len - 1] != 0xD9)) {
+        printf("  %d restart markers, expected %d\n", restarts, expected);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int jpgtest_size(const struct jpgtest_size *size){
+    unsigned char *image, *jpeg_strips, *jpeg_single, *out_strips, *out_single;
+    int image_size, len_strips, len_single, retcd;
+
+    image_size = (size->width * size->height * 3) / 2;
+    image = mymalloc(image_size);
+    jpeg_strips = mymalloc(image_size);
+    jpeg_single = mymalloc(image_size);
+    out_strips = mymalloc(image_size);
+    out_single = mymalloc(image_size);
+
+    jpgtest_image(image, size->width, size->height);
+
+    len_strips = jpgutl_put_yuv420p_strips(jpeg_strips, image_size, image
+        , size->width, size->height, 80, NULL, NULL, NULL, size->strips);
+    len_single = jpgutl_put_yuv420p_planes(jpeg_single, image_size
+        , image, image + size->width * size->height
+        , image + (size->width * size->height * 5) / 4
+        , size->width, size->height, 80, NULL, NULL, NULL);
+
+    retcd = -1;
+    if ((len_strips <= 0) || (len_single <= 0)) {
+        printf("  compression failed, strips %d single %d\n", len_strips, len_single);
+    } else if (jpgtest_markers(jpeg_strips, len_strips, size) != 0) {
+        /* Reported by jpgtest_markers */
+    } else if (jpgutl_decode_jpeg(jpeg_strips, len_strips, size->width, size->height, out_strips) != 0) {
+        printf("  strips do not decode\n");
+    } else if (jpgutl_decode_jpeg(jpeg_single, len_single, size->width, size->height, out_single) != 0) {
+        printf("  single pass does not decode\n");
+    } else if (memcmp(out_strips, out_single, image_size) != 0) {
+        printf("  decoded pixels differ\n");
+    } else {
+        retcd = 0;
+    }
+
+    printf("%s %dx%d in %d strips: %d bytes, single pass %d bytes\n"
+        , (retcd == 0) ? "ok  " : "FAIL", size->width, size->height
+        , size->strips, len_strips, len_single);
+
+    free(image);
+    free(jpeg_strips);
+    free(jpeg_single);
+    free(out_strips);
+    free(out_single);
+
+    return retcd;
+}
+
+int main(void){
+    unsigned int indx;
+    int fails;
+
+    fails = 0;
+    for (indx = 0; indx < sizeof(jpgtest_sizes) / sizeof(jpgtest_sizes[0]); indx++) {
+        if (jpgtest_size(&jpgtest_sizes[indx]) != 0) fails++;
+    }
+
+    return (fails == 0) ? 0 : 1;
+}
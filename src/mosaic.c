@@ -0,0 +1,341 @@
+/*
+ *    mosaic.c
+ *
+ *    Mosaic stream of all the cameras for Motion
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    The stream port of motion.conf provides a single stream showing all
+ *    the cameras in a grid.  While the mosaic has clients each camera thread
+ *    scales its latest frame into its cell of the grid at the rate of the
+ *    mosaic.  A thread of its own compresses the grid once per interval and
+ *    the image is shared by all the clients, so a display showing every
+ *    camera costs one compression rather than one per camera and client.
+ */
+
+#include "motion.h"
+#include "translate.h"
+#include "picture.h"
+#include "jpegutils.h"
+#include "webu.h"
+#include "webu_stream.h"
+
+struct mosaic_tile {
+    int             x;              /* Top left corner of the cell in the mosaic */
+    int             y;
+    unsigned char  *image;          /* Frame of the camera scaled to fit the cell */
+    struct timeval  time;           /* When the camera last drew its cell */
+};
+
+static pthread_mutex_t  mosaic_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   mosaic_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t        mosaic_thread;
+static int              mosaic_finish = FALSE;
+
+/* Main context serving the mosaic, NULL when stopped.  Set before the camera
+ * threads start and cleared once they stopped, so they read it unlocked */
+static struct context  *mosaic_cnt = NULL;
+static struct mosaic_tile *mosaic_tiles = NULL; /* Cell of each camera, by thread number */
+static int              mosaic_count = 0;
+static unsigned char   *mosaic_image = NULL;    /* Grid the cameras draw into */
+static int              mosaic_width;
+static int              mosaic_height;
+static int              mosaic_cell_width;
+static int              mosaic_cell_height;
+static long             mosaic_interval;        /* usec between two images of the mosaic */
+
+int mosaic_watched(void){
+    /* Whether a client is connected to the mosaic */
+    int cnct_count;
+
+    if (mosaic_cnt == NULL) return FALSE;
+
+    pthread_mutex_lock(&mosaic_cnt->mutex_stream);
+        cnct_count = mosaic_cnt->stream_mosaic.cnct_count;
+    pthread_mutex_unlock(&mosaic_cnt->mutex_stream);
+
+    return (cnct_count > 0);
+}
+
+static void mosaic_plane(unsigned char *dst, int dst_width, const unsigned char *src
+            , int width, int height, int cell_x, int cell_y, int cell_width, int cell_height
+            , int x, int y, unsigned char blank){
+    /* Blank a cell of a plane of the mosaic and copy the plane of a frame to x,y in it */
+    int row;
+
+    for (row = 0; row < cell_height; row++) {
+        memset(dst + (cell_y + row) * dst_width + cell_x, blank, cell_width);
+    }
+
+    for (row = 0; row < height; row++) {
+        memcpy(dst + (cell_y + y + row) * dst_width + cell_x + x, src + row * width, width);
+    }
+
+}
+
+static void mosaic_draw(struct mosaic_tile *tile, int width, int height){
+    /* Put the scaled frame of a camera centered in its cell.  The offsets are
+     * kept even so the chroma planes line up.  Called with mosaic_mutex held
+     */
+    unsigned char *dst;
+    const unsigned char *src;
+    int size_dst, size_src, x, y;
+
+    size_dst = mosaic_width * mosaic_height;
+    size_src = width * height;
+    x = ((mosaic_cell_width - width) / 2) & ~1;
+    y = ((mosaic_cell_height - height) / 2) & ~1;
+
+    dst = mosaic_image;
+    src = tile->image;
+    mosaic_plane(dst, mosaic_width, src, width, height
+        , tile->x, tile->y, mosaic_cell_width, mosaic_cell_height, x, y, 0);
+
+    dst += size_dst;
+    src += size_src;
+    mosaic_plane(dst, mosaic_width / 2, src, width / 2, height / 2
+        , tile->x / 2, tile->y / 2, mosaic_cell_width / 2, mosaic_cell_height / 2
+        , x / 2, y / 2, 128);
+
+    dst += size_dst / 4;
+    src += size_src / 4;
+    mosaic_plane(dst, mosaic_width / 2, src, width / 2, height / 2
+        , tile->x / 2, tile->y / 2, mosaic_cell_width / 2, mosaic_cell_height / 2
+        , x / 2, y / 2, 128);
+
+}
+
+static void *mosaic_handler(void *arg){
+    /* Compress the grid for the clients once per interval of the mosaic */
+    struct stream_jpeg *jpeg;
+    unsigned char *image;
+    struct timeval curtime;
+    struct timespec waittime;
+    long usec;
+    int size;
+
+    (void)arg;
+
+    util_threadname_set("mo", 0, NULL);
+
+    size = (mosaic_width * mosaic_height * 3) / 2;
+    image = mymalloc(size);
+
+    pthread_mutex_lock(&mosaic_mutex);
+    while (!mosaic_finish) {
+        gettimeofday(&curtime, NULL);
+        usec = curtime.tv_usec + mosaic_interval;
+        waittime.tv_sec = curtime.tv_sec + (usec / 1000000L);
+        waittime.tv_nsec = 1000L * (usec % 1000000L);
+        pthread_cond_timedwait(&mosaic_cond, &mosaic_mutex, &waittime);
+
+        if (mosaic_finish) break;
+        if (!mosaic_watched()) continue;
+
+        /* Take a copy so the cameras can draw while it is compressed */
+        memcpy(image, mosaic_image, size);
+        pthread_mutex_unlock(&mosaic_mutex);
+
+        /* The grid is no image of a single camera so it gets no EXIF data */
+        jpeg = webu_stream_jpeg_claim(mosaic_cnt, &mosaic_cnt->stream_mosaic, size);
+        if (mosaic_cnt->conf.stream_grey) {
+            jpeg->size = jpgutl_put_grey(jpeg->data, jpeg->alloc, image
+                , mosaic_width, mosaic_height, mosaic_cnt->conf.stream_quality
+                , NULL, NULL, NULL);
+        } else {
+            jpeg->size = jpgutl_put_yuv420p(jpeg->data, jpeg->alloc, image
+                , mosaic_width, mosaic_height, mosaic_cnt->conf.stream_quality
+                , NULL, NULL, NULL);
+        }
+        webu_stream_jpeg_publish(mosaic_cnt, &mosaic_cnt->stream_mosaic, jpeg);
+
+        pthread_mutex_lock(&mosaic_mutex);
+    }
+    pthread_mutex_unlock(&mosaic_mutex);
+
+    free(image);
+
+    return NULL;
+}
+
+static void mosaic_free(void){
+
+    int indx;
+
+    if (mosaic_tiles != NULL) {
+        for (indx = 0; indx < mosaic_count; indx++) free(mosaic_tiles[indx].image);
+        free(mosaic_tiles);
+        mosaic_tiles = NULL;
+    }
+    free(mosaic_image);
+    mosaic_image = NULL;
+    mosaic_count = 0;
+
+}
+
+/**
+ * mosaic_start
+ *
+ *   Sets up the grid of the cameras and starts the thread compressing it
+ *   when the stream port of motion.conf serves camera config files.  Called
+ *   before the camera threads and the web server are started.
+ *
+ * Parameters:
+ *
+ *      cntlist  The list of contexts, the first one being motion.conf
+ *
+ * Returns:     nothing
+ */
+void mosaic_start(struct context **cntlist){
+
+    struct context *cnt = cntlist[0];
+    pthread_attr_t attr;
+    int indx, cols, rows, size_cell, size, retcd;
+
+    mosaic_cnt = NULL;
+    if ((cntlist[1] == NULL) || (cnt->conf.stream_port == 0)) return;
+
+    mosaic_count = 0;
+    while (cntlist[mosaic_count + 1] != NULL) mosaic_count++;
+
+    /* Square grid, dropping the last row when it would stay empty */
+    cols = 1;
+    while (cols * cols < mosaic_count) cols++;
+    rows = (mosaic_count + cols - 1) / cols;
+
+    mosaic_width = cnt->conf.stream_mosaic_width - (cnt->conf.stream_mosaic_width % 8);
+    mosaic_height = cnt->conf.stream_mosaic_height - (cnt->conf.stream_mosaic_height % 8);
+    mosaic_cell_width = (mosaic_width / cols) & ~1;
+    mosaic_cell_height = (mosaic_height / rows) & ~1;
+    if ((mosaic_cell_width < 16) || (mosaic_cell_height < 16)) {
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Mosaic of %dx%d is too small for %d cameras")
+            ,cnt->conf.stream_mosaic_width, cnt->conf.stream_mosaic_height, mosaic_count);
+        mosaic_count = 0;
+        return;
+    }
+    if (cnt->conf.stream_mosaic_rate < 1) cnt->conf.stream_mosaic_rate = 1;
+    mosaic_interval = 1000000L / cnt->conf.stream_mosaic_rate;
+
+    size = mosaic_width * mosaic_height;
+    mosaic_image = mymalloc((size * 3) / 2);
+    memset(mosaic_image, 0, size);
+    memset(mosaic_image + size, 128, size / 2);
+
+    size_cell = (mosaic_cell_width * mosaic_cell_height * 3) / 2;
+    mosaic_tiles = mymalloc(sizeof(struct mosaic_tile) * mosaic_count);
+    for (indx = 0; indx < mosaic_count; indx++) {
+        mosaic_tiles[indx].x = (indx % cols) * mosaic_cell_width;
+        mosaic_tiles[indx].y = (indx / cols) * mosaic_cell_height;
+        mosaic_tiles[indx].image = mymalloc(size_cell);
+        mosaic_tiles[indx].time.tv_sec = 0;
+        mosaic_tiles[indx].time.tv_usec = 0;
+    }
+
+    /* The main context runs no motion loop that would set these up */
+    cnt->stream_mosaic.jpeg = NULL;
+    cnt->stream_mosaic.seq = 0;
+    cnt->stream_mosaic.spare = NULL;
+    cnt->stream_mosaic.cnct_count = 0;
+    cnt->stream_mosaic.waiting = NULL;
+    mosaic_cnt = cnt;
+
+    mosaic_finish = FALSE;
+    pthread_attr_init(&attr);
+    retcd = pthread_create(&mosaic_thread, &attr, &mosaic_handler, NULL);
+    pthread_attr_destroy(&attr);
+    if (retcd != 0) {
+        MOTION_LOG(ERR, TYPE_STREAM, SHOW_ERRNO, _("Unable to start the mosaic thread"));
+        mosaic_cnt = NULL;
+        mosaic_free();
+        return;
+    }
+
+    MOTION_LOG(NTC, TYPE_STREAM, NO_ERRNO
+        ,_("Mosaic of %d cameras at %dx%d and %d fps on port %d")
+        ,mosaic_count, mosaic_width, mosaic_height
+        ,cnt->conf.stream_mosaic_rate, cnt->conf.stream_port);
+
+}
+
+void mosaic_stop(struct context **cntlist){
+    /* Called once the camera threads and the web server have stopped */
+    struct context *cnt = cntlist[0];
+
+    if (mosaic_cnt == NULL) return;
+
+    pthread_mutex_lock(&mosaic_mutex);
+        mosaic_finish = TRUE;
+        pthread_cond_signal(&mosaic_cond);
+    pthread_mutex_unlock(&mosaic_mutex);
+    pthread_join(mosaic_thread, NULL);
+
+    webu_stream_jpeg_free(cnt, &cnt->stream_mosaic);
+
+    mosaic_cnt = NULL;
+    mosaic_free();
+
+}
+
+int mosaic_running(const struct context *cnt){
+    /* Whether the context serves the mosaic */
+    return ((mosaic_cnt != NULL) && (mosaic_cnt == cnt));
+}
+
+/**
+ * mosaic_put
+ *
+ *   Draws the frame of a camera in its cell of the mosaic when the mosaic
+ *   has clients and the cell is due for a new frame.  Called by the camera
+ *   threads with each stream frame.
+ *
+ * Parameters:
+ *
+ *      cnt       The context of the camera
+ *      img_data  The frame
+ *      tv1       Time of the frame
+ *
+ * Returns:     nothing
+ */
+void mosaic_put(struct context *cnt, struct image_data *img_data, struct timeval *tv1){
+
+    struct mosaic_tile *tile;
+    unsigned char *image;
+    int width, height;
+    long elapsed;
+
+    if ((mosaic_cnt == NULL) || (!mosaic_watched())) return;
+    if ((cnt->threadnr < 1) || (cnt->threadnr > mosaic_count)) return;
+    if (img_data->image_norm == NULL) return;
+
+    /* The cell is only used by the thread of its camera */
+    tile = &mosaic_tiles[cnt->threadnr - 1];
+    elapsed = (tv1->tv_sec - tile->time.tv_sec) * 1000000L +
+        (tv1->tv_usec - tile->time.tv_usec);
+    if ((elapsed >= 0) && (elapsed < mosaic_interval)) return;
+    tile->time = *tv1;
+
+    /* Largest size with the shape of the camera image that fits the cell */
+    width = mosaic_cell_width;
+    height = (int)((long)cnt->imgs.height * width / cnt->imgs.width);
+    if (height > mosaic_cell_height) {
+        height = mosaic_cell_height;
+        width = (int)((long)cnt->imgs.width * height / cnt->imgs.height);
+    }
+    if (width > cnt->imgs.width) {
+        width = cnt->imgs.width;
+        height = cnt->imgs.height;
+    }
+    width -= width % 2;
+    height -= height % 2;
+    if ((width < 2) || (height < 2)) return;
+
+    image = overlay_image(cnt, img_data, cnt->overlay_stream);
+    pic_scale_img(cnt->imgs.width, cnt->imgs.height, image, width, height, tile->image);
+
+    pthread_mutex_lock(&mosaic_mutex);
+        mosaic_draw(tile, width, height);
+    pthread_mutex_unlock(&mosaic_mutex);
+
+}
@@ -0,0 +1,22 @@
+/*
+ *    mosaic.h
+ *
+ *    Include file for mosaic.c
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ */
+#ifndef _INCLUDE_MOSAIC_H_
+#define _INCLUDE_MOSAIC_H_
+
+struct context;
+struct image_data;
+
+void mosaic_start(struct context **cntlist);
+void mosaic_stop(struct context **cntlist);
+int mosaic_running(const struct context *cnt);
+int mosaic_watched(void);
+void mosaic_put(struct context *cnt, struct image_data *img_data, struct timeval *tv1);
+
+#endif /* _INCLUDE_MOSAIC_H_ */
@@ -16,9 +16,11 @@
 #include "alg.h"
 #include "track.h"
 #include "event.h"
+#include "jpegutils.h"
 #include "picture.h"
 #include "rotate.h"
 #include "webu.h"
+#include "webu_stream.h"
 
 
 #define IMAGE_BUFFER_FLUSH ((unsigned int)-1)
@@ -70,6 +72,151 @@ FILE *ptr_logfile = NULL;
 unsigned int restart = 0;
 
 
+static void image_packed_free(struct image_packed *packed)
+{
+    if (packed == NULL) return;
+
+    overlay_free(&packed->overlay);
+    free(packed->data);
+    free(packed);
+}
+
+/**
+ * image_ring_release
+ *
+ *   Drops the pixels of a ring image that are no longer needed.  The slot
+ *   gets new storage from outpool_image_claim when it is captured into again.
+ *
+ * Parameters:
+ *
+ *      img      The ring image
+ *
+ * Returns:     nothing
+ */
+static void image_ring_release(struct image_data *img)
+{
+    outpool_buffer_unref(img->buffer);
+    img->buffer = NULL;
+    img->image_norm = NULL;
+    img->image_high = NULL;
+}
+
+/**
+ * image_ring_pack
+ *
+ *   Replaces the pixels of an image waiting in the pre_capture ring by a
+ *   JPEG copy of pre_capture_quality so a long ring costs memory in
+ *   proportion to the compressed size rather than the resolution.  With
+ *   passthrough the movie is written from the packets of the camera so
+ *   only the normal image is kept.  When the compression fails the pixels
+ *   are left in place.
+ *
+ * Parameters:
+ *
+ *      cnt      Pointer to the motion context structure
+ *      img      The ring image
+ *
+ * Returns:     nothing
+ */
+static void image_ring_pack(struct context *cnt, struct image_data *img)
+{
+    struct image_packed *packed;
+    int size_norm, size_high, quality;
+
+    if (img->buffer == NULL) return;
+
+    quality = cnt->conf.pre_capture_quality;
+    if (quality > 100) quality = 100;
+
+    if (cnt->imgs.packed_work == NULL) {
+        cnt->imgs.packed_work = arena_alloc(&cnt->imgs.arena
+            , MAX(cnt->imgs.size_norm, cnt->imgs.size_high));
+    }
+
+    if (img->packed == NULL)
+        img->packed = mymalloc(sizeof(struct image_packed));
+    packed = img->packed;
+
+    size_norm = jpgutl_put_yuv420p(cnt->imgs.packed_work, cnt->imgs.size_norm
+        , img->image_norm, cnt->imgs.width, cnt->imgs.height, quality, NULL, NULL, NULL);
+    if (size_norm <= 0) return;
+
+    if (packed->alloc < size_norm) {
+        packed->data = myrealloc(packed->data, size_norm, "image_ring_pack");
+        packed->alloc = size_norm;
+    }
+    memcpy(packed->data, cnt->imgs.packed_work, size_norm);
+
+    size_high = 0;
+    if ((cnt->imgs.size_high > 0) && (!util_check_passthrough(cnt))) {
+        size_high = jpgutl_put_yuv420p(cnt->imgs.packed_work, cnt->imgs.size_high
+            , img->image_high, cnt->imgs.width_high, cnt->imgs.height_high
+            , quality, NULL, NULL, NULL);
+        if (size_high <= 0) return;
+
+        if (packed->alloc < size_norm + size_high) {
+            packed->data = myrealloc(packed->data, size_norm + size_high, "image_ring_pack");
+            packed->alloc = size_norm + size_high;
+        }
+        memcpy(packed->data + size_norm, cnt->imgs.packed_work, size_high);
+    }
+
+    packed->size_norm = size_norm;
+    packed->size_high = size_high;
+    overlay_save(&packed->overlay, img);
+
+    image_ring_release(img);
+}
+
+/**
+ * image_ring_unpack
+ *
+ *   Gives a ring image its pixels back before it is output.  Images that
+ *   were never captured into or whose copy cannot be decoded are grey.
+ *
+ * Parameters:
+ *
+ *      cnt      Pointer to the motion context structure
+ *      img      The ring image
+ *
+ * Returns:     nothing
+ */
+static void image_ring_unpack(struct context *cnt, struct image_data *img)
+{
+    struct image_packed *packed = img->packed;
+    int retcd;
+
+    if (img->buffer != NULL) return;
+
+    img->buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+    img->image_norm = img->buffer->image_norm;
+    img->image_high = img->buffer->image_high;
+
+    retcd = -1;
+    if ((packed != NULL) && (packed->size_norm > 0)) {
+        retcd = jpgutl_decode_jpeg(packed->data, packed->size_norm
+            , cnt->imgs.width, cnt->imgs.height, img->image_norm);
+    }
+    if (retcd != 0)
+        memset(img->image_norm, 0x80, cnt->imgs.size_norm);
+
+    if (cnt->imgs.size_high > 0) {
+        retcd = -1;
+        if ((packed != NULL) && (packed->size_high > 0)) {
+            retcd = jpgutl_decode_jpeg(packed->data + packed->size_norm, packed->size_high
+                , cnt->imgs.width_high, cnt->imgs.height_high, img->image_high);
+        }
+        if (retcd != 0)
+            memset(img->image_high, 0x80, cnt->imgs.size_high);
+    }
+
+    if (packed != NULL) {
+        overlay_restore(img, &packed->overlay);
+        packed->size_norm = 0;
+        packed->size_high = 0;
+    }
+}
+
 /**
  * image_ring_resize
  *
@@ -120,13 +267,25 @@ static void image_ring_resize(struct context *cnt, int new_size)
             {
                 int i;
                 for(i = smallest; i < new_size; i++) {
-                    tmp[i].image_norm = mymalloc(cnt->imgs.size_norm);
+                    /*
+                     * When the ring is packed the new slots get storage once
+                     * they are captured into and restore as grey if output before.
+                     */
+                    if ((i > 0) && (cnt->conf.pre_capture_quality > 0))
+                        continue;
+                    tmp[i].buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+                    tmp[i].image_norm = tmp[i].buffer->image_norm;
                     memset(tmp[i].image_norm, 0x80, cnt->imgs.size_norm);  /* initialize to grey */
                     if (cnt->imgs.size_high > 0){
-                        tmp[i].image_high = mymalloc(cnt->imgs.size_high);
+                        tmp[i].image_high = tmp[i].buffer->image_high;
                         memset(tmp[i].image_high, 0x80, cnt->imgs.size_high);
                     }
                 }
+                /* Release the images no longer in the ring */
+                for(i = smallest; i < cnt->imgs.image_ring_size; i++) {
+                    outpool_buffer_unref(cnt->imgs.image_ring[i].buffer);
+                    image_packed_free(cnt->imgs.image_ring[i].packed);
+                }
             }
 
             /* Free the old ring */
@@ -144,6 +303,86 @@ static void image_ring_resize(struct context *cnt, int new_size)
     }
 }
 
+/**
+ * image_view_alias
+ *
+ *   Points a view of the captured frame (image_virgin or image_vprvcy) at the
+ *   pixels of a ring image instead of copying them.  The view holds a
+ *   reference on the ring storage so the pixels stay valid when the ring
+ *   slot is reused for a later capture.
+ *
+ * Parameters:
+ *
+ *      view     The view to point at the image
+ *      img      The ring image
+ *
+ * Returns:     nothing
+ */
+static void image_view_alias(struct image_data *view, struct image_data *img)
+{
+    outpool_buffer_ref(img->buffer);
+    outpool_buffer_unref(view->buffer);
+    view->buffer = img->buffer;
+    view->image_norm = img->image_norm;
+}
+
+/**
+ * image_view_copy
+ *
+ *   Copies the pixels of an image into the own storage of a view.
+ *
+ * Parameters:
+ *
+ *      cnt      Pointer to the motion context structure
+ *      view     The view to fill
+ *      store    Own storage of the view
+ *      img      The image to copy
+ *
+ * Returns:     nothing
+ */
+static void image_view_copy(struct context *cnt, struct image_data *view
+            , unsigned char *store, struct image_data *img)
+{
+    memcpy(store, img->image_norm, cnt->imgs.size_norm);
+    outpool_buffer_unref(view->buffer);
+    view->buffer = NULL;
+    view->image_norm = store;
+}
+
+/**
+ * image_views_detach
+ *
+ *   Must be called before text is drawn directly into a ring image, which
+ *   only the debug texts still do.  Views that still use the pixels of the
+ *   image get a copy of their own, and so does the ring slot when queued
+ *   outputs still use them, so the copies are only made on frames that are
+ *   drawn on.  The regular overlays never touch the ring, see overlay.c
+ *
+ * Parameters:
+ *
+ *      cnt      Pointer to the motion context structure
+ *      img      The ring image about to be altered
+ *
+ * Returns:     nothing
+ */
+static void image_views_detach(struct context *cnt, struct image_data *img)
+{
+    if (cnt->imgs.image_vprvcy.image_norm == img->image_norm)
+        image_view_copy(cnt, &cnt->imgs.image_vprvcy, cnt->imgs.vprvcy_norm, img);
+
+    /*
+     * When the virgin image was not kept apart from the privacy masked one
+     * at capture time the two are identical, so it shares the copy.
+     */
+    if (cnt->imgs.image_virgin.image_norm == img->image_norm) {
+        outpool_buffer_unref(cnt->imgs.image_virgin.buffer);
+        cnt->imgs.image_virgin.buffer = NULL;
+        cnt->imgs.image_virgin.image_norm = cnt->imgs.image_vprvcy.image_norm;
+    }
+
+    outpool_image_private(cnt, img);
+}
+
 /**
  * image_ring_destroy
  *
@@ -163,10 +402,10 @@ static void image_ring_destroy(struct context *cnt)
     if (cnt->imgs.image_ring == NULL)
         return;
 
-    /* Free all image buffers */
+    /* Release all image buffers, queued output jobs may still hold them */
     for (i = 0; i < cnt->imgs.image_ring_size; i++){
-        free(cnt->imgs.image_ring[i].image_norm);
-        if (cnt->imgs.size_high >0 ) free(cnt->imgs.image_ring[i].image_high);
+        outpool_buffer_unref(cnt->imgs.image_ring[i].buffer);
+        image_packed_free(cnt->imgs.image_ring[i].packed);
     }
 
     /* Free the ring */
@@ -177,6 +416,65 @@ static void image_ring_destroy(struct context *cnt)
     cnt->imgs.image_ring_size = 0;
 }
 
+/**
+ * image_arena_init
+ *
+ *   Maps the arena holding the frame memory of the camera.  It is sized for
+ *   the detection buffers allocated in motion_init, the privacy masks, the
+ *   preview image and the images of the pre_capture ring.  Images queued for
+ *   the output workers beyond that come from the heap and are freed again
+ *   when released, see outpool_buffer_unref.
+ *
+ * Parameters:
+ *
+ *      cnt      Pointer to the motion context structure
+ *
+ * Returns:     nothing
+ */
+static void image_arena_init(struct context *cnt)
+{
+    size_t size, motionsize;
+    int images;
+
+    motionsize = cnt->imgs.motionsize;
+
+    /* ref, img_motion, virgin_norm, vprvcy_norm and common_buffer */
+    size = 4 * arena_size(cnt->imgs.size_norm);
+    size += arena_size(3 * cnt->imgs.width * cnt->imgs.height);
+    /* ref_dyn, smartmask, smartmask_final, smartmask_buffer, labels and labelsize */
+    size += arena_size(motionsize * sizeof(*cnt->imgs.ref_dyn));
+    size += 2 * arena_size(motionsize);
+    size += arena_size(motionsize * sizeof(*cnt->imgs.smartmask_buffer));
+    size += arena_size(motionsize * sizeof(*cnt->imgs.labels));
+    size += arena_size((motionsize / 2 + 1) * sizeof(*cnt->imgs.labelsize));
+
+    if (cnt->conf.mask_privacy) {
+        size += arena_size((cnt->imgs.height * cnt->imgs.width) / 2);
+        if (cnt->imgs.size_high > 0)
+            size += arena_size((cnt->imgs.height_high * cnt->imgs.width_high) / 2);
+    }
+
+    /*
+     * The ring, the preview image and one spare image for the swap when an
+     * output worker still holds the ring image about to be overwritten.
+     * A packed ring only keeps the pixels of the last images and needs the
+     * buffer the images are compressed into.
+     */
+    if (cnt->conf.pre_capture_quality > 0) {
+        images = 4;
+        size += arena_size(MAX(cnt->imgs.size_norm, cnt->imgs.size_high));
+    } else {
+        images = cnt->conf.pre_capture + cnt->conf.minimum_motion_frames + 2;
+    }
+    size += images * arena_size(cnt->imgs.size_norm);
+    if (cnt->imgs.size_high > 0) {
+        size += arena_size(cnt->imgs.size_high);  /* image_virgin.image_high */
+        size += images * arena_size(cnt->imgs.size_high);
+    }
+
+    arena_init(&cnt->imgs.arena, size, cnt->conf.memory_hugepages, cnt->conf.memory_numa);
+}
+
 /**
  * image_save_as_preview
  *
@@ -191,18 +489,20 @@ static void image_ring_destroy(struct context *cnt)
  */
 static void image_save_as_preview(struct context *cnt, struct image_data *img)
 {
-    void *image_norm, *image_high;
+    struct image_buffer *buffer;
 
-    /* Save our pointers to our memory locations for images*/
-    image_norm = cnt->imgs.preview_image.image_norm;
-    image_high = cnt->imgs.preview_image.image_high;
+    /* A queued preview event may still be using the current preview storage */
+    outpool_image_claim(cnt, &cnt->imgs.preview_image);
+    buffer = cnt->imgs.preview_image.buffer;
 
     /* Copy over the meta data from the img into preview */
     memcpy(&cnt->imgs.preview_image, img, sizeof(struct image_data));
 
     /* Restore the pointers to the memory locations for images*/
-    cnt->imgs.preview_image.image_norm = image_norm;
-    cnt->imgs.preview_image.image_high = image_high;
+    cnt->imgs.preview_image.buffer = buffer;
+    cnt->imgs.preview_image.packed = NULL;
+    cnt->imgs.preview_image.image_norm = buffer->image_norm;
+    cnt->imgs.preview_image.image_high = buffer->image_high;
 
     /* Copy the actual images for norm and high */
     memcpy(cnt->imgs.preview_image.image_norm, img->image_norm, cnt->imgs.size_norm);
@@ -217,23 +517,10 @@ static void image_save_as_preview(struct context *cnt, struct image_data *img)
     if (cnt->imgs.preview_image.diffs == 0)
         cnt->imgs.preview_image.diffs = 1;
 
-    /* draw locate box here when mode = LOCATE_PREVIEW */
-    if (cnt->locate_motion_mode == LOCATE_PREVIEW) {
-
-        if (cnt->locate_motion_style == LOCATE_BOX) {
-            alg_draw_location(&img->location, &cnt->imgs, cnt->imgs.width, cnt->imgs.preview_image.image_norm,
-                              LOCATE_BOX, LOCATE_NORMAL, cnt->process_thisframe);
-        } else if (cnt->locate_motion_style == LOCATE_REDBOX) {
-            alg_draw_red_location(&img->location, &cnt->imgs, cnt->imgs.width, cnt->imgs.preview_image.image_norm,
-                                  LOCATE_REDBOX, LOCATE_NORMAL, cnt->process_thisframe);
-        } else if (cnt->locate_motion_style == LOCATE_CROSS) {
-            alg_draw_location(&img->location, &cnt->imgs, cnt->imgs.width, cnt->imgs.preview_image.image_norm,
-                              LOCATE_CROSS, LOCATE_NORMAL, cnt->process_thisframe);
-        } else if (cnt->locate_motion_style == LOCATE_REDCROSS) {
-            alg_draw_red_location(&img->location, &cnt->imgs, cnt->imgs.width, cnt->imgs.preview_image.image_norm,
-                                  LOCATE_REDCROSS, LOCATE_NORMAL, cnt->process_thisframe);
-        }
-    }
+    /* The preview keeps the overlay of the image and adds the locate box when mode = LOCATE_PREVIEW */
+    overlay_copy(&cnt->imgs.preview_image, img);
+    if (cnt->locate_motion_mode == LOCATE_PREVIEW)
+        overlay_set_locate(&cnt->imgs.preview_image);
 }
 
 /**
@@ -488,21 +775,24 @@ static void motion_detected(struct context *cnt, int dev, struct image_data *img
     struct coord *location = &img->location;
     int indx;
 
-    /* Draw location */
+    /*
+     * Draw location.  The normal image gets it when an output asks for it,
+     * the motion image only when something is going to use it.
+     */
     if (cnt->locate_motion_mode == LOCATE_ON) {
 
-        if (cnt->locate_motion_style == LOCATE_BOX) {
-            alg_draw_location(location, imgs, imgs->width, img->image_norm, LOCATE_BOX,
-                              LOCATE_BOTH, cnt->process_thisframe);
-        } else if (cnt->locate_motion_style == LOCATE_REDBOX) {
-            alg_draw_red_location(location, imgs, imgs->width, img->image_norm, LOCATE_REDBOX,
-                                  LOCATE_BOTH, cnt->process_thisframe);
-        } else if (cnt->locate_motion_style == LOCATE_CROSS) {
-            alg_draw_location(location, imgs, imgs->width, img->image_norm, LOCATE_CROSS,
-                              LOCATE_BOTH, cnt->process_thisframe);
-        } else if (cnt->locate_motion_style == LOCATE_REDCROSS) {
-            alg_draw_red_location(location, imgs, imgs->width, img->image_norm, LOCATE_REDCROSS,
-                                  LOCATE_BOTH, cnt->process_thisframe);
+        overlay_set_locate(img);
+
+        if (conf->picture_output_motion || conf->movie_output_motion ||
+            conf->setup_mode || (cnt->stream_motion.cnct_count > 0)) {
+            if ((cnt->locate_motion_style == LOCATE_REDBOX) ||
+                (cnt->locate_motion_style == LOCATE_REDCROSS)) {
+                alg_draw_red_location(location, imgs, imgs->width, img->image_norm,
+                                      cnt->locate_motion_style, LOCATE_MOTION, cnt->process_thisframe);
+            } else {
+                alg_draw_location(location, imgs, imgs->width, img->image_norm,
+                                  cnt->locate_motion_style, LOCATE_MOTION, cnt->process_thisframe);
+            }
         }
     }
 
@@ -542,6 +832,12 @@ static void motion_detected(struct context *cnt, int dev, struct image_data *img
                 indx++;
                 if (indx == cnt->imgs.image_ring_size) indx = 0;
                 if ((cnt->imgs.image_ring[indx].flags & (IMAGE_SAVE | IMAGE_SAVED)) == IMAGE_SAVE){
+                    /* Frame counting of the new movie */
+                    cnt->movie_last_shot = -1;
+                    cnt->movie_fps = cnt->lastrate;
+                    MOTION_LOG(INF, TYPE_EVENTS, NO_ERRNO, _("Source FPS %d"), cnt->movie_fps);
+                    if (cnt->movie_fps < 2) cnt->movie_fps = 2;
+
                     event(cnt, EVENT_FIRSTMOTION, img, NULL, NULL, &cnt->imgs.image_ring[indx].timestamp_tv);
                     indx = cnt->imgs.image_ring_in;
                 }
@@ -576,7 +872,7 @@ static void motion_detected(struct context *cnt, int dev, struct image_data *img
          * Output the image_out (motion) picture.
          */
         if (conf->picture_output_motion)
-            event(cnt, EVENT_IMAGEM_DETECTED, NULL, NULL, NULL, &img->timestamp_tv);
+            event(cnt, EVENT_IMAGEM_DETECTED, &imgs->img_motion, NULL, NULL, &img->timestamp_tv);
     }
 
     /* if track enabled and auto track on */
@@ -615,6 +911,7 @@ static void process_image_ring(struct context *cnt, unsigned int max_images)
 
         /* Set inte global context that we are working with this image */
         cnt->current_image = &cnt->imgs.image_ring[cnt->imgs.image_ring_out];
+        image_ring_unpack(cnt, cnt->current_image);
 
         if (cnt->imgs.image_ring[cnt->imgs.image_ring_out].shot < cnt->conf.framerate) {
             if (cnt->log_level >= DBG) {
@@ -634,10 +931,12 @@ static void process_image_ring(struct context *cnt, unsigned int max_images)
 
                 mystrftime(cnt, tmp, sizeof(tmp), "%H%M%S-%q",
                            &cnt->imgs.image_ring[cnt->imgs.image_ring_out].timestamp_tv, NULL, 0);
+                image_views_detach(cnt, &cnt->imgs.image_ring[cnt->imgs.image_ring_out]);
                 draw_text(cnt->imgs.image_ring[cnt->imgs.image_ring_out].image_norm,
                           cnt->imgs.width, cnt->imgs.height, 10, 20, tmp, cnt->text_scale);
                 draw_text(cnt->imgs.image_ring[cnt->imgs.image_ring_out].image_norm,
                           cnt->imgs.width, cnt->imgs.height, 10, 30, t, cnt->text_scale);
+                overlay_changed(&cnt->imgs.image_ring[cnt->imgs.image_ring_out]);
             }
 
             /* Output the picture to jpegs and ffmpeg */
@@ -656,7 +955,7 @@ static void process_image_ring(struct context *cnt, unsigned int max_images)
             if (!cnt->conf.movie_duplicate_frames) {
                 /* don't duplicate frames */
             } else if ((cnt->imgs.image_ring[cnt->imgs.image_ring_out].shot == 0) &&
-                (cnt->ffmpeg_output || (cnt->conf.movie_extpipe_use && cnt->extpipe))) {
+                (cnt->conf.movie_output || (cnt->conf.movie_extpipe_use && cnt->conf.movie_extpipe))) {
                 /*
                  * movie_last_shoot is -1 when file is created,
                  * we don't know how many frames there is in first sec
@@ -669,8 +968,10 @@ static void process_image_ring(struct context *cnt, unsigned int max_images)
                             MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO
                             ,_("Added %d fillerframes into movie"), frames);
                             sprintf(tmp, "Fillerframes %d", frames);
+                            image_views_detach(cnt, &cnt->imgs.image_ring[cnt->imgs.image_ring_out]);
                             draw_text(cnt->imgs.image_ring[cnt->imgs.image_ring_out].image_norm,
                                       cnt->imgs.width, cnt->imgs.height, 10, 40, tmp, cnt->text_scale);
+                            overlay_changed(&cnt->imgs.image_ring[cnt->imgs.image_ring_out]);
                         }
                     }
                     /* Check how many frames it was last sec */
@@ -716,6 +1017,10 @@ static void process_image_ring(struct context *cnt, unsigned int max_images)
             }
         }
 
+        /* Pixels of an older image that was unpacked are not needed anymore */
+        if ((cnt->conf.pre_capture_quality > 0) && (cnt->current_image != saved_current_image))
+            image_ring_release(cnt->current_image);
+
         /* Increment to image after last sended */
         if (++cnt->imgs.image_ring_out >= cnt->imgs.image_ring_size)
             cnt->imgs.image_ring_out = 0;
@@ -808,13 +1113,14 @@ static void init_mask_privacy(struct context *cnt){
             cnt->imgs.mask_privacy = get_pgm(picture, cnt->imgs.width, cnt->imgs.height);
 
             /* We only need the "or" mask for the U & V chrominance area.  */
-            cnt->imgs.mask_privacy_uv = mymalloc((cnt->imgs.height * cnt->imgs.width) / 2);
+            cnt->imgs.mask_privacy_uv = arena_alloc(&cnt->imgs.arena, (cnt->imgs.height * cnt->imgs.width) / 2);
             if (cnt->imgs.size_high > 0){
                 MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
                     ,_("Opening high resolution privacy mask file"));
                 rewind(picture);
                 cnt->imgs.mask_privacy_high = get_pgm(picture, cnt->imgs.width_high, cnt->imgs.height_high);
-                cnt->imgs.mask_privacy_high_uv = mymalloc((cnt->imgs.height_high * cnt->imgs.width_high) / 2);
+                cnt->imgs.mask_privacy_high_uv = arena_alloc(&cnt->imgs.arena
+                    , (cnt->imgs.height_high * cnt->imgs.width_high) / 2);
             }
 
             myfclose(picture);
@@ -916,61 +1222,154 @@ static void init_text_scale(struct context *cnt){
 
 static void mot_stream_init(struct context *cnt){
 
-    /* The image buffers are allocated in event_stream_put if needed*/
-    pthread_mutex_init(&cnt->mutex_stream, NULL);
+    /*
+     * The images are allocated in event_stream_put if needed.  The mutex and
+     * the connection counters belong to the context, clients stay connected
+     * while the camera is restarted.
+     */
+    pthread_mutex_lock(&cnt->mutex_stream);
+        cnt->stream_norm.jpeg = NULL;
+        cnt->stream_norm.seq = 0;
+        cnt->stream_norm.spare = NULL;
+
+        /* The substreams are set up by mot_stream_sizes once the image size is known */
+        cnt->stream_scaled_count = 0;
+
+        cnt->stream_motion.jpeg = NULL;
+        cnt->stream_motion.seq = 0;
+        cnt->stream_motion.spare = NULL;
+
+        cnt->stream_source.jpeg = NULL;
+        cnt->stream_source.seq = 0;
+        cnt->stream_source.spare = NULL;
+
+        cnt->stream_mpegts.seq = 0;
+        cnt->stream_mpegts.head = NULL;
+        cnt->stream_mpegts.first = NULL;
+        cnt->stream_mpegts.build = NULL;
+        cnt->stream_mpegts.kept = 0;
+    pthread_mutex_unlock(&cnt->mutex_stream);
+    cnt->ffmpeg_stream = NULL;
+    cnt->ffmpeg_stream_fail = 0;
 
-    cnt->imgs.substream_image = NULL;
+}
 
-    cnt->stream_norm.jpeg_size = 0;
-    cnt->stream_norm.jpeg_data = NULL;
-    cnt->stream_norm.cnct_count = 0;
+static int mot_stream_size_add(struct context *cnt, const char *size){
 
-    cnt->stream_sub.jpeg_size = 0;
-    cnt->stream_sub.jpeg_data = NULL;
-    cnt->stream_sub.cnct_count = 0;
+    struct stream_scaled *scaled;
+    int num, den, width, height, indx;
 
-    cnt->stream_motion.jpeg_size = 0;
-    cnt->stream_motion.jpeg_data = NULL;
-    cnt->stream_motion.cnct_count = 0;
+    if (sscanf(size, " %d / %d", &num, &den) == 2) {
+        if ((num != 1) || (den < 2)) return -1;
+        width = cnt->imgs.width / den;
+        height = cnt->imgs.height / den;
+    } else if (sscanf(size, " %d", &num) == 1) {
+        if ((num <= 0) || (num >= cnt->imgs.width)) return -1;
+        width = num;
+        height = (int)((long)cnt->imgs.height * num / cnt->imgs.width);
+    } else {
+        return -1;
+    }
 
-    cnt->stream_source.jpeg_size = 0;
-    cnt->stream_source.jpeg_data = NULL;
-    cnt->stream_source.cnct_count = 0;
+    /* Multiples of 8 keep the chroma planes even and suit the JPEG blocks */
+    width -= width % 8;
+    height -= height % 8;
+    if ((width < 16) || (height < 16)) return -1;
 
-}
+    for (indx = 0; indx < cnt->stream_scaled_count; indx++) {
+        if (cnt->stream_scaled[indx].width == width) return 0;
+    }
 
-static void mot_stream_deinit(struct context *cnt){
+    if (cnt->stream_scaled_count == STREAM_SCALED_MAX) {
+        MOTION_LOG(WRN, TYPE_STREAM, NO_ERRNO
+            ,_("Only %d stream sizes are allowed, ignoring %s")
+            ,STREAM_SCALED_MAX, size);
+        return 0;
+    }
 
-    /* Need to check whether buffers were allocated since init
-     * function defers the allocations to event_stream_put
-    */
+    /* Keep the sizes sorted from the largest down */
+    indx = cnt->stream_scaled_count;
+    while ((indx > 0) && (cnt->stream_scaled[indx - 1].width < width)) {
+        cnt->stream_scaled[indx] = cnt->stream_scaled[indx - 1];
+        indx--;
+    }
+    scaled = &cnt->stream_scaled[indx];
+    scaled->width = width;
+    scaled->height = height;
+    cnt->stream_scaled_count++;
 
-    pthread_mutex_destroy(&cnt->mutex_stream);
+    return 0;
+}
 
-    if (cnt->imgs.substream_image != NULL){
-        free(cnt->imgs.substream_image);
-        cnt->imgs.substream_image = NULL;
+static void mot_stream_sizes(struct context *cnt){
+    /*
+     * Set up the substreams listed in stream_sizes.  Each size is scaled
+     * from the size twice as large when there is one so a ladder of halves
+     * only ever averages 2x2 blocks.
+     */
+    struct stream_scaled *scaled;
+    char *sizes, *size, *saveptr;
+    int indx, indx2;
+
+    cnt->stream_scaled_count = 0;
+    if ((cnt->conf.stream_sizes == NULL) || (*cnt->conf.stream_sizes == '\0')) return;
+
+    sizes = mystrdup(cnt->conf.stream_sizes);
+    for (size = strtok_r(sizes, ",", &saveptr); size != NULL; size = strtok_r(NULL, ",", &saveptr)) {
+        if (mot_stream_size_add(cnt, size) != 0) {
+            MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+                ,_("Invalid stream size %s for a %dx%d image")
+                ,size, cnt->imgs.width, cnt->imgs.height);
+        }
     }
-
-    if (cnt->stream_norm.jpeg_data != NULL){
-        free(cnt->stream_norm.jpeg_data);
-        cnt->stream_norm.jpeg_data = NULL;
+    free(sizes);
+
+    for (indx = 0; indx < cnt->stream_scaled_count; indx++) {
+        scaled = &cnt->stream_scaled[indx];
+        scaled->source = -1;
+        for (indx2 = 0; indx2 < indx; indx2++) {
+            if ((cnt->stream_scaled[indx2].width == scaled->width * 2) &&
+                (cnt->stream_scaled[indx2].height == scaled->height * 2)) {
+                scaled->source = indx2;
+            }
+        }
+        scaled->needed = FALSE;
+        scaled->image = mymalloc((scaled->width * scaled->height * 3) / 2);
+        scaled->stream.jpeg = NULL;
+        scaled->stream.seq = 0;
+        scaled->stream.spare = NULL;
+        scaled->stream.cnct_count = 0;
+        MOTION_LOG(INF, TYPE_STREAM, NO_ERRNO
+            ,_("Substream %d: %dx%d"), indx, scaled->width, scaled->height);
     }
 
-    if (cnt->stream_sub.jpeg_data != NULL){
-        free(cnt->stream_sub.jpeg_data);
-        cnt->stream_sub.jpeg_data = NULL;
-    }
+}
 
-    if (cnt->stream_motion.jpeg_data != NULL){
-        free(cnt->stream_motion.jpeg_data);
-        cnt->stream_motion.jpeg_data = NULL;
-    }
+static void mot_stream_deinit(struct context *cnt){
 
-    if (cnt->stream_source.jpeg_data != NULL){
-        free(cnt->stream_source.jpeg_data);
-        cnt->stream_source.jpeg_data = NULL;
+    int indx;
+
+    /* Need to check whether images were allocated since init
+     * function defers the allocations to event_stream_put
+    */
+
+    webu_stream_jpeg_free(cnt, &cnt->stream_norm);
+    for (indx = 0; indx < cnt->stream_scaled_count; indx++) {
+        webu_stream_jpeg_free(cnt, &cnt->stream_scaled[indx].stream);
+        free(cnt->stream_scaled[indx].image);
+        cnt->stream_scaled[indx].image = NULL;
     }
+    cnt->stream_scaled_count = 0;
+    webu_stream_jpeg_free(cnt, &cnt->stream_motion);
+    webu_stream_jpeg_free(cnt, &cnt->stream_source);
+
+    if (cnt->ffmpeg_stream != NULL) {
+        ffmpeg_close(cnt->ffmpeg_stream);
+        free(cnt->ffmpeg_stream);
+        cnt->ffmpeg_stream = NULL;
+    }
+    webu_stream_mpegts_free(cnt, &cnt->stream_mpegts);
+
 }
 
 /* TODO: dbse functions are to be moved to separate module in future change*/
@@ -1244,6 +1643,9 @@ static int motion_init(struct context *cnt)
     cnt->detecting_motion = 0;
     cnt->event_user = FALSE;
     cnt->event_stop = FALSE;
+    cnt->segment = NULL;
+    cnt->segment_running = FALSE;
+    cnt->extpipe_writer = NULL;
 
     /* Make sure to default the high res to zero */
     cnt->imgs.width_high = 0;
@@ -1353,25 +1755,31 @@ static int motion_init(struct context *cnt)
      */
     cnt->imgs.size_high = (cnt->imgs.width_high * cnt->imgs.height_high * 3) / 2;
 
+    image_arena_init(cnt);
+    outpool_pool_init(&cnt->imgs.image_pool, &cnt->imgs.arena
+        , cnt->imgs.size_norm, cnt->imgs.size_high);
     image_ring_resize(cnt, 1); /* Create a initial precapture ring buffer with 1 frame */
 
-    cnt->imgs.ref = mymalloc(cnt->imgs.size_norm);
-    cnt->imgs.img_motion.image_norm = mymalloc(cnt->imgs.size_norm);
+    cnt->imgs.ref = arena_alloc(&cnt->imgs.arena, cnt->imgs.size_norm);
+    cnt->imgs.img_motion.image_norm = arena_alloc(&cnt->imgs.arena, cnt->imgs.size_norm);
 
     /* contains the moving objects of ref. frame */
-    cnt->imgs.ref_dyn = mymalloc(cnt->imgs.motionsize * sizeof(*cnt->imgs.ref_dyn));
-    cnt->imgs.image_virgin.image_norm = mymalloc(cnt->imgs.size_norm);
-    cnt->imgs.image_vprvcy.image_norm = mymalloc(cnt->imgs.size_norm);
-    cnt->imgs.smartmask = mymalloc(cnt->imgs.motionsize);
-    cnt->imgs.smartmask_final = mymalloc(cnt->imgs.motionsize);
-    cnt->imgs.smartmask_buffer = mymalloc(cnt->imgs.motionsize * sizeof(*cnt->imgs.smartmask_buffer));
-    cnt->imgs.labels = mymalloc(cnt->imgs.motionsize * sizeof(*cnt->imgs.labels));
-    cnt->imgs.labelsize = mymalloc((cnt->imgs.motionsize/2+1) * sizeof(*cnt->imgs.labelsize));
-    cnt->imgs.preview_image.image_norm = mymalloc(cnt->imgs.size_norm);
-    cnt->imgs.common_buffer = mymalloc(3 * cnt->imgs.width * cnt->imgs.height);
+    cnt->imgs.ref_dyn = arena_alloc(&cnt->imgs.arena, cnt->imgs.motionsize * sizeof(*cnt->imgs.ref_dyn));
+    cnt->imgs.virgin_norm = arena_alloc(&cnt->imgs.arena, cnt->imgs.size_norm);
+    cnt->imgs.vprvcy_norm = arena_alloc(&cnt->imgs.arena, cnt->imgs.size_norm);
+    cnt->imgs.image_virgin.image_norm = cnt->imgs.virgin_norm;
+    cnt->imgs.image_vprvcy.image_norm = cnt->imgs.vprvcy_norm;
+    cnt->imgs.smartmask = arena_alloc(&cnt->imgs.arena, cnt->imgs.motionsize);
+    cnt->imgs.smartmask_final = arena_alloc(&cnt->imgs.arena, cnt->imgs.motionsize);
+    cnt->imgs.smartmask_buffer = arena_alloc(&cnt->imgs.arena, cnt->imgs.motionsize * sizeof(*cnt->imgs.smartmask_buffer));
+    cnt->imgs.labels = arena_alloc(&cnt->imgs.arena, cnt->imgs.motionsize * sizeof(*cnt->imgs.labels));
+    cnt->imgs.labelsize = arena_alloc(&cnt->imgs.arena, (cnt->imgs.motionsize/2+1) * sizeof(*cnt->imgs.labelsize));
+    cnt->imgs.preview_image.buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+    cnt->imgs.preview_image.image_norm = cnt->imgs.preview_image.buffer->image_norm;
+    cnt->imgs.preview_image.image_high = cnt->imgs.preview_image.buffer->image_high;
+    cnt->imgs.common_buffer = arena_alloc(&cnt->imgs.arena, 3 * cnt->imgs.width * cnt->imgs.height);
     if (cnt->imgs.size_high > 0){
-        cnt->imgs.image_virgin.image_high = mymalloc(cnt->imgs.size_high);
-        cnt->imgs.preview_image.image_high = mymalloc(cnt->imgs.size_high);
+        cnt->imgs.image_virgin.image_high = arena_alloc(&cnt->imgs.arena, cnt->imgs.size_high);
     }
 
     mot_stream_init(cnt);
@@ -1403,8 +1811,15 @@ static int motion_init(struct context *cnt)
      */
     rotate_init(cnt); /* rotate_deinit is called in main */
 
+    mot_stream_sizes(cnt);
+
     init_text_scale(cnt);   /*Initialize and validate the text_scale */
 
+    cnt->overlay_picture = overlay_items(cnt->conf.picture_overlay);
+    cnt->overlay_movie = overlay_items(cnt->conf.movie_overlay);
+    cnt->overlay_stream = overlay_items(cnt->conf.stream_overlay);
+    cnt->overlay_video_pipe = overlay_items(cnt->conf.video_pipe_overlay);
+
     /* Capture first image, or we will get an alarm on start */
     if (cnt->video_dev >= 0) {
         int i;
@@ -1496,6 +1911,8 @@ static int motion_init(struct context *cnt)
 
     init_mask_privacy(cnt);
 
+    arena_report(&cnt->imgs.arena);
+
     /* Always initialize smart_mask - someone could turn it on later... */
     memset(cnt->imgs.smartmask, 0, cnt->imgs.motionsize);
     memset(cnt->imgs.smartmask_final, 255, cnt->imgs.motionsize);
@@ -1562,6 +1979,11 @@ static int motion_init(struct context *cnt)
     for (indx = 0; indx < cnt->rolling_average_limit; indx++)
         cnt->rolling_average_data[indx] = cnt->required_frame_time;
 
+    /* Start at the full framerate */
+    cnt->idle = FALSE;
+    cnt->idle_rampup = FALSE;
+    cnt->idle_lasttime = time(NULL);
+
 
     cnt->track_posx = 0;
     cnt->track_posy = 0;
@@ -1642,6 +2064,10 @@ static void motion_cleanup(struct context *cnt) {
     event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, NULL);
     event(cnt, EVENT_ENDMOTION, NULL, NULL, NULL, NULL);
 
+    /* Wait for the output workers before releasing the images and devices */
+    outpool_flush(cnt);
+    segment_close(cnt, NULL);
+
     mot_stream_deinit(cnt);
 
     if (cnt->video_dev >= 0) {
@@ -1649,34 +2075,42 @@ static void motion_cleanup(struct context *cnt) {
         vid_close(cnt);
     }
 
-    free(cnt->imgs.img_motion.image_norm);
+    arena_free(&cnt->imgs.arena, cnt->imgs.img_motion.image_norm);
     cnt->imgs.img_motion.image_norm = NULL;
 
-    free(cnt->imgs.ref);
+    arena_free(&cnt->imgs.arena, cnt->imgs.ref);
     cnt->imgs.ref = NULL;
 
-    free(cnt->imgs.ref_dyn);
+    arena_free(&cnt->imgs.arena, cnt->imgs.ref_dyn);
     cnt->imgs.ref_dyn = NULL;
 
-    free(cnt->imgs.image_virgin.image_norm);
+    outpool_buffer_unref(cnt->imgs.image_virgin.buffer);
+    cnt->imgs.image_virgin.buffer = NULL;
     cnt->imgs.image_virgin.image_norm = NULL;
 
-    free(cnt->imgs.image_vprvcy.image_norm);
+    outpool_buffer_unref(cnt->imgs.image_vprvcy.buffer);
+    cnt->imgs.image_vprvcy.buffer = NULL;
     cnt->imgs.image_vprvcy.image_norm = NULL;
 
-    free(cnt->imgs.labels);
+    arena_free(&cnt->imgs.arena, cnt->imgs.virgin_norm);
+    cnt->imgs.virgin_norm = NULL;
+
+    arena_free(&cnt->imgs.arena, cnt->imgs.vprvcy_norm);
+    cnt->imgs.vprvcy_norm = NULL;
+
+    arena_free(&cnt->imgs.arena, cnt->imgs.labels);
     cnt->imgs.labels = NULL;
 
-    free(cnt->imgs.labelsize);
+    arena_free(&cnt->imgs.arena, cnt->imgs.labelsize);
     cnt->imgs.labelsize = NULL;
 
-    free(cnt->imgs.smartmask);
+    arena_free(&cnt->imgs.arena, cnt->imgs.smartmask);
     cnt->imgs.smartmask = NULL;
 
-    free(cnt->imgs.smartmask_final);
+    arena_free(&cnt->imgs.arena, cnt->imgs.smartmask_final);
     cnt->imgs.smartmask_final = NULL;
 
-    free(cnt->imgs.smartmask_buffer);
+    arena_free(&cnt->imgs.arena, cnt->imgs.smartmask_buffer);
     cnt->imgs.smartmask_buffer = NULL;
 
     if (cnt->imgs.mask) free(cnt->imgs.mask);
@@ -1685,30 +2119,34 @@ static void motion_cleanup(struct context *cnt) {
     if (cnt->imgs.mask_privacy) free(cnt->imgs.mask_privacy);
     cnt->imgs.mask_privacy = NULL;
 
-    if (cnt->imgs.mask_privacy_uv) free(cnt->imgs.mask_privacy_uv);
+    arena_free(&cnt->imgs.arena, cnt->imgs.mask_privacy_uv);
     cnt->imgs.mask_privacy_uv = NULL;
 
     if (cnt->imgs.mask_privacy_high) free(cnt->imgs.mask_privacy_high);
     cnt->imgs.mask_privacy_high = NULL;
 
-    if (cnt->imgs.mask_privacy_high_uv) free(cnt->imgs.mask_privacy_high_uv);
+    arena_free(&cnt->imgs.arena, cnt->imgs.mask_privacy_high_uv);
     cnt->imgs.mask_privacy_high_uv = NULL;
 
-    free(cnt->imgs.common_buffer);
+    arena_free(&cnt->imgs.arena, cnt->imgs.common_buffer);
     cnt->imgs.common_buffer = NULL;
 
-    free(cnt->imgs.preview_image.image_norm);
+    outpool_buffer_unref(cnt->imgs.preview_image.buffer);
+    cnt->imgs.preview_image.buffer = NULL;
     cnt->imgs.preview_image.image_norm = NULL;
+    cnt->imgs.preview_image.image_high = NULL;
 
     if (cnt->imgs.size_high > 0){
-        free(cnt->imgs.image_virgin.image_high);
+        arena_free(&cnt->imgs.arena, cnt->imgs.image_virgin.image_high);
         cnt->imgs.image_virgin.image_high = NULL;
-
-        free(cnt->imgs.preview_image.image_high);
-        cnt->imgs.preview_image.image_high = NULL;
     }
 
     image_ring_destroy(cnt); /* Cleanup the precapture ring buffer */
+    outpool_pool_deinit(&cnt->imgs.image_pool);
+
+    arena_free(&cnt->imgs.arena, cnt->imgs.packed_work);
+    cnt->imgs.packed_work = NULL;
+    arena_deinit(&cnt->imgs.arena);
 
     rotate_deinit(cnt); /* cleanup image rotation data */
 
@@ -1850,6 +2288,7 @@ static void mlp_areadetect(struct context *cnt){
 static void mlp_prepare(struct context *cnt){
 
     int frame_buffer_size;
+    unsigned int detect_rate;
     struct timeval tv1;
 
     /***** MOTION LOOP - PREPARE FOR NEW FRAME SECTION *****/
@@ -1866,11 +2305,16 @@ static void mlp_prepare(struct context *cnt){
 
     /*
      * Calculate detection rate limit. Above 5fps we limit the detection
-     * rate to 3fps to reduce load at higher framerates.
+     * rate to 3fps to reduce load at higher framerates.  An idle camera
+     * only detects at the idle_framerate.
      */
+    detect_rate = 3;
+    if (cnt->idle && (cnt->conf.idle_framerate < detect_rate))
+        detect_rate = cnt->conf.idle_framerate;
+
     cnt->process_thisframe = 0;
     cnt->rate_limit++;
-    if (cnt->rate_limit >= (cnt->lastrate / 3)) {
+    if (cnt->rate_limit >= (cnt->lastrate / detect_rate)) {
         cnt->rate_limit = 0;
         cnt->process_thisframe = 1;
     }
@@ -1911,7 +2355,13 @@ static void mlp_prepare(struct context *cnt){
      * is used as the ffmpeg framerate when motion is detected.
      */
     if (cnt->lastframetime != cnt->currenttime) {
-        cnt->lastrate = cnt->shots + 1;
+        /* A second that was partly idle would give a wrong movie framerate */
+        if (cnt->idle_rampup) {
+            cnt->lastrate = cnt->conf.framerate;
+            cnt->idle_rampup = FALSE;
+        } else {
+            cnt->lastrate = cnt->shots + 1;
+        }
         cnt->shots = -1;
         cnt->lastframetime = cnt->currenttime;
 
@@ -1957,6 +2407,21 @@ static void mlp_resetimages(struct context *cnt){
     old_image = cnt->current_image;
     cnt->current_image = &cnt->imgs.image_ring[cnt->imgs.image_ring_in];
 
+    /* Detach the slot from images still queued for the output workers */
+    outpool_image_claim(cnt, cnt->current_image);
+
+    /*
+     * The previous image now only waits in the ring.  Pack it unless it is
+     * about to be output, and drop it when it already has been.
+     */
+    if ((cnt->conf.pre_capture_quality > 0) && (old_image != NULL) &&
+        (old_image != cnt->current_image)) {
+        if (old_image->flags & IMAGE_SAVED)
+            image_ring_release(old_image);
+        else if (!(old_image->flags & IMAGE_SAVE))
+            image_ring_pack(cnt, old_image);
+    }
+
     /* Init/clear current_image */
     if (cnt->process_thisframe) {
         /* set diffs to 0 now, will be written after we calculated diffs in new image */
@@ -2085,14 +2550,20 @@ static int mlp_capture(struct context *cnt){
         cnt->missing_frame_counter = 0;
 
         /*
-         * Save the newly captured still virgin image to a buffer
-         * which we will not alter with text and location graphics
+         * The still virgin image and the privacy masked image use the pixels
+         * of the ring image until text or location graphics are drawn on it.
+         * The image without the privacy mask is only kept apart when the
+         * source stream is being watched.
          */
-        memcpy(cnt->imgs.image_virgin.image_norm, cnt->current_image->image_norm, cnt->imgs.size_norm);
+        if (cnt->imgs.mask_privacy && (cnt->stream_source.cnct_count > 0)) {
+            image_view_copy(cnt, &cnt->imgs.image_virgin, cnt->imgs.virgin_norm, cnt->current_image);
+        } else {
+            image_view_alias(&cnt->imgs.image_virgin, cnt->current_image);
+        }
 
         mlp_mask_privacy(cnt);
 
-        memcpy(cnt->imgs.image_vprvcy.image_norm, cnt->current_image->image_norm, cnt->imgs.size_norm);
+        image_view_alias(&cnt->imgs.image_vprvcy, cnt->current_image);
 
         /*
          * If the camera is a netcam we let the camera decide the pace.
@@ -2268,6 +2739,8 @@ static void mlp_detection(struct context *cnt){
              * because with Round Robin this is controlled by roundrobin_skip.
              */
             if (cnt->conf.roundrobin_switchfilter && cnt->current_image->diffs > cnt->threshold) {
+                if (cnt->conf.text_changes)
+                    image_views_detach(cnt, cnt->current_image);
                 cnt->current_image->diffs = alg_switchfilter(cnt, cnt->current_image->diffs,
                                                              cnt->current_image->image_norm);
 
@@ -2428,6 +2901,11 @@ static void mlp_overlay(struct context *cnt){
         cnt->conf.setup_mode || (cnt->stream_motion.cnct_count > 0)))
         overlay_fixed_mask(cnt, cnt->imgs.img_motion.image_norm);
 
+    /*
+     * The text for the captured image is only recorded here and drawn by
+     * the outputs that use the image, see overlay.c
+     */
+
     /* Add changed pixels in upper right corner of the pictures */
     if (cnt->conf.text_changes) {
         if (!cnt->pause)
@@ -2435,8 +2913,7 @@ static void mlp_overlay(struct context *cnt){
         else
             sprintf(tmp, "-");
 
-        draw_text(cnt->current_image->image_norm, cnt->imgs.width, cnt->imgs.height,
-                  cnt->imgs.width - 10, 10, tmp, cnt->text_scale);
+        overlay_set_text(cnt->current_image, OVERLAY_TEXT_CHANGES, tmp);
     }
 
     /*
@@ -2459,17 +2936,14 @@ static void mlp_overlay(struct context *cnt){
     if (cnt->conf.text_left) {
         mystrftime(cnt, tmp, sizeof(tmp), cnt->conf.text_left,
                    &cnt->current_image->timestamp_tv, NULL, 0);
-        draw_text(cnt->current_image->image_norm, cnt->imgs.width, cnt->imgs.height,
-                  10, cnt->imgs.height - (10 * cnt->text_scale), tmp, cnt->text_scale);
+        overlay_set_text(cnt->current_image, OVERLAY_TEXT_LEFT, tmp);
     }
 
     /* Add text in lower right corner of the pictures */
     if (cnt->conf.text_right) {
         mystrftime(cnt, tmp, sizeof(tmp), cnt->conf.text_right,
                    &cnt->current_image->timestamp_tv, NULL, 0);
-        draw_text(cnt->current_image->image_norm, cnt->imgs.width, cnt->imgs.height,
-                  cnt->imgs.width - 10, cnt->imgs.height - (10 * cnt->text_scale),
-                  tmp, cnt->text_scale);
+        overlay_set_text(cnt->current_image, OVERLAY_TEXT_RIGHT, tmp);
     }
 
 }
@@ -2501,8 +2975,8 @@ static void mlp_actions(struct context *cnt){
          *  no motion then we reset the start movie time so that we do not
          *  get a pause in the movie.
         */
-        if ( (cnt->detecting_motion == 0) && (cnt->ffmpeg_output != NULL) )
-            ffmpeg_reset_movie_start_time(cnt->ffmpeg_output, &cnt->current_image->timestamp_tv);
+        if (cnt->detecting_motion == 0)
+            event(cnt, EVENT_FFMPEG_RESUME, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
         cnt->detecting_motion = 1;
         if (cnt->conf.post_capture > 0) {
             /* Setup the postcap counter */
@@ -2544,8 +3018,8 @@ static void mlp_actions(struct context *cnt){
              *  no motion then we reset the start movie time so that we do not
              *  get a pause in the movie.
             */
-            if ( (cnt->detecting_motion == 0) && (cnt->ffmpeg_output != NULL) )
-                ffmpeg_reset_movie_start_time(cnt->ffmpeg_output, &cnt->current_image->timestamp_tv);
+            if (cnt->detecting_motion == 0)
+                event(cnt, EVENT_FFMPEG_RESUME, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
 
             cnt->detecting_motion = 1;
 
@@ -2610,7 +3084,7 @@ static void mlp_actions(struct context *cnt){
 
             /* Save preview_shot here at the end of event */
             if (cnt->imgs.preview_image.diffs) {
-                event(cnt, EVENT_IMAGE_PREVIEW, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
+                event(cnt, EVENT_IMAGE_PREVIEW, &cnt->imgs.preview_image, NULL, NULL, &cnt->current_image->timestamp_tv);
                 cnt->imgs.preview_image.diffs = 0;
             }
 
@@ -2708,6 +3182,56 @@ static void mlp_snapshot(struct context *cnt){
 
 }
 
+/*
+ * Whether the timelapse_mode period of the timelapse movie ended with the
+ * current frame.  The period ends on the first frame of the hour it ends at.
+ */
+static int mlp_timelapse_rollover(struct context *cnt, const struct tm *timestamp_tm){
+
+    /*
+     * We must use the seconds to prevent the timelapse file from getting
+     * reset multiple times during the minute.
+     */
+    if (timestamp_tm->tm_min != 0 ||
+        (cnt->time_current_frame % 60 >= cnt->time_last_frame % 60) ||
+        cnt->shots != 0) {
+        return FALSE;
+    }
+
+    if (strcasecmp(cnt->conf.timelapse_mode, "manual") == 0) {
+        return FALSE;
+
+    /* If we are daily, roll over at midnight */
+    } else if (strcasecmp(cnt->conf.timelapse_mode, "daily") == 0) {
+        return (timestamp_tm->tm_hour == 0);
+
+    /* handle the hourly case */
+    } else if (strcasecmp(cnt->conf.timelapse_mode, "hourly") == 0) {
+        return TRUE;
+
+    /* If we are weekly-sunday, roll over at midnight on sunday */
+    } else if (strcasecmp(cnt->conf.timelapse_mode, "weekly-sunday") == 0) {
+        return (timestamp_tm->tm_wday == 0 && timestamp_tm->tm_hour == 0);
+
+    /* If we are weekly-monday, roll over at midnight on monday */
+    } else if (strcasecmp(cnt->conf.timelapse_mode, "weekly-monday") == 0) {
+        return (timestamp_tm->tm_wday == 1 && timestamp_tm->tm_hour == 0);
+
+    /* If we are monthly, roll over at midnight on first day of month */
+    } else if (strcasecmp(cnt->conf.timelapse_mode, "monthly") == 0) {
+        return (timestamp_tm->tm_mday == 1 && timestamp_tm->tm_hour == 0);
+    }
+
+    /* If invalid we report in syslog once and continue in manual mode */
+    MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+        ,_("Invalid timelapse_mode argument '%s'"), cnt->conf.timelapse_mode);
+    MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+        ,_("%:s Defaulting to manual timelapse mode"));
+    conf_cmdparse(&cnt, (char *)"ffmpeg_timelapse_mode",(char *)"manual");
+
+    return FALSE;
+}
+
 static void mlp_timelapse(struct context *cnt){
 
     struct tm timestamp_tm;
@@ -2716,49 +3240,12 @@ static void mlp_timelapse(struct context *cnt){
         localtime_r(&cnt->current_image->timestamp_tv.tv_sec, &timestamp_tm);
 
         /*
-         * Check to see if we should start a new timelapse file. We start one when
-         * we are on the first shot, and and the seconds are zero. We must use the seconds
-         * to prevent the timelapse file from getting reset multiple times during the minute.
+         * Close the timelapse movie when its period is over.  The timelapse
+         * file is held open and buffered between frames, so this is where it
+         * gets written out and a frame of the new period starts a new file.
          */
-        if (timestamp_tm.tm_min == 0 &&
-            (cnt->time_current_frame % 60 < cnt->time_last_frame % 60) &&
-            cnt->shots == 0) {
-
-            if (strcasecmp(cnt->conf.timelapse_mode, "manual") == 0) {
-                ;/* No action */
-
-            /* If we are daily, raise timelapseend event at midnight */
-            } else if (strcasecmp(cnt->conf.timelapse_mode, "daily") == 0) {
-                if (timestamp_tm.tm_hour == 0)
-                    event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
-
-            /* handle the hourly case */
-            } else if (strcasecmp(cnt->conf.timelapse_mode, "hourly") == 0) {
-                event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
-
-            /* If we are weekly-sunday, raise timelapseend event at midnight on sunday */
-            } else if (strcasecmp(cnt->conf.timelapse_mode, "weekly-sunday") == 0) {
-                if (timestamp_tm.tm_wday == 0 &&
-                    timestamp_tm.tm_hour == 0)
-                    event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
-            /* If we are weekly-monday, raise timelapseend event at midnight on monday */
-            } else if (strcasecmp(cnt->conf.timelapse_mode, "weekly-monday") == 0) {
-                if (timestamp_tm.tm_wday == 1 &&
-                    timestamp_tm.tm_hour == 0)
-                    event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
-            /* If we are monthly, raise timelapseend event at midnight on first day of month */
-            } else if (strcasecmp(cnt->conf.timelapse_mode, "monthly") == 0) {
-                if (timestamp_tm.tm_mday == 1 &&
-                    timestamp_tm.tm_hour == 0)
-                    event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
-            /* If invalid we report in syslog once and continue in manual mode */
-            } else {
-                MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
-                    ,_("Invalid timelapse_mode argument '%s'"), cnt->conf.timelapse_mode);
-                MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
-                    ,_("%:s Defaulting to manual timelapse mode"));
-                conf_cmdparse(&cnt, (char *)"ffmpeg_timelapse_mode",(char *)"manual");
-            }
+        if (mlp_timelapse_rollover(cnt, &timestamp_tm)) {
+            event(cnt, EVENT_TIMELAPSEEND, NULL, NULL, NULL, &cnt->current_image->timestamp_tv);
         }
 
         /*
@@ -2784,6 +3271,18 @@ static void mlp_timelapse(struct context *cnt){
 
 }
 
+static void mlp_segment(struct context *cnt){
+    /*
+     * Feed the frame to the continuous recording.  Once the recording is
+     * turned off one more frame is sent for the output worker to close it.
+     */
+    if ((cnt->conf.movie_segment_time > 0) || (cnt->segment_running)) {
+        cnt->segment_running = (cnt->conf.movie_segment_time > 0);
+        event(cnt, EVENT_SEGMENT_PUT, cnt->current_image, NULL, NULL,
+            &cnt->current_image->timestamp_tv);
+    }
+}
+
 static void mlp_loopback(struct context *cnt){
     /*
      * Feed last image and motion image to video device pipes and the stream clients
@@ -2820,6 +3319,11 @@ static void mlp_parmsupdate(struct context *cnt){
 
     init_text_scale(cnt);  /* Initialize and validate text_scale */
 
+    cnt->overlay_picture = overlay_items(cnt->conf.picture_overlay);
+    cnt->overlay_movie = overlay_items(cnt->conf.movie_overlay);
+    cnt->overlay_stream = overlay_items(cnt->conf.stream_overlay);
+    cnt->overlay_video_pipe = overlay_items(cnt->conf.video_pipe_overlay);
+
     if (strcasecmp(cnt->conf.picture_output, "on") == 0)
         cnt->new_img = NEWIMG_ON;
     else if (strcasecmp(cnt->conf.picture_output, "first") == 0)
@@ -2885,6 +3389,98 @@ static void mlp_parmsupdate(struct context *cnt){
 
 }
 
+static void mlp_idle_timing(struct context *cnt, int framerate){
+    /* Preset the timing history with the new rate so the loop does not try to catch up */
+    int indx;
+
+    cnt->passflag = 0;
+    for (indx = 0; indx < cnt->rolling_average_limit; indx++)
+        cnt->rolling_average_data[indx] = 1000000L / framerate;
+
+}
+
+static int mlp_idle_streams(struct context *cnt){
+    /* Whether any stream of the camera has a client.  Every camera is drawn
+     * in the mosaic, so its clients count for all of them.
+     */
+    int indx;
+
+    if ((cnt->stream_norm.cnct_count > 0) || (cnt->stream_motion.cnct_count > 0) ||
+        (cnt->stream_source.cnct_count > 0) || (cnt->stream_mpegts.cnct_count > 0)) return TRUE;
+
+    for (indx = 0; indx < cnt->stream_scaled_count; indx++) {
+        if (cnt->stream_scaled[indx].stream.cnct_count > 0) return TRUE;
+    }
+
+    return mosaic_watched();
+}
+
+static void mlp_idle(struct context *cnt){
+
+    int idle_threshold;
+
+    /***** MOTION LOOP - IDLE FRAMERATE SECTION *****/
+    /*
+     * After idle_delay seconds without anything moving the camera drops to
+     * idle_framerate.  The first frame with more changed pixels than the
+     * idle threshold brings it back to the full framerate right away, so
+     * the minimum_motion_frames are counted at the normal rate.
+     * The capture itself is only slowed down when the pre_capture frames
+     * can still be filled, i.e. without pre_capture or when the packets of
+     * a passthrough camera are kept anyway.  Otherwise only the detection
+     * runs at the idle rate.  The frames of a continuous recording without
+     * passthrough are the captured ones, so it keeps the capture at the
+     * full rate as well.
+     */
+    if (cnt->conf.idle_framerate <= 0 ||
+        cnt->conf.idle_framerate >= cnt->conf.framerate) {
+        cnt->idle = FALSE;
+        return;
+    }
+
+    idle_threshold = cnt->conf.idle_threshold;
+    if (idle_threshold <= 0)
+        idle_threshold = cnt->threshold / 2;
+
+    if ((cnt->event_nr == cnt->prev_event) || cnt->detecting_motion || cnt->postcap ||
+        cnt->conf.setup_mode || cnt->conf.emulate_motion || cnt->event_user ||
+        (cnt->process_thisframe && (cnt->current_image->diffs > idle_threshold)) ||
+        mlp_idle_streams(cnt)) {
+        cnt->idle_lasttime = cnt->currenttime;
+    }
+
+    if (cnt->idle) {
+        if (cnt->idle_lasttime == cnt->currenttime) {
+            cnt->idle = FALSE;
+            cnt->idle_rampup = TRUE;
+            cnt->lastrate = cnt->conf.framerate;
+            if (cnt->idle_slowloop)
+                mlp_idle_timing(cnt, cnt->conf.framerate);
+            MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+                ,_("Returning to %d fps"), cnt->conf.framerate);
+        } else if (cnt->idle_slowloop && cnt->segment_running && !util_check_passthrough(cnt)) {
+            /* The continuous recording was started while idle */
+            cnt->idle_slowloop = FALSE;
+            cnt->lastrate = cnt->conf.framerate;
+            mlp_idle_timing(cnt, cnt->conf.framerate);
+            MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+                ,_("Recording, capturing at %d fps"), cnt->conf.framerate);
+        }
+    } else if ((cnt->currenttime - cnt->idle_lasttime) >= cnt->conf.idle_delay) {
+        cnt->idle = TRUE;
+        cnt->idle_slowloop = (util_check_passthrough(cnt) ||
+            ((cnt->conf.pre_capture == 0) && (!cnt->segment_running)));
+        if (cnt->idle_slowloop)
+            mlp_idle_timing(cnt, cnt->conf.idle_framerate);
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+            ,_("Nothing moved for %d seconds, %s at %d fps")
+            ,cnt->conf.idle_delay
+            ,(cnt->idle_slowloop ? _("capturing") : _("detecting"))
+            ,cnt->conf.idle_framerate);
+    }
+
+}
+
 static void mlp_frametiming(struct context *cnt){
 
     int indx;
@@ -2897,7 +3493,9 @@ static void mlp_frametiming(struct context *cnt){
      * Work out expected frame rate based on config setting which may
      * have changed from http-control
      */
-    if (cnt->conf.framerate)
+    if (cnt->idle && cnt->idle_slowloop)
+        cnt->required_frame_time = 1000000L / cnt->conf.idle_framerate;
+    else if (cnt->conf.framerate)
         cnt->required_frame_time = 1000000L / cnt->conf.framerate;
     else
         cnt->required_frame_time = 0;
@@ -2965,6 +3563,7 @@ static void *motion_loop(void *arg)
                 mlp_detection(cnt);
                 mlp_tuning(cnt);
                 mlp_overlay(cnt);
+                mlp_segment(cnt);
                 mlp_actions(cnt);
                 mlp_setupmode(cnt);
             }
@@ -2972,6 +3571,7 @@ static void *motion_loop(void *arg)
             mlp_timelapse(cnt);
             mlp_loopback(cnt);
             mlp_parmsupdate(cnt);
+            mlp_idle(cnt);
             mlp_frametiming(cnt);
         }
     }
@@ -3097,6 +3697,8 @@ static void become_daemon(void)
 }
 
 static void cntlist_create(int argc, char *argv[]){
+    int indx;
+
     /*
      * cnt_list is an array of pointers to the context structures cnt for each thread.
      * First we reserve room for a pointer to thread 0's context structure
@@ -3126,6 +3728,15 @@ static void cntlist_create(int argc, char *argv[]){
     cnt_list[0]->conf.argv = argv;
     cnt_list[0]->conf.argc = argc;
     cnt_list = conf_load(cnt_list);
+
+    /*
+     * Web clients may still hold images of a stream after the camera thread
+     * stopped so the stream mutex lives as long as the context.
+     */
+    for (indx = 0; cnt_list[indx] != NULL; indx++) {
+        pthread_mutex_init(&cnt_list[indx]->mutex_stream, NULL);
+        pthread_cond_init(&cnt_list[indx]->cond_stream, NULL);
+    }
 }
 
 static void motion_shutdown(void){
@@ -3135,8 +3746,13 @@ static void motion_shutdown(void){
 
     webu_stop(cnt_list);
 
-    while (cnt_list[++i])
+    mosaic_stop(cnt_list);
+
+    while (cnt_list[++i]) {
+        pthread_cond_destroy(&cnt_list[i]->cond_stream);
+        pthread_mutex_destroy(&cnt_list[i]->mutex_stream);
         context_destroy(cnt_list[i]);
+    }
 
     free(cnt_list);
     cnt_list = NULL;
@@ -3345,6 +3961,8 @@ static void motion_startup(int daemonize, int argc, char *argv[])
 
     initialize_chars();
 
+    mosaic_start(cnt_list);
+
     webu_start(cnt_list);
 
     vid_mutex_init();
@@ -3653,6 +4271,8 @@ int main (int argc, char **argv)
     do {
         if (restart) motion_restart(argc, argv);
 
+        outpool_start(cnt_list);
+
         for (i = cnt_list[1] != NULL ? 1 : 0; cnt_list[i]; i++) {
             cnt_list[i]->threadnr = i ? i : 1;
             motion_start_thread(cnt_list[i]);
@@ -3679,6 +4299,8 @@ int main (int argc, char **argv)
         /* Reset end main loop flag */
         finish = 0;
 
+        outpool_stop();
+
         MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO, _("Threads finished"));
 
         /* Rest for a while if we're supposed to restart. */
@@ -3735,6 +4357,35 @@ void * mymalloc(size_t nbytes)
     return dummy;
 }
 
+/**
+ * mymemalign
+ *
+ *   Allocates zeroed memory starting on a multiple of alignment, which must
+ *   be a power of two multiple of sizeof(void *).  Released with free().
+ *   Exits like mymalloc when there is no memory.
+ *
+ * Parameters:
+ *
+ *   alignment - required alignment of the memory
+ *   nbytes    - no. of bytes to allocate
+ *
+ * Returns: a pointer to the allocated memory
+ */
+void * mymemalign(size_t alignment, size_t nbytes)
+{
+    void *dummy;
+
+    if (posix_memalign(&dummy, alignment, nbytes) != 0) {
+        MOTION_LOG(EMG, TYPE_ALL, NO_ERRNO, _("Could not allocate %llu bytes of memory!")
+            ,(unsigned long long)nbytes);
+        motion_remove_pid();
+        exit(1);
+    }
+    memset(dummy, 0, nbytes);
+
+    return dummy;
+}
+
 /**
  * myrealloc
  *
@@ -3783,41 +4434,62 @@ void *myrealloc(void *ptr, size_t size, const char *desc)
  *      /this/is/an/example/
  *   Warning: a path *must* end with a slash!
  *
+ *   The deepest directory is tried first and the walk only goes up while
+ *   the parent is missing, so a new directory below existing ones costs a
+ *   single mkdir rather than one per component of the path.
+ *
  * Parameters:
  *
- *   cnt  - current thread's context structure (for logging)
  *   path - the path to create
  *
  * Returns: 0 on success, -1 on failure
  */
 int create_path(const char *path)
 {
-    char *start;
+    char *buffer, *end;
+    int depth;
     mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
 
-    if (path[0] == '/')
-        start = strchr(path + 1, '/');
-    else
-        start = strchr(path, '/');
+    buffer = mystrdup(path);
 
-    while (start) {
-        char *buffer = mystrdup(path);
-        buffer[start-path] = 0x00;
+    /* Everything after the last slash is not a directory */
+    end = strrchr(buffer, '/');
+    if ((end == NULL) || (end == buffer)) {
+        free(buffer);
+        return 0;
+    }
+    *end = 0x00;
+
+    /* Go up until a directory can be made or is already there */
+    depth = 0;
+    while (mkdir(buffer, mode) == -1) {
+        if (errno == EEXIST) break;
+        end = strrchr(buffer, '/');
+        if ((errno != ENOENT) || (end == NULL) || (end == buffer)) {
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                ,_("Problem creating directory %s"), buffer);
+            free(buffer);
+            return -1;
+        }
+        *end = 0x00;
+        depth++;
+    }
 
+    /* and come back down making the missing ones */
+    while (depth > 0) {
+        buffer[strlen(buffer)] = '/';
         if (mkdir(buffer, mode) == -1 && errno != EEXIST) {
             MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
                 ,_("Problem creating directory %s"), buffer);
             free(buffer);
             return -1;
         }
+        depth--;
+    }
 
-        start = strchr(start + 1, '/');
-
-        if (!start)
-            MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO, _("creating directory %s"), buffer);
+    MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO, _("creating directory %s"), buffer);
 
-        free(buffer);
-    }
+    free(buffer);
 
     return 0;
 }
@@ -3977,9 +4649,15 @@ size_t mystrftime(const struct context *cnt, char *s, size_t max, const char *us
     const char *pos_userformat;
     int width;
     struct tm timestamp_tm;
+    const struct image_data *img_data;
+    const char *text_event;
 
     localtime_r(&tv1->tv_sec, &timestamp_tm);
 
+    /* Output workers use the image and event of the job they are running */
+    img_data = outpool_image(cnt);
+    text_event = outpool_event_text(cnt);
+
     format = formatstring;
 
     /* if mystrftime is called with userformat = NULL we return a zero length string */
@@ -4011,16 +4689,16 @@ size_t mystrftime(const struct context *cnt, char *s, size_t max, const char *us
                 break;
 
             case 'v': // event
-                sprintf(tempstr, "%0*d", width ? width : 2, cnt->event_nr);
+                sprintf(tempstr, "%0*d", width ? width : 2, outpool_event_nr(cnt));
                 break;
 
             case 'q': // shots
                 sprintf(tempstr, "%0*d", width ? width : 2,
-                    cnt->current_image->shot);
+                    img_data->shot);
                 break;
 
             case 'D': // diffs
-                sprintf(tempstr, "%*d", width, cnt->current_image->diffs);
+                sprintf(tempstr, "%*d", width, img_data->diffs);
                 break;
 
             case 'N': // noise
@@ -4029,20 +4707,20 @@ size_t mystrftime(const struct context *cnt, char *s, size_t max, const char *us
 
             case 'i': // motion width
                 sprintf(tempstr, "%*d", width,
-                    cnt->current_image->location.width);
+                    img_data->location.width);
                 break;
 
             case 'J': // motion height
                 sprintf(tempstr, "%*d", width,
-                    cnt->current_image->location.height);
+                    img_data->location.height);
                 break;
 
             case 'K': // motion center x
-                sprintf(tempstr, "%*d", width, cnt->current_image->location.x);
+                sprintf(tempstr, "%*d", width, img_data->location.x);
                 break;
 
             case 'L': // motion center y
-                sprintf(tempstr, "%*d", width, cnt->current_image->location.y);
+                sprintf(tempstr, "%*d", width, img_data->location.y);
                 break;
 
             case 'o': // threshold
@@ -4051,7 +4729,7 @@ size_t mystrftime(const struct context *cnt, char *s, size_t max, const char *us
 
             case 'Q': // number of labels
                 sprintf(tempstr, "%*d", width,
-                    cnt->current_image->total_labels);
+                    img_data->total_labels);
                 break;
 
             case 't': // camera id
@@ -4059,9 +4737,9 @@ size_t mystrftime(const struct context *cnt, char *s, size_t max, const char *us
                 break;
 
             case 'C': // text_event
-                if (cnt->text_event_string[0])
+                if (text_event[0])
                     snprintf(tempstr, PATH_MAX, "%*s", width,
-                        cnt->text_event_string);
+                        text_event);
                 else
                     ++pos_userformat;
                 break;
@@ -65,6 +65,12 @@ struct image_data;
 #include "netcam.h"
 #include "netcam_rtsp.h"
 #include "ffmpeg.h"
+#include "arena.h"
+#include "overlay.h"
+#include "outpool.h"
+#include "mosaic.h"
+#include "segment.h"
+#include "extpipe.h"
 
 #ifdef HAVE_MMAL
 #include "mmalcam.h"
@@ -175,6 +181,7 @@ struct image_data;
 
 #define LOCATE_NORMAL     1
 #define LOCATE_BOTH       2
+#define LOCATE_MOTION     3  /* Only the motion image */
 
 #define UPDATE_REF_FRAME  1
 #define RESET_REF_FRAME   2
@@ -228,10 +235,23 @@ struct vdev_context {
     int update_parms;                           /*Bool for whether to update the parameters on the device*/
 };
 
+/*
+ * JPEG copy of a pre_capture ring image.  While an image waits in the ring
+ * only this copy is kept and the pixels are restored if the image is output.
+ */
+struct image_packed {
+    unsigned char *data;            /* Normal image followed by the high resolution image */
+    int alloc;                      /* Bytes allocated for data */
+    int size_norm;                  /* Bytes of the normal image, 0 when not packed */
+    int size_high;                  /* Bytes of the high resolution image */
+    struct image_overlay overlay;   /* Overlay items recorded for the image */
+};
 
 struct image_data {
     unsigned char *image_norm;
     unsigned char *image_high;
+    struct image_buffer *buffer;    /* Storage of the pixels when shared with the output workers */
+    struct image_packed *packed;    /* Compressed copy of a ring image, see image_ring_pack */
     int diffs;
     int64_t        idnbr_norm;
     int64_t        idnbr_high;
@@ -252,10 +272,66 @@ struct image_data {
 
 };
 
+/*
+ * JPEG image published to the clients of a stream.  The stream holds one
+ * reference to its latest image and every client sending it holds another,
+ * so a new image can be compressed and swapped in while clients still send
+ * the previous one.  The multipart header and terminator are written around
+ * the JPEG when it is published and the clients send the part straight from
+ * this buffer.  The reference count is protected by mutex_stream.
+ */
+struct stream_jpeg {
+    unsigned char   *part;      /* Multipart header, jpg and terminator */
+    long            part_size;  /* The number of bytes of the part */
+    unsigned char   *data;      /* Image compressed as JPG, inside part */
+    long            size;       /* The number of bytes for jpg */
+    long            alloc;      /* Room for jpg after data */
+    int             refcnt;
+};
+
+/*
+ * Piece of the MPEG-TS stream written by the muxer for one frame.  The stream
+ * keeps the chunks from its latest key frame on, so a new client starts at a
+ * key frame and then follows the chunks by number.  Clients sending a chunk
+ * hold a reference to it.  The reference count is protected by mutex_stream.
+ */
+struct stream_chunk {
+    unsigned char   *data;
+    long            size;       /* The number of bytes written */
+    long            alloc;      /* Room at data */
+    unsigned int    seq;        /* Number of the chunk in the stream */
+    int             iskey;      /* Chunk starts with a key frame */
+    int             refcnt;
+    struct stream_chunk *next;  /* Next chunk kept by the stream */
+};
+
 struct stream_data {
-    unsigned char   *jpeg_data; /* Image compressed as JPG */
-    long            jpeg_size;  /* The number of bytes for jpg */
+    struct stream_jpeg *jpeg;   /* Latest image of the stream */
+    unsigned int    seq;        /* Number of the latest image, see cond_stream */
+    struct webui_ctx *waiting;  /* Suspended clients waiting for the next image */
+    struct stream_jpeg *spare;  /* Released image reused for the next one */
     int             cnct_count; /* Counter of the number of connections */
+    struct stream_chunk *head;  /* MPEG-TS stream: header sent first to each client */
+    struct stream_chunk *first; /* MPEG-TS stream: oldest chunk kept */
+    struct stream_chunk *build; /* MPEG-TS stream: chunk the muxer is writing */
+    long            kept;       /* MPEG-TS stream: bytes of the chunks kept */
+};
+
+/* Maximum number of substream sizes, see stream_sizes */
+#define STREAM_SCALED_MAX   4
+
+/*
+ * Substream of one of the stream_sizes.  The sizes are sorted from the
+ * largest down so the image of a size is made before the smaller sizes
+ * scaled from it.  Only used by the motion thread apart from the stream.
+ */
+struct stream_scaled {
+    int             width;
+    int             height;
+    int             source;     /* Size twice as big it is scaled from or -1 for the image */
+    int             needed;     /* Image is made for the current frame */
+    unsigned char   *image;     /* Scaled image of the current frame */
+    struct stream_data stream;
 };
 
 /*
@@ -302,12 +378,16 @@ struct images {
     int *ref_dyn;                     /* Dynamic objects to be excluded from reference frame */
     struct image_data image_virgin;   /* Last picture frame with no text or locate overlay */
     struct image_data image_vprvcy;   /* Virgin image with the privacy mask applied */
+    unsigned char *virgin_norm;       /* Own pixels of image_virgin when it cannot use the ring image */
+    unsigned char *vprvcy_norm;       /* Own pixels of image_vprvcy when it cannot use the ring image */
+    struct image_arena arena;         /* Memory of the images and detection buffers */
+    struct image_pool image_pool;     /* Storage of the ring images */
+    unsigned char *packed_work;       /* Compression buffer for the ring images */
     struct image_data preview_image;  /* Picture buffer for best image when enables */
     unsigned char *mask;              /* Buffer for the mask file */
     unsigned char *smartmask;
     unsigned char *smartmask_final;
     unsigned char *common_buffer;
-    unsigned char *substream_image;
 
     unsigned char *mask_privacy;      /* Buffer for the privacy mask values */
     unsigned char *mask_privacy_uv;   /* Buffer for the privacy U&V values */
@@ -364,6 +444,7 @@ struct rotdata {
 struct context {
     FILE *extpipe;
     int extpipe_open;
+    struct extpipe_writer *extpipe_writer;  /* Thread writing the frames to extpipe */
     char conf_filename[PATH_MAX];
     int from_conf_dir;
     int threadnr;
@@ -395,6 +476,10 @@ struct context {
 
     int locate_motion_mode;
     int locate_motion_style;
+    int overlay_picture;                     /* OVERLAY_* items drawn on pictures */
+    int overlay_movie;                       /* OVERLAY_* items drawn on movies */
+    int overlay_stream;                      /* OVERLAY_* items drawn on the stream */
+    int overlay_video_pipe;                  /* OVERLAY_* items drawn on the video loopback */
     int process_thisframe;
     struct rotdata rotate_data;              /* rotation data is thread-specific */
 
@@ -478,10 +563,15 @@ struct context {
     struct ffmpeg   *ffmpeg_output;
     struct ffmpeg   *ffmpeg_output_motion;
     struct ffmpeg   *ffmpeg_timelapse;
+    struct ffmpeg   *ffmpeg_stream;     /* Muxer of the movie stream, open while it has clients */
+    time_t          ffmpeg_stream_fail; /* When the muxer of the movie stream last failed to open */
+    struct segment_recorder *segment;   /* Continuous recording, used by the output workers */
+    int             segment_running;    /* Frames are sent to the continuous recording */
     int             movie_passthrough;
 
     char timelapsefilename[PATH_MAX];
     char motionfilename[PATH_MAX];
+    char streamfilename[PATH_MAX];
 
     int area_minx[9], area_miny[9], area_maxx[9], area_maxy[9];
     int areadetect_eventnbr;
@@ -489,6 +579,10 @@ struct context {
     unsigned long long int timenow, timebefore;
 
     unsigned int rate_limit;
+    int idle;                                /* Running at the idle_framerate */
+    int idle_slowloop;                       /* The idle rate also slows down the capture */
+    int idle_rampup;                         /* Returned to full rate during the current second */
+    time_t idle_lasttime;                    /* Last time something moved above the idle threshold */
     time_t lastframetime;
     int minimum_frame_time_downcounter;
     unsigned int get_image;    /* Flag used to signal that we capture new image when we run the loop */
@@ -513,17 +607,23 @@ struct context {
 
     struct MHD_Daemon   *webcontrol_daemon;
     struct MHD_Daemon   *webstream_daemon;
+    int                 webstream_suspend;  /* Stream clients are suspended while waiting for images */
     char                webcontrol_digest_rand[8];
     char                webstream_digest_rand[8];
     int                 camera_id;
 
     pthread_mutex_t     mutex_stream;
+    pthread_cond_t      cond_stream;    /* Signalled when a stream image is published */
 
     struct stream_data  stream_norm;    /* Copy of the image to use for web stream*/
-    struct stream_data  stream_sub;     /* Copy of the image to use for web stream*/
+    struct stream_scaled stream_scaled[STREAM_SCALED_MAX];  /* Substreams of stream_sizes */
+    int                 stream_scaled_count;
     struct stream_data  stream_motion;  /* Copy of the image to use for web stream*/
     struct stream_data  stream_source;  /* Copy of the image to use for web stream*/
+    struct stream_data  stream_mpegts;  /* Chunks of the MPEG-TS stream */
+    struct stream_data  stream_mosaic;  /* Grid of all cameras, only used on the main context */
 
+    struct outpool_queue outq;          /* Output jobs waiting for the output workers */
 
 };
 
@@ -536,6 +636,7 @@ extern pthread_key_t tls_key_threadnr; /* key for thread number */
 
 int http_bindsock(int, int, int);
 void * mymalloc(size_t);
+void * mymemalign(size_t, size_t);
 void * myrealloc(void *, size_t, const char *);
 FILE * myfopen(const char *, const char *);
 int myfclose(FILE *);
@@ -490,6 +490,9 @@ int netcam_proc_jpeg(netcam_context_ptr netcam,  struct image_data *img_data)
         retval |= NETCAM_JPEG_CONV_ERROR;
         MOTION_LOG(INF, TYPE_NETCAM, NO_ERRNO
             ,_("ret %d retval %d"), ret, retval);
+    } else {
+        overlay_set_source(netcam->cnt, img_data
+            , (unsigned char *)netcam->jpegbuf->ptr, netcam->jpegbuf->used);
     }
 
     return retval;
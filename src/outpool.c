@@ -0,0 +1,786 @@
+/*
+ *    outpool.c
+ *
+ *    Pool of output workers for Motion
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    The events that write pictures and movies are queued per camera and
+ *    run by a small pool of worker threads shared by all cameras.  Only one
+ *    worker runs the jobs of a given camera at a time so movie frames stay
+ *    in order while different cameras are written in parallel.  Ring images
+ *    are handed over by reference rather than copied.
+ *
+ *    Functional naming scheme
+ *    outpool_buffer*   - Reference counted image storage
+ *    outpool_job*      - Creation and running of a single queued event
+ *    outpool_*         - Pool control and accessors used by the handlers
+ */
+
+#include "motion.h"
+#include "translate.h"
+#include "event.h"
+
+struct outpool_job {
+    struct outpool_job  *next;
+    struct context      *cnt;
+    motion_event         type;
+
+    struct image_data   *img_arg;       /* Image passed to the handlers */
+    struct image_data   *image;         /* Image used for the format specifiers */
+    struct image_data    img;           /* Storage for a queued image */
+    struct image_data    imgm;          /* Storage for the motion image */
+    char                *filename;
+    void                *eventdata;
+    struct timeval      *tv_arg;
+    struct timeval       tv;
+
+    int                  event_nr;
+    const char          *text_event;
+    char                *text_event_copy;
+    struct timeval       queued_tv;
+};
+
+static pthread_mutex_t  outpool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   outpool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t   outpool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t    outpool_key;
+static int              outpool_key_ready = FALSE;
+
+static struct context  *outpool_ready_head = NULL;
+static struct context  *outpool_ready_tail = NULL;
+static pthread_t       *outpool_threads = NULL;
+static int              outpool_nthreads = 0;
+static int              outpool_depth_limit = 0;
+static int              outpool_finish = FALSE;
+
+void outpool_pool_init(struct image_pool *pool, struct image_arena *arena
+            , int size_norm, int size_high){
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->spare = NULL;
+    pool->heap_count = 0;
+    pool->render_count = 0;
+    pool->arena = arena;
+    pool->size_norm = size_norm;
+    pool->size_high = size_high;
+
+}
+
+static void outpool_buffer_free(struct image_buffer *buffer){
+
+    arena_free(buffer->pool->arena, buffer->image_norm);
+    arena_free(buffer->pool->arena, buffer->image_high);
+    overlay_free(&buffer->overlay);
+    pthread_mutex_destroy(&buffer->mutex);
+    pthread_mutex_destroy(&buffer->overlay_mutex);
+    free(buffer);
+
+}
+
+void outpool_pool_deinit(struct image_pool *pool){
+    /* All buffers of the pool must have been released by now */
+    struct image_buffer *buffer;
+
+    while (pool->spare != NULL) {
+        buffer = pool->spare;
+        pool->spare = buffer->next;
+        outpool_buffer_free(buffer);
+    }
+    pool->heap_count = 0;
+    while (pool->render_count > 0) {
+        free(pool->render_spare[--pool->render_count]);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+
+}
+
+struct image_buffer *outpool_buffer_new(struct image_pool *pool){
+    /* Take image storage from the pool holding a single reference for the caller */
+    struct image_buffer *buffer;
+
+    pthread_mutex_lock(&pool->mutex);
+        buffer = pool->spare;
+        if (buffer != NULL) {
+            pool->spare = buffer->next;
+            if (buffer->heap) pool->heap_count--;
+        }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (buffer == NULL) {
+        buffer = mymalloc(sizeof(struct image_buffer));
+        pthread_mutex_init(&buffer->mutex, NULL);
+        pthread_mutex_init(&buffer->overlay_mutex, NULL);
+        buffer->pool = pool;
+        buffer->image_norm = arena_alloc(pool->arena, pool->size_norm);
+        if (pool->size_high > 0) buffer->image_high = arena_alloc(pool->arena, pool->size_high);
+        buffer->heap = (!arena_contains(pool->arena, buffer->image_norm)) ||
+            ((buffer->image_high != NULL) && (!arena_contains(pool->arena, buffer->image_high)));
+    } else {
+        overlay_reset(&buffer->overlay);
+    }
+    buffer->refcnt = 1;
+    buffer->next = NULL;
+
+    return buffer;
+}
+
+void outpool_buffer_ref(struct image_buffer *buffer){
+
+    pthread_mutex_lock(&buffer->mutex);
+        buffer->refcnt++;
+    pthread_mutex_unlock(&buffer->mutex);
+
+}
+
+void outpool_buffer_unref(struct image_buffer *buffer){
+    /* Buffers of the arena are always kept.  Those taken from the heap while
+     * frames were queued are only kept up to OUTPOOL_HEAP_SPARE so the memory
+     * of a long event is returned once the queue drains.
+     */
+    struct image_pool *pool;
+    int refcnt, keep;
+
+    if (buffer == NULL) return;
+
+    pthread_mutex_lock(&buffer->mutex);
+        refcnt = --buffer->refcnt;
+    pthread_mutex_unlock(&buffer->mutex);
+
+    if (refcnt > 0) return;
+
+    overlay_release(buffer);
+
+    pool = buffer->pool;
+    pthread_mutex_lock(&pool->mutex);
+        keep = (!buffer->heap) || (pool->heap_count < OUTPOOL_HEAP_SPARE);
+        if (keep) {
+            if (buffer->heap) pool->heap_count++;
+            buffer->next = pool->spare;
+            pool->spare = buffer;
+        }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (!keep) outpool_buffer_free(buffer);
+
+}
+
+void outpool_image_claim(struct context *cnt, struct image_data *img){
+    /* Called before the motion thread writes a new frame into a ring slot.
+     * When a queued job still references the pixels of the slot, the slot
+     * gets other storage and the old one is released by the last job using it.
+     */
+    int shared;
+
+    /* Slots released by image_ring_pack get new storage */
+    if (img->buffer == NULL) {
+        img->buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+        img->image_norm = img->buffer->image_norm;
+        img->image_high = img->buffer->image_high;
+        return;
+    }
+
+    pthread_mutex_lock(&img->buffer->mutex);
+        shared = (img->buffer->refcnt > 1);
+    pthread_mutex_unlock(&img->buffer->mutex);
+
+    if (!shared) {
+        overlay_reset(&img->buffer->overlay);
+        overlay_release(img->buffer);
+        return;
+    }
+
+    outpool_buffer_unref(img->buffer);
+    img->buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+    img->image_norm = img->buffer->image_norm;
+    img->image_high = img->buffer->image_high;
+
+}
+
+void outpool_image_private(struct context *cnt, struct image_data *img){
+    /* Called before the motion thread draws into a ring image it already
+     * handed to the outputs.  When a job still references the pixels, the
+     * slot gets a copy of its own to draw on.
+     */
+    struct image_data copy;
+    int shared;
+
+    if (img->buffer == NULL) return;
+
+    pthread_mutex_lock(&img->buffer->mutex);
+        shared = (img->buffer->refcnt > 1);
+    pthread_mutex_unlock(&img->buffer->mutex);
+
+    if (!shared) return;
+
+    memcpy(&copy, img, sizeof(struct image_data));
+    copy.buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+    copy.image_norm = copy.buffer->image_norm;
+    copy.image_high = copy.buffer->image_high;
+    memcpy(copy.image_norm, img->image_norm, cnt->imgs.size_norm);
+    if ((cnt->imgs.size_high > 0) && (img->image_high != NULL)) {
+        memcpy(copy.image_high, img->image_high, cnt->imgs.size_high);
+    }
+    overlay_copy(&copy, img);
+
+    outpool_buffer_unref(img->buffer);
+    img->buffer = copy.buffer;
+    img->image_norm = copy.image_norm;
+    img->image_high = copy.image_high;
+
+}
+
+unsigned char *outpool_render_new(struct image_pool *pool){
+    /* Storage for a render of the overlays of a normal size image */
+    unsigned char *render;
+
+    render = NULL;
+    pthread_mutex_lock(&pool->mutex);
+        if (pool->render_count > 0) render = pool->render_spare[--pool->render_count];
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (render == NULL) render = mymalloc(pool->size_norm);
+
+    return render;
+}
+
+void outpool_render_free(struct image_pool *pool, unsigned char *render){
+    /* Keep a few renders for the next frames, the others go back to the heap */
+
+    pthread_mutex_lock(&pool->mutex);
+        if (pool->render_count < OUTPOOL_RENDER_SPARE) {
+            pool->render_spare[pool->render_count++] = render;
+            render = NULL;
+        }
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(render);
+
+}
+
+static void outpool_key_create(void){
+
+    pthread_key_create(&outpool_key, NULL);
+    outpool_key_ready = TRUE;
+
+}
+
+static struct outpool_job *outpool_job_current(const struct context *cnt){
+    /* Return the job being run by this thread for the camera */
+    struct outpool_job *job;
+
+    if (!outpool_key_ready) return NULL;
+
+    job = pthread_getspecific(outpool_key);
+    if ((job != NULL) && (job->cnt == cnt)) return job;
+
+    return NULL;
+}
+
+struct image_data *outpool_image(const struct context *cnt){
+    /* Image of the event being processed.  Handlers run on a worker
+     * while the motion thread has already moved on to other frames
+     * so the format specifiers must use the image of the job.
+     */
+    struct outpool_job *job;
+
+    job = outpool_job_current(cnt);
+    if ((job != NULL) && (job->image != NULL)) return job->image;
+
+    return cnt->current_image;
+}
+
+int outpool_event_nr(const struct context *cnt){
+
+    struct outpool_job *job;
+
+    job = outpool_job_current(cnt);
+    if (job != NULL) return job->event_nr;
+
+    return cnt->event_nr;
+}
+
+const char *outpool_event_text(const struct context *cnt){
+
+    struct outpool_job *job;
+
+    job = outpool_job_current(cnt);
+    if (job != NULL) return job->text_event;
+
+    return cnt->text_event_string;
+}
+
+static int outpool_job_deferred(motion_event type){
+    /* Events run on the output workers */
+    switch (type) {
+    case EVENT_FIRSTMOTION:
+    case EVENT_ENDMOTION:
+    case EVENT_TIMELAPSE:
+    case EVENT_TIMELAPSEEND:
+    case EVENT_IMAGE_DETECTED:
+    case EVENT_IMAGEM_DETECTED:
+    case EVENT_IMAGE_SNAPSHOT:
+    case EVENT_IMAGE_PREVIEW:
+    case EVENT_FFMPEG_PUT:
+    case EVENT_SEGMENT_PUT:
+    case EVENT_FFMPEG_RESUME:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static int outpool_job_pixels(motion_event type){
+    /* Events whose handlers use the pixels of the image */
+    switch (type) {
+    case EVENT_TIMELAPSE:
+    case EVENT_IMAGE_DETECTED:
+    case EVENT_IMAGEM_DETECTED:
+    case EVENT_IMAGE_SNAPSHOT:
+    case EVENT_IMAGE_PREVIEW:
+    case EVENT_FFMPEG_PUT:
+    case EVENT_SEGMENT_PUT:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static int outpool_job_droppable(motion_event type){
+    /* Frames may be dropped when the queue is full.  Events that open
+     * or close files must always run and the frames of the continuous
+     * recording have their own limit, see outpool_segment_full.
+     */
+    switch (type) {
+    case EVENT_TIMELAPSE:
+    case EVENT_IMAGE_DETECTED:
+    case EVENT_IMAGEM_DETECTED:
+    case EVENT_IMAGE_SNAPSHOT:
+    case EVENT_FFMPEG_PUT:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static void outpool_job_image(struct context *cnt, struct image_data *dst
+        , struct image_data *src, int pixels){
+    /* Keep the image of a queued job.  Ring images are referenced and
+     * any other image is copied when the handlers need its pixels.
+     */
+    memcpy(dst, src, sizeof(struct image_data));
+    dst->packed = NULL;
+
+    if (src->buffer != NULL) {
+        outpool_buffer_ref(src->buffer);
+    } else if (pixels) {
+        dst->buffer = outpool_buffer_new(&cnt->imgs.image_pool);
+        dst->image_norm = dst->buffer->image_norm;
+        dst->image_high = dst->buffer->image_high;
+        memcpy(dst->image_norm, src->image_norm, cnt->imgs.size_norm);
+        if ((cnt->imgs.size_high > 0) && (src->image_high != NULL)) {
+            memcpy(dst->image_high, src->image_high, cnt->imgs.size_high);
+        }
+    } else {
+        dst->image_norm = NULL;
+        dst->image_high = NULL;
+    }
+
+}
+
+static struct outpool_job *outpool_job_new(struct context *cnt, motion_event type
+        , struct image_data *img_data, char *filename, void *eventdata, struct timeval *tv1){
+
+    struct outpool_job *job;
+    int pixels;
+
+    pixels = outpool_job_pixels(type);
+
+    job = mymalloc(sizeof(struct outpool_job));
+    job->cnt = cnt;
+    job->type = type;
+    job->eventdata = eventdata;
+
+    if (img_data != NULL) {
+        outpool_job_image(cnt, &job->img, img_data, pixels);
+        job->img_arg = &job->img;
+        job->image = &job->img;
+    } else if (cnt->current_image != NULL) {
+        outpool_job_image(cnt, &job->img, cnt->current_image, FALSE);
+        job->image = &job->img;
+    }
+
+    /* The motion movie uses the motion image of the frame */
+    if (((type == EVENT_IMAGE_DETECTED) || (type == EVENT_FFMPEG_PUT)) &&
+        (cnt->conf.movie_output_motion)) {
+        outpool_job_image(cnt, &job->imgm, &cnt->imgs.img_motion, TRUE);
+        job->eventdata = &job->imgm;
+    }
+
+    if (filename != NULL) {
+        job->filename = mymalloc(strlen(filename) + 1);
+        strcpy(job->filename, filename);
+    }
+
+    if (tv1 != NULL) {
+        job->tv = *tv1;
+        job->tv_arg = &job->tv;
+    }
+
+    job->event_nr = cnt->event_nr;
+    job->text_event_copy = mymalloc(strlen(cnt->text_event_string) + 1);
+    strcpy(job->text_event_copy, cnt->text_event_string);
+    job->text_event = job->text_event_copy;
+
+    gettimeofday(&job->queued_tv, NULL);
+
+    return job;
+}
+
+static void outpool_job_free(struct outpool_job *job){
+
+    outpool_buffer_unref(job->img.buffer);
+    outpool_buffer_unref(job->imgm.buffer);
+    if (job->filename != NULL) free(job->filename);
+    if (job->text_event_copy != NULL) free(job->text_event_copy);
+    free(job);
+
+}
+
+static void outpool_job_run(struct outpool_job *job){
+
+    pthread_setspecific(outpool_key, job);
+        event_dispatch(job->cnt, job->type, job->img_arg
+            , job->filename, job->eventdata, job->tv_arg);
+    pthread_setspecific(outpool_key, NULL);
+
+}
+
+static void outpool_ready_push(struct context *cnt){
+    /* Put the camera at the end of the ready list.  Caller holds the pool mutex */
+
+    cnt->outq.ready = TRUE;
+    cnt->outq.ready_next = NULL;
+    if (outpool_ready_tail == NULL) {
+        outpool_ready_head = cnt;
+    } else {
+        outpool_ready_tail->outq.ready_next = cnt;
+    }
+    outpool_ready_tail = cnt;
+
+}
+
+static struct context *outpool_ready_pop(void){
+    /* Take the first camera from the ready list.  Caller holds the pool mutex */
+    struct context *cnt;
+
+    cnt = outpool_ready_head;
+    if (cnt == NULL) return NULL;
+
+    outpool_ready_head = cnt->outq.ready_next;
+    if (outpool_ready_head == NULL) outpool_ready_tail = NULL;
+    cnt->outq.ready_next = NULL;
+    cnt->outq.ready = FALSE;
+
+    return cnt;
+}
+
+void outpool_stats(struct context *cnt){
+    /* Report the queue statistics of the camera */
+    unsigned long cnt_jobs, cnt_drops, cnt_segment_drops, cnt_writes;
+    unsigned long long write_bytes;
+    long long latency_sum, write_sum;
+    long latency_max, write_max;
+    int depth_max;
+
+    if (outpool_nthreads == 0) return;
+
+    pthread_mutex_lock(&outpool_mutex);
+        cnt_jobs    = cnt->outq.cnt_jobs;
+        cnt_drops   = cnt->outq.cnt_drops;
+        cnt_segment_drops = cnt->outq.cnt_segment_drops;
+        depth_max   = cnt->outq.depth_max;
+        latency_sum = cnt->outq.latency_sum;
+        latency_max = cnt->outq.latency_max;
+        cnt_writes  = cnt->outq.cnt_writes;
+        write_bytes = cnt->outq.write_bytes;
+        write_sum   = cnt->outq.write_sum;
+        write_max   = cnt->outq.write_max;
+    pthread_mutex_unlock(&outpool_mutex);
+
+    if (cnt_jobs == 0) return;
+
+    MOTION_LOG(INF, TYPE_EVENTS, NO_ERRNO
+        ,_("Output queue: %lu jobs, max depth %d, latency avg %lld ms max %ld ms"
+           ", dropped %lu, recording frames dropped %lu")
+        ,cnt_jobs, depth_max, (latency_sum / cnt_jobs) / 1000
+        ,latency_max / 1000, cnt_drops, cnt_segment_drops);
+
+    if (cnt_writes == 0) return;
+
+    MOTION_LOG(INF, TYPE_EVENTS, NO_ERRNO
+        ,_("Picture files: %lu written, %llu kB, write avg %lld ms max %ld ms")
+        ,cnt_writes, write_bytes / 1024, (write_sum / cnt_writes) / 1000
+        ,write_max / 1000);
+
+}
+
+void outpool_write_done(struct context *cnt, int bytes, long usec){
+    /* Account a picture file written by the camera */
+
+    pthread_mutex_lock(&outpool_mutex);
+        cnt->outq.cnt_writes++;
+        cnt->outq.write_bytes += bytes;
+        cnt->outq.write_sum += usec;
+        if (usec > cnt->outq.write_max) cnt->outq.write_max = usec;
+    pthread_mutex_unlock(&outpool_mutex);
+
+}
+
+static void *outpool_handler(void *arg){
+    /* Worker thread: run the queued jobs of the cameras in turn */
+    struct context *cnt;
+    struct outpool_job *job;
+    struct timeval tv_now;
+    long latency;
+
+    util_threadname_set("op", (int)(unsigned long)arg, NULL);
+
+    pthread_mutex_lock(&outpool_mutex);
+    while (TRUE) {
+        while ((outpool_ready_head == NULL) && (!outpool_finish)) {
+            pthread_cond_wait(&outpool_cond, &outpool_mutex);
+        }
+
+        cnt = outpool_ready_pop();
+        if (cnt == NULL) break;
+
+        job = cnt->outq.head;
+        cnt->outq.head = job->next;
+        if (cnt->outq.head == NULL) cnt->outq.tail = NULL;
+        cnt->outq.depth--;
+        cnt->outq.busy = TRUE;
+        if (job->type == EVENT_SEGMENT_PUT) {
+            cnt->outq.depth_segment--;
+            pthread_cond_signal(&cnt->outq.cond_segment);
+        }
+
+        gettimeofday(&tv_now, NULL);
+        latency = (tv_now.tv_sec - job->queued_tv.tv_sec) * 1000000L +
+            (tv_now.tv_usec - job->queued_tv.tv_usec);
+        cnt->outq.cnt_jobs++;
+        cnt->outq.latency_sum += latency;
+        if (latency > cnt->outq.latency_max) cnt->outq.latency_max = latency;
+        pthread_mutex_unlock(&outpool_mutex);
+
+        pthread_setspecific(tls_key_threadnr, (void *)((unsigned long)cnt->threadnr));
+
+        outpool_job_run(job);
+        if (job->type == EVENT_ENDMOTION) outpool_stats(cnt);
+        outpool_job_free(job);
+
+        pthread_mutex_lock(&outpool_mutex);
+        cnt->outq.busy = FALSE;
+        if (cnt->outq.head != NULL) {
+            outpool_ready_push(cnt);
+        } else {
+            pthread_cond_broadcast(&cnt->outq.cond_idle);
+        }
+    }
+    pthread_mutex_unlock(&outpool_mutex);
+
+    MOTION_LOG(DBG, TYPE_EVENTS, NO_ERRNO, _("Output worker finished"));
+
+    return NULL;
+}
+
+static int outpool_segment_full(struct context *cnt){
+    /* The frames of the continuous recording are not dropped with the
+     * other images, the camera waits up to one frame for the workers to
+     * start one of them.  Only when they are still behind is the frame
+     * dropped.  With pass-through the next frame also writes the packets
+     * of the dropped one, or starts over at a key frame when they already
+     * left the packet buffer.  Returns TRUE when the frame is dropped.
+     */
+    struct timeval curtime;
+    struct timespec waittime;
+    long usec;
+    int full;
+
+    if (outpool_depth_limit <= 0) return FALSE;
+
+    pthread_mutex_lock(&outpool_mutex);
+        if (cnt->outq.depth_segment >= outpool_depth_limit) {
+            gettimeofday(&curtime, NULL);
+            usec = curtime.tv_usec + 1000000L / ((cnt->lastrate > 1) ? cnt->lastrate : 2);
+            waittime.tv_sec = curtime.tv_sec + (usec / 1000000L);
+            waittime.tv_nsec = 1000L * (usec % 1000000L);
+            pthread_cond_timedwait(&cnt->outq.cond_segment, &outpool_mutex, &waittime);
+        }
+        full = (cnt->outq.depth_segment >= outpool_depth_limit);
+        if (full) {
+            cnt->outq.cnt_segment_drops++;
+            if ((cnt->outq.cnt_segment_drops % 100) == 1) {
+                MOTION_LOG(WRN, TYPE_EVENTS, NO_ERRNO
+                    ,_("Output queue full, %lu frames of the recording dropped")
+                    ,cnt->outq.cnt_segment_drops);
+            }
+        }
+    pthread_mutex_unlock(&outpool_mutex);
+
+    return full;
+}
+
+int outpool_event(struct context *cnt, int type, struct image_data *img_data
+        , char *filename, void *eventdata, struct timeval *tv1){
+    /* Queue the event for the output workers.  Returns FALSE when the
+     * event is to be run directly by the caller.
+     */
+    struct outpool_job *job, jobinline;
+
+    if (!outpool_key_ready) return FALSE;
+
+    if (!outpool_job_deferred(type)) return FALSE;
+
+    /* Events raised from a handler of a job run directly */
+    if (pthread_getspecific(outpool_key) != NULL) return FALSE;
+
+    if (outpool_nthreads == 0) {
+        /* No workers: run the job in the calling thread without copies */
+        memset(&jobinline, 0, sizeof(struct outpool_job));
+        jobinline.cnt = cnt;
+        jobinline.type = type;
+        jobinline.img_arg = img_data;
+        jobinline.image = (img_data != NULL) ? img_data : cnt->current_image;
+        jobinline.filename = filename;
+        jobinline.eventdata = eventdata;
+        jobinline.tv_arg = tv1;
+        jobinline.event_nr = cnt->event_nr;
+        jobinline.text_event = cnt->text_event_string;
+        outpool_job_run(&jobinline);
+        return TRUE;
+    }
+
+    if ((type == EVENT_SEGMENT_PUT) && (outpool_segment_full(cnt))) return TRUE;
+
+    if (outpool_job_droppable(type)) {
+        pthread_mutex_lock(&outpool_mutex);
+            if ((outpool_depth_limit > 0) &&
+                ((cnt->outq.depth - cnt->outq.depth_segment) >= outpool_depth_limit)) {
+                cnt->outq.cnt_drops++;
+                if ((cnt->outq.cnt_drops % 100) == 1) {
+                    MOTION_LOG(WRN, TYPE_EVENTS, NO_ERRNO
+                        ,_("Output queue full, %lu images dropped")
+                        ,cnt->outq.cnt_drops);
+                }
+                pthread_mutex_unlock(&outpool_mutex);
+                return TRUE;
+            }
+        pthread_mutex_unlock(&outpool_mutex);
+    }
+
+    job = outpool_job_new(cnt, type, img_data, filename, eventdata, tv1);
+
+    pthread_mutex_lock(&outpool_mutex);
+        if (cnt->outq.tail == NULL) {
+            cnt->outq.head = job;
+        } else {
+            cnt->outq.tail->next = job;
+        }
+        cnt->outq.tail = job;
+        cnt->outq.depth++;
+        if (type == EVENT_SEGMENT_PUT) cnt->outq.depth_segment++;
+        if (cnt->outq.depth > cnt->outq.depth_max) cnt->outq.depth_max = cnt->outq.depth;
+
+        if ((!cnt->outq.busy) && (!cnt->outq.ready)) {
+            outpool_ready_push(cnt);
+            pthread_cond_signal(&outpool_cond);
+        }
+    pthread_mutex_unlock(&outpool_mutex);
+
+    return TRUE;
+}
+
+void outpool_flush(struct context *cnt){
+    /* Wait until all the queued jobs of the camera have been run */
+
+    if (outpool_nthreads == 0) return;
+
+    pthread_mutex_lock(&outpool_mutex);
+        while ((cnt->outq.head != NULL) || (cnt->outq.busy)) {
+            pthread_cond_wait(&cnt->outq.cond_idle, &outpool_mutex);
+        }
+    pthread_mutex_unlock(&outpool_mutex);
+
+}
+
+void outpool_start(struct context **cntlist){
+    /* Start the output workers.  Uses the parameters of the main context */
+    int indx, retcd;
+    pthread_attr_t attr;
+
+    pthread_once(&outpool_once, outpool_key_create);
+
+    for (indx = 0; cntlist[indx] != NULL; indx++) {
+        memset(&cntlist[indx]->outq, 0, sizeof(struct outpool_queue));
+        pthread_cond_init(&cntlist[indx]->outq.cond_idle, NULL);
+        pthread_cond_init(&cntlist[indx]->outq.cond_segment, NULL);
+    }
+
+    outpool_finish = FALSE;
+    outpool_depth_limit = cntlist[0]->conf.output_queue_depth;
+    outpool_nthreads = cntlist[0]->conf.output_workers;
+    if (outpool_nthreads <= 0) {
+        outpool_nthreads = 0;
+        MOTION_LOG(NTC, TYPE_EVENTS, NO_ERRNO
+            ,_("Output workers disabled, images written by the camera threads"));
+        return;
+    }
+
+    outpool_threads = mymalloc(sizeof(pthread_t) * outpool_nthreads);
+
+    pthread_attr_init(&attr);
+    for (indx = 0; indx < outpool_nthreads; indx++) {
+        retcd = pthread_create(&outpool_threads[indx], &attr
+            , &outpool_handler, (void *)((unsigned long)indx + 1));
+        if (retcd != 0) {
+            MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
+                ,_("Unable to start output worker %d"), indx + 1);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    if (indx == 0) {
+        free(outpool_threads);
+        outpool_threads = NULL;
+    }
+    outpool_nthreads = indx;
+
+    MOTION_LOG(NTC, TYPE_EVENTS, NO_ERRNO
+        ,_("Started %d output workers, queue depth %d")
+        ,outpool_nthreads, outpool_depth_limit);
+
+}
+
+void outpool_stop(void){
+    /* Let the workers finish the queued jobs and stop them */
+    int indx;
+
+    if (outpool_nthreads == 0) return;
+
+    pthread_mutex_lock(&outpool_mutex);
+        outpool_finish = TRUE;
+        pthread_cond_broadcast(&outpool_cond);
+    pthread_mutex_unlock(&outpool_mutex);
+
+    for (indx = 0; indx < outpool_nthreads; indx++) {
+        pthread_join(outpool_threads[indx], NULL);
+    }
+
+    free(outpool_threads);
+    outpool_threads = NULL;
+    outpool_nthreads = 0;
+
+}
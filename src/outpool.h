@@ -0,0 +1,107 @@
+/*
+ *    outpool.h
+ *
+ *    Include file for outpool.c
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ */
+#ifndef _INCLUDE_OUTPOOL_H_
+#define _INCLUDE_OUTPOOL_H_
+
+struct context;
+struct image_data;
+struct outpool_job;
+
+/*
+ * Pixel storage of a ring image.  The ring holds one reference and every
+ * queued output job holds another, so the motion thread can hand a frame to
+ * the output workers without copying it.
+ */
+struct image_buffer {
+    pthread_mutex_t     mutex;          /* Guards refcnt only, never held for long */
+    int                 refcnt;
+    unsigned char      *image_norm;
+    unsigned char      *image_high;
+    struct image_pool  *pool;           /* Pool the storage is returned to */
+    struct image_buffer *next;          /* Next spare buffer of the pool */
+    int                 heap;           /* Pixels are on the heap rather than in the arena */
+    pthread_mutex_t     overlay_mutex;  /* Guards overlay, held while drawing and compressing */
+    struct image_overlay overlay;       /* Text and graphics drawn on request */
+};
+
+/* Most renders of the overlays kept for reuse by a camera, see outpool_render_free */
+#define OUTPOOL_RENDER_SPARE    4
+
+/* Most buffers with pixels on the heap kept for reuse by a camera, see outpool_buffer_unref */
+#define OUTPOOL_HEAP_SPARE      4
+
+/*
+ * Per camera list of released image storage.  Buffers are sized once when
+ * the camera starts and recycled so the ring never goes back to the heap
+ * for storage of the same size.  Only a few of the buffers taken from the
+ * heap beyond the arena are kept, the others are freed when released.  The renders of the overlays are only
+ * attached to a buffer while its frame is in use and recycled the same way.
+ */
+struct image_pool {
+    pthread_mutex_t      mutex;
+    struct image_buffer *spare;
+    int                  heap_count;    /* Buffers in spare with pixels on the heap */
+    unsigned char       *render_spare[OUTPOOL_RENDER_SPARE];
+    int                  render_count;  /* Renders in render_spare */
+    struct image_arena  *arena;         /* Memory the pixels are taken from */
+    int                  size_norm;
+    int                  size_high;
+};
+
+/* Per camera queue of output jobs.  Protected by the pool mutex. */
+struct outpool_queue {
+    struct outpool_job *head;
+    struct outpool_job *tail;
+    struct context     *ready_next;     /* Next camera on the pool ready list */
+    int                 depth;          /* Jobs queued and not yet started */
+    int                 depth_segment;  /* Frames of the continuous recording in depth */
+    int                 busy;           /* A worker is running a job of this camera */
+    int                 ready;          /* Camera is on the pool ready list */
+    pthread_cond_t      cond_idle;
+    pthread_cond_t      cond_segment;   /* A frame of the continuous recording started */
+
+    /* Statistics */
+    unsigned long       cnt_jobs;
+    unsigned long       cnt_drops;
+    unsigned long       cnt_segment_drops;
+    int                 depth_max;
+    long long           latency_sum;    /* usec between queueing and start of job */
+    long                latency_max;
+    unsigned long       cnt_writes;     /* Picture files written */
+    unsigned long long  write_bytes;
+    long long           write_sum;      /* usec from opening to closing a picture file */
+    long                write_max;
+};
+
+void outpool_pool_init(struct image_pool *pool, struct image_arena *arena
+    , int size_norm, int size_high);
+void outpool_pool_deinit(struct image_pool *pool);
+struct image_buffer *outpool_buffer_new(struct image_pool *pool);
+void outpool_buffer_ref(struct image_buffer *buffer);
+void outpool_buffer_unref(struct image_buffer *buffer);
+void outpool_image_claim(struct context *cnt, struct image_data *img);
+void outpool_image_private(struct context *cnt, struct image_data *img);
+unsigned char *outpool_render_new(struct image_pool *pool);
+void outpool_render_free(struct image_pool *pool, unsigned char *render);
+
+void outpool_start(struct context **cntlist);
+void outpool_stop(void);
+void outpool_flush(struct context *cnt);
+void outpool_stats(struct context *cnt);
+void outpool_write_done(struct context *cnt, int bytes, long usec);
+
+int outpool_event(struct context *cnt, int type, struct image_data *img_data
+    , char *filename, void *eventdata, struct timeval *tv1);
+
+struct image_data *outpool_image(const struct context *cnt);
+int outpool_event_nr(const struct context *cnt);
+const char *outpool_event_text(const struct context *cnt);
+
+#endif /* _INCLUDE_OUTPOOL_H_ */
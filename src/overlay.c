@@ -0,0 +1,445 @@
+/*
+ *    overlay.c
+ *
+ *    Rendering of the text and locate overlays for Motion
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    The ring images are kept free of text and graphics.  While processing
+ *    a frame the motion thread only records the overlay items that belong
+ *    on it.  The stream, the pictures, the movies and the video loopback
+ *    each ask for the items they are configured for and get an image with
+ *    those drawn, so a frame that is never output is never drawn on and a
+ *    set of items used by several outputs is drawn once.
+ *
+ *    The JPEG images of a frame are kept the same way.  The streams, the
+ *    pictures and the snapshots ask for the frame with their items, size and
+ *    quality and an image asked for by several of them is compressed once.
+ *    With picture_passthrough the JPEG an MJPEG camera sent for the frame
+ *    is kept and handed out whenever no items are to be drawn on it.
+ */
+
+#include "motion.h"
+#include "alg.h"
+#include "picture.h"
+#include "jpegutils.h"
+
+int overlay_items(const char *setting){
+    /* Convert a comma separated list of overlay names to OVERLAY_* items */
+    char tmp[PATH_MAX];
+    char *token, *saveptr;
+    int items;
+
+    if ((setting == NULL) || (strcasecmp(setting, "all") == 0)) return OVERLAY_ALL;
+
+    snprintf(tmp, sizeof(tmp), "%s", setting);
+
+    items = 0;
+    token = strtok_r(tmp, ", ", &saveptr);
+    while (token != NULL) {
+        if (strcasecmp(token, "all") == 0)
+            items |= OVERLAY_ALL;
+        else if (strcasecmp(token, "text_changes") == 0)
+            items |= OVERLAY_TEXT_CHANGES;
+        else if (strcasecmp(token, "text_left") == 0)
+            items |= OVERLAY_TEXT_LEFT;
+        else if (strcasecmp(token, "text_right") == 0)
+            items |= OVERLAY_TEXT_RIGHT;
+        else if (strcasecmp(token, "locate") == 0)
+            items |= OVERLAY_LOCATE;
+        token = strtok_r(NULL, ", ", &saveptr);
+    }
+
+    return items;
+}
+
+void overlay_set_text(struct image_data *img, int item, const char *text){
+    /* Record one of the text items for the frame */
+    struct image_overlay *overlay;
+
+    if (img->buffer == NULL) return;
+    overlay = &img->buffer->overlay;
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        if (item == OVERLAY_TEXT_CHANGES) {
+            snprintf(overlay->text_changes, sizeof(overlay->text_changes), "%s", text);
+        } else if (item == OVERLAY_TEXT_LEFT) {
+            free(overlay->text_left);
+            overlay->text_left = mystrdup(text);
+        } else if (item == OVERLAY_TEXT_RIGHT) {
+            free(overlay->text_right);
+            overlay->text_right = mystrdup(text);
+        }
+        overlay->items |= item;
+        overlay->rendered = 0;
+        overlay->jpeg_count = 0;
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+}
+
+void overlay_set_locate(struct image_data *img){
+    /* The locate graphics use the location stored with the image */
+
+    if (img->buffer == NULL) return;
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        img->buffer->overlay.items |= OVERLAY_LOCATE;
+        img->buffer->overlay.rendered = 0;
+        img->buffer->overlay.jpeg_count = 0;
+        img->buffer->overlay.source_len = 0;
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+}
+
+static void overlay_copy_items(struct image_overlay *dst, struct image_overlay *src){
+    /* dst must have been reset */
+
+    dst->items = src->items;
+    if (src->text_left != NULL)
+        dst->text_left = mystrdup(src->text_left);
+    if (src->text_right != NULL)
+        dst->text_right = mystrdup(src->text_right);
+    memcpy(dst->text_changes, src->text_changes, sizeof(src->text_changes));
+
+}
+
+void overlay_copy(struct image_data *dst, struct image_data *src){
+    /* Give the image copied into dst the overlay items of src */
+
+    if ((dst->buffer == NULL) || (src->buffer == NULL)) return;
+
+    overlay_reset(&dst->buffer->overlay);
+
+    pthread_mutex_lock(&src->buffer->overlay_mutex);
+        overlay_copy_items(&dst->buffer->overlay, &src->buffer->overlay);
+    pthread_mutex_unlock(&src->buffer->overlay_mutex);
+
+}
+
+void overlay_save(struct image_overlay *saved, struct image_data *img){
+    /* Keep the overlay items of an image whose storage is about to be released */
+
+    overlay_reset(saved);
+    if (img->buffer == NULL) return;
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        overlay_copy_items(saved, &img->buffer->overlay);
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+}
+
+void overlay_restore(struct image_data *img, struct image_overlay *saved){
+    /* Give new storage of an image the overlay items kept by overlay_save */
+
+    if (img->buffer == NULL) return;
+
+    overlay_reset(&img->buffer->overlay);
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        overlay_copy_items(&img->buffer->overlay, saved);
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+}
+
+void overlay_changed(struct image_data *img){
+    /* The pixels of the image were altered so the renders are out of date */
+
+    if (img->buffer == NULL) return;
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        img->buffer->overlay.rendered = 0;
+        img->buffer->overlay.jpeg_count = 0;
+        img->buffer->overlay.source_len = 0;
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+}
+
+void overlay_reset(struct image_overlay *overlay){
+    /* Forget the items of the previous frame.  Renders are released by overlay_release. */
+
+    free(overlay->text_left);
+    overlay->text_left = NULL;
+    free(overlay->text_right);
+    overlay->text_right = NULL;
+    overlay->text_changes[0] = '\0';
+    overlay->items = 0;
+    overlay->rendered = 0;
+    overlay->jpeg_count = 0;
+    overlay->source_len = 0;
+
+}
+
+void overlay_free(struct image_overlay *overlay){
+    int indx;
+
+    overlay_reset(overlay);
+    for (indx = 0; indx <= OVERLAY_ALL; indx++) {
+        free(overlay->render[indx]);
+        overlay->render[indx] = NULL;
+    }
+    for (indx = 0; indx < OVERLAY_JPEG_MAX; indx++) {
+        free(overlay->jpeg[indx].data);
+        overlay->jpeg[indx].data = NULL;
+        overlay->jpeg[indx].alloc = 0;
+    }
+    free(overlay->source);
+    overlay->source = NULL;
+    overlay->source_alloc = 0;
+
+}
+
+void overlay_release(struct image_buffer *buffer){
+    /*
+     * Give the renders back to the pool of the camera once no output uses
+     * the frame, so a buffer only holds them while its frame is output.
+     * Called by the only holder of the buffer.
+     */
+    struct image_overlay *overlay = &buffer->overlay;
+    int indx;
+
+    for (indx = 0; indx <= OVERLAY_ALL; indx++) {
+        if (overlay->render[indx] == NULL) continue;
+        outpool_render_free(buffer->pool, overlay->render[indx]);
+        overlay->render[indx] = NULL;
+    }
+    overlay->rendered = 0;
+
+}
+
+void overlay_set_source(struct context *cnt, struct image_data *img, const unsigned char *jpeg, int jpeg_len){
+    /*
+     * Keep the JPEG the camera sent for the frame so outputs wanting the
+     * frame without items can pass it on as is.  It is not kept when the
+     * frame is rotated, flipped or privacy masked since the pixels then
+     * differ from the JPEG.
+     */
+    struct image_overlay *overlay;
+
+    if (!cnt->conf.picture_passthrough || (img->buffer == NULL)) return;
+    if ((cnt->rotate_data.degrees != 0) || (cnt->rotate_data.axis != FLIP_TYPE_NONE)) return;
+    if (cnt->imgs.mask_privacy != NULL) return;
+
+    overlay = &img->buffer->overlay;
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        if (overlay->source_alloc < jpeg_len + JPGUTL_DHT_SIZE) {
+            overlay->source_alloc = jpeg_len + JPGUTL_DHT_SIZE;
+            overlay->source = myrealloc(overlay->source, overlay->source_alloc, "overlay_set_source");
+        }
+        overlay->source_len = jpgutl_copy_jpeg(overlay->source, overlay->source_alloc, jpeg, jpeg_len);
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+}
+
+static void overlay_draw(struct context *cnt, struct image_data *img
+            , struct image_overlay *overlay, unsigned char *image, int items){
+    /* Same positions and order as the overlays were always drawn in */
+    int width = cnt->imgs.width;
+    int height = cnt->imgs.height;
+
+    if (items & OVERLAY_TEXT_CHANGES) {
+        draw_text(image, width, height, width - 10, 10
+            , overlay->text_changes, cnt->text_scale);
+    }
+
+    if ((items & OVERLAY_TEXT_LEFT) && (overlay->text_left != NULL)) {
+        draw_text(image, width, height, 10, height - (10 * cnt->text_scale)
+            , overlay->text_left, cnt->text_scale);
+    }
+
+    if ((items & OVERLAY_TEXT_RIGHT) && (overlay->text_right != NULL)) {
+        draw_text(image, width, height, width - 10, height - (10 * cnt->text_scale)
+            , overlay->text_right, cnt->text_scale);
+    }
+
+    if (items & OVERLAY_LOCATE) {
+        if ((cnt->locate_motion_style == LOCATE_REDBOX) ||
+            (cnt->locate_motion_style == LOCATE_REDCROSS)) {
+            alg_draw_red_location(&img->location, &cnt->imgs, width, image
+                , cnt->locate_motion_style, LOCATE_NORMAL, 0);
+        } else {
+            alg_draw_location(&img->location, &cnt->imgs, width, image
+                , cnt->locate_motion_style, LOCATE_NORMAL, 0);
+        }
+    }
+
+}
+
+static unsigned char *overlay_render(struct context *cnt, struct image_data *img, int items){
+    /* Called with the overlay mutex of the buffer held */
+    struct image_overlay *overlay = &img->buffer->overlay;
+
+    items &= overlay->items;
+    if (items == 0) return img->image_norm;
+
+    if (!(overlay->rendered & (1 << items))) {
+        if (overlay->render[items] == NULL)
+            overlay->render[items] = outpool_render_new(img->buffer->pool);
+        memcpy(overlay->render[items], img->image_norm, cnt->imgs.size_norm);
+        overlay_draw(cnt, img, overlay, overlay->render[items], items);
+        overlay->rendered |= (1 << items);
+    }
+
+    return overlay->render[items];
+}
+
+/**
+ * overlay_image
+ *
+ *   Returns the pixels of an image with the requested overlay items drawn on
+ *   them.  Items that were not recorded for the frame are ignored and when
+ *   nothing is left to draw the image itself is returned.  The result stays
+ *   valid as long as the caller holds the image.
+ *
+ * Parameters:
+ *
+ *      cnt      Pointer to the motion context structure
+ *      img      The image
+ *      items    OVERLAY_* items wanted by the output
+ *
+ * Returns:     pointer to the normal size pixels to output
+ */
+unsigned char *overlay_image(struct context *cnt, struct image_data *img, int items){
+
+    unsigned char *image;
+
+    if ((img->buffer == NULL) || (img->image_norm == NULL)) return img->image_norm;
+
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        image = overlay_render(cnt, img, items);
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+    return image;
+}
+
+static int overlay_jpeg_encode(struct context *cnt, unsigned char *dest, int dest_size
+            , unsigned char *image, int width, int height, int quality, int grey
+            , struct timeval *tv, struct coord *box){
+
+    if (grey) {
+        return jpgutl_put_grey(dest, dest_size, image, width, height, quality, cnt, tv, box);
+    } else {
+        return jpgutl_put_yuv420p(dest, dest_size, image, width, height, quality, cnt, tv, box);
+    }
+
+}
+
+static int overlay_jpeg_image(struct context *cnt, unsigned char *image, unsigned char *image_high
+            , int size, int quality, int grey, int exif, unsigned char *dest, int dest_size
+            , struct timeval *tv, struct coord *box){
+    /* Compress the image as requested into dest */
+    struct context *cnt_exif;
+
+    /* Without a context the encoder leaves out the EXIF data */
+    cnt_exif = (exif ? cnt : NULL);
+
+    if (size == OVERLAY_JPEG_HIGH) {
+        return overlay_jpeg_encode(cnt_exif, dest, dest_size, image_high
+            , cnt->imgs.width_high, cnt->imgs.height_high, quality, grey, tv, box);
+    }
+
+    return overlay_jpeg_encode(cnt_exif, dest, dest_size, image
+        , cnt->imgs.width, cnt->imgs.height, quality, grey, tv, box);
+}
+
+/**
+ * overlay_jpeg
+ *
+ *   Puts a JPEG image of a frame with the requested overlay items into dest.
+ *   The first output asking for a combination of items, size and quality
+ *   compresses the frame and the others get a copy of the same JPEG until
+ *   the frame changes.  Images that are not ring images are compressed on
+ *   every call.  The EXIF data of a kept JPEG uses the time and location
+ *   of the frame.  JPEG images for streams leave the EXIF data out and may
+ *   be given a kept JPEG that has it, but not the other way around.
+ *
+ * Parameters:
+ *
+ *      cnt        Pointer to the motion context structure
+ *      img        The image
+ *      items      OVERLAY_* items wanted by the output
+ *      size       OVERLAY_JPEG_* size of the JPEG
+ *      quality    JPEG quality
+ *      grey       Compress only the luminance
+ *      exif       Put the EXIF data in the JPEG
+ *      dest       Memory receiving the JPEG
+ *      dest_size  Bytes available in dest, at least the size of the raw image
+ *
+ * Returns:     number of bytes put in dest
+ */
+int overlay_jpeg(struct context *cnt, struct image_data *img, int items, int size
+            , int quality, int grey, int exif, unsigned char *dest, int dest_size){
+
+    struct image_overlay *overlay;
+    struct overlay_jpeg *jpeg, oldest;
+    int indx, len;
+
+    if (size == OVERLAY_JPEG_HIGH) items = 0;
+
+    if ((img->buffer == NULL) || (img->image_norm == NULL)) {
+        return overlay_jpeg_image(cnt, img->image_norm, img->image_high, size, quality, grey
+            , exif, dest, dest_size, NULL, NULL);
+    }
+    overlay = &img->buffer->overlay;
+
+    /*
+     * The frame is compressed with the overlay mutex held so outputs asking
+     * for the same JPEG at the same time wait for it rather than compress it
+     * again.  The reference count has its own mutex so queueing the frame or
+     * claiming the ring slot does not wait for the compression.
+     */
+    pthread_mutex_lock(&img->buffer->overlay_mutex);
+        items &= overlay->items;
+
+        /* Nothing to draw on the frame so the JPEG of the camera will do */
+        if ((items == 0) && (size == OVERLAY_JPEG_NORM) && !grey &&
+            (overlay->source_len > 0) && (overlay->source_len <= dest_size)) {
+            memcpy(dest, overlay->source, overlay->source_len);
+            len = overlay->source_len;
+            pthread_mutex_unlock(&img->buffer->overlay_mutex);
+            return len;
+        }
+
+        for (indx = 0; indx < overlay->jpeg_count; indx++) {
+            jpeg = &overlay->jpeg[indx];
+            if ((jpeg->items == items) && (jpeg->size == size) &&
+                (jpeg->quality == quality) && (jpeg->grey == grey) &&
+                (jpeg->exif || !exif) && (jpeg->len <= dest_size)) {
+                memcpy(dest, jpeg->data, jpeg->len);
+                len = jpeg->len;
+                pthread_mutex_unlock(&img->buffer->overlay_mutex);
+                return len;
+            }
+        }
+
+        len = overlay_jpeg_image(cnt, overlay_render(cnt, img, items), img->image_high
+            , size, quality, grey, exif, dest, dest_size, &img->timestamp_tv, &img->location);
+
+        if (len > 0) {
+            if (overlay->jpeg_count < OVERLAY_JPEG_MAX) {
+                jpeg = &overlay->jpeg[overlay->jpeg_count++];
+            } else {
+                /* Reuse the storage of the oldest */
+                oldest = overlay->jpeg[0];
+                memmove(&overlay->jpeg[0], &overlay->jpeg[1]
+                    , (OVERLAY_JPEG_MAX - 1) * sizeof(struct overlay_jpeg));
+                overlay->jpeg[OVERLAY_JPEG_MAX - 1] = oldest;
+                jpeg = &overlay->jpeg[OVERLAY_JPEG_MAX - 1];
+            }
+            if (jpeg->alloc < len) {
+                jpeg->data = myrealloc(jpeg->data, len, "overlay_jpeg");
+                jpeg->alloc = len;
+            }
+            memcpy(jpeg->data, dest, len);
+            jpeg->len = len;
+            jpeg->items = items;
+            jpeg->size = size;
+            jpeg->quality = quality;
+            jpeg->grey = grey;
+            jpeg->exif = exif;
+        }
+    pthread_mutex_unlock(&img->buffer->overlay_mutex);
+
+    return len;
+}
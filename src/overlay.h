@@ -0,0 +1,78 @@
+/*
+ *    overlay.h
+ *
+ *    Include file for overlay.c
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ */
+#ifndef _INCLUDE_OVERLAY_H_
+#define _INCLUDE_OVERLAY_H_
+
+struct context;
+struct image_data;
+struct image_buffer;
+
+/* Items that can be drawn over the captured images */
+#define OVERLAY_TEXT_CHANGES    1
+#define OVERLAY_TEXT_LEFT       2
+#define OVERLAY_TEXT_RIGHT      4
+#define OVERLAY_LOCATE          8
+#define OVERLAY_ALL             (OVERLAY_TEXT_CHANGES | OVERLAY_TEXT_LEFT | OVERLAY_TEXT_RIGHT | OVERLAY_LOCATE)
+
+/* Sizes of the JPEG images kept for a frame */
+#define OVERLAY_JPEG_NORM       0
+#define OVERLAY_JPEG_HIGH       1       /* High resolution image, never has overlay items */
+#define OVERLAY_JPEG_MAX        4       /* Number of JPEG images kept per frame */
+
+/* JPEG image of a frame and what it was compressed with */
+struct overlay_jpeg {
+    int                 items;
+    int                 size;
+    int                 quality;
+    int                 grey;
+    int                 exif;
+    unsigned char      *data;
+    int                 alloc;
+    int                 len;
+};
+
+/*
+ * Overlay of a ring image.  The motion thread records what belongs on the
+ * frame and each output draws the items it is configured for when it uses
+ * the frame.  Rendered images are kept per set of items so outputs wanting
+ * the same set share a single render and outputs wanting the same JPEG share
+ * a single compression.  Protected by the overlay_mutex of the image_buffer,
+ * its mutex only guards the reference count.
+ */
+struct image_overlay {
+    int                 items;                      /* OVERLAY_* items recorded for the frame */
+    char               *text_left;
+    char               *text_right;
+    char                text_changes[16];
+    unsigned char      *render[OVERLAY_ALL + 1];    /* Rendered image for each set of items */
+    int                 rendered;                   /* Bit per set of items with a valid render */
+    struct overlay_jpeg jpeg[OVERLAY_JPEG_MAX];     /* JPEG images compressed from the frame */
+    int                 jpeg_count;                 /* Valid entries of jpeg, oldest first */
+    unsigned char      *source;                     /* JPEG of the camera the frame was decoded from */
+    int                 source_alloc;
+    int                 source_len;                 /* 0 when there is no JPEG of the camera */
+};
+
+int overlay_items(const char *setting);
+void overlay_set_text(struct image_data *img, int item, const char *text);
+void overlay_set_locate(struct image_data *img);
+void overlay_copy(struct image_data *dst, struct image_data *src);
+void overlay_save(struct image_overlay *saved, struct image_data *img);
+void overlay_restore(struct image_data *img, struct image_overlay *saved);
+void overlay_changed(struct image_data *img);
+void overlay_reset(struct image_overlay *overlay);
+void overlay_free(struct image_overlay *overlay);
+void overlay_release(struct image_buffer *buffer);
+void overlay_set_source(struct context *cnt, struct image_data *img, const unsigned char *jpeg, int jpeg_len);
+unsigned char *overlay_image(struct context *cnt, struct image_data *img, int items);
+int overlay_jpeg(struct context *cnt, struct image_data *img, int items, int size
+    , int quality, int grey, int exif, unsigned char *dest, int dest_size);
+
+#endif /* _INCLUDE_OVERLAY_H_ */
@@ -15,6 +15,12 @@
 
 #include <assert.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #ifdef HAVE_WEBP
 #include <webp/encode.h>
 #include <webp/mux.h>
@@ -54,6 +60,8 @@
 #define TIFF_TYPE_UNDEF  7  /* Byte blob */
 #define TIFF_TYPE_SSHORT 8  /* Signed 16-bit int */
 
+#define PPM_HEADER_MAX   32 /* Room for the header of a PPM picture */
+
 static const char exif_marker_start[14] = {
     'E', 'x', 'i', 'f', 0, 0,   /* EXIF marker signature */
     'M', 'M', 0, 42,            /* TIFF file header (big-endian) */
@@ -343,6 +351,70 @@ unsigned prepare_exif(unsigned char **exif,
     return marker_len;
 }
 
+/**
+ * put_picture_write
+ *      Writes an encoded picture to a file.  The whole picture is written
+ *      with a single write and the directory of the file is only created
+ *      when opening the file reports it missing.  The time taken is added
+ *      to the output statistics of the camera.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int put_picture_write(struct context *cnt, const char *file
+            , const unsigned char *buf, int len)
+{
+    int fd, retcd, done;
+    ssize_t written;
+    struct timeval tv_start, tv_end;
+
+    gettimeofday(&tv_start, NULL);
+
+    fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if ((fd == -1) && (errno == ENOENT) && (create_path(file) == 0)) {
+        fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    if (fd == -1) {
+        /* Report to syslog - suggest solution if the problem is access rights to target dir. */
+        if (errno ==  EACCES) {
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                ,_("Can't write picture to file %s - check access rights to target directory\n"
+                "Thread is going to finish due to this fatal error"), file);
+            cnt->finish = 1;
+            cnt->restart = 0;
+        } else {
+            /* If target dir is temporarily unavailable we may survive. */
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                ,_("Can't write picture to file %s"), file);
+        }
+        return -1;
+    }
+
+    retcd = 0;
+    done = 0;
+    while (done < len) {
+        written = write(fd, buf + done, len - done);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                ,_("Can't write picture to file %s"), file);
+            retcd = -1;
+            break;
+        }
+        done += written;
+    }
+
+    if (close(fd) == -1) {
+        MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO, _("Error closing file %s"), file);
+        retcd = -1;
+    }
+
+    gettimeofday(&tv_end, NULL);
+    outpool_write_done(cnt, done, (tv_end.tv_sec - tv_start.tv_sec) * 1000000L +
+        (tv_end.tv_usec - tv_start.tv_usec));
+
+    return retcd;
+}
+
 
 #ifdef HAVE_WEBP
 /*
@@ -380,21 +452,23 @@ static void put_webp_exif(WebPMux* webp_mux,
 /**
  * put_webp_yuv420p_file
  *      Converts an YUV420P coded image to a webp image and writes
- *      it to an already open file.
+ *      it to a file.
  *
  * Inputs:
+ * - file is the name of the file to write
  * - image is the image in YUV420P format.
  * - width and height are the dimensions of the image
  * - quality is the webp encoding quality 0-100%
+ * - method is the webp compression method, 0 (fastest) to 6 (smallest)
  *
  * Output:
- * - The webp is written directly to the file given by the file pointer fp
+ * - The webp is encoded in memory and written to the file in one go
  *
  * Returns nothing
  */
-static void put_webp_yuv420p_file(FILE *fp,
+static void put_webp_yuv420p_file(const char *file,
                   unsigned char *image, int width, int height,
-                  int quality, struct context *cnt, struct timeval *tv1, struct coord *box)
+                  int quality, int method, struct context *cnt, struct timeval *tv1, struct coord *box)
 {
     /* Create a config present and check for compatible library version */
     WebPConfig webp_config;
@@ -402,6 +476,9 @@ static void put_webp_yuv420p_file(FILE *fp,
         MOTION_LOG(ERR, TYPE_CORE, NO_ERRNO, _("libwebp version error"));
         return;
     }
+    if (method < 0) method = 0;
+    if (method > 6) method = 6;
+    webp_config.method = method;
 
     /* Create the input data structure and check for compatible library version */
     WebPPicture webp_image;
@@ -410,18 +487,19 @@ static void put_webp_yuv420p_file(FILE *fp,
         return;
     }
 
-    /* Allocate the image buffer based on image width and height */
+    /*
+     * Let the picture view the Y, U and V planes of the input YUV420P buffer
+     * rather than allocating planes of its own for them
+     */
+    webp_image.use_argb = 0;
+    webp_image.colorspace = WEBP_YUV420;
     webp_image.width = width;
     webp_image.height = height;
-    if (!WebPPictureAlloc(&webp_image)){
-        MOTION_LOG(ERR, TYPE_CORE, NO_ERRNO,_("libwebp image buffer allocation error"));
-        return;
-    }
-
-    /* Map the input YUV420P buffer as individual Y, U and V pointers */
     webp_image.y = image;
     webp_image.u = image + width * height;
     webp_image.v = webp_image.u + (width * height) / 4;
+    webp_image.y_stride = width;
+    webp_image.uv_stride = width / 2;
 
     /* Setup the memory writting method */
     WebPMemoryWriter webp_writer;
@@ -430,29 +508,39 @@ static void put_webp_yuv420p_file(FILE *fp,
     webp_image.custom_ptr = (void*) &webp_writer;
 
     /* Encode the YUV image as webp */
-    if (!WebPEncode(&webp_config, &webp_image))
-        MOTION_LOG(WRN, TYPE_CORE, NO_ERRNO,_("libwebp image compression error"));
-
-    /* A bitstream object is needed for the muxing proces */
-    WebPData webp_bitstream;
-    webp_bitstream.bytes = webp_writer.mem;
-    webp_bitstream.size = webp_writer.size;
-
-    /* Create a mux from the prepared image data */
-    WebPMux* webp_mux = WebPMuxCreate(&webp_bitstream, 1);
-    put_webp_exif(webp_mux, cnt, tv1, box);
+    if (WebPEncode(&webp_config, &webp_image)) {
+        /* A bitstream object is needed for the muxing proces */
+        WebPData webp_bitstream;
+        webp_bitstream.bytes = webp_writer.mem;
+        webp_bitstream.size = webp_writer.size;
+
+        /* Create a mux from the prepared image data, which outlives it so it is not copied */
+        WebPMux* webp_mux = WebPMuxCreate(&webp_bitstream, 0);
+        if (webp_mux != NULL) {
+            put_webp_exif(webp_mux, cnt, tv1, box);
+
+            /* Add Exif data to the webp image data */
+            WebPData webp_output;
+            WebPDataInit(&webp_output);
+            WebPMuxError err = WebPMuxAssemble(webp_mux, &webp_output);
+            if (err != WEBP_MUX_OK) {
+                MOTION_LOG(ERR, TYPE_CORE, NO_ERRNO,_("unable to assemble webp image"));
+            } else {
+                /* Write the webp final bitstream to the file */
+                put_picture_write(cnt, file, webp_output.bytes, (int)webp_output.size);
+            }
 
-    /* Add Exif data to the webp image data */
-    WebPData webp_output;
-    WebPMuxError err = WebPMuxAssemble(webp_mux, &webp_output);
-    if (err != WEBP_MUX_OK) {
-        MOTION_LOG(ERR, TYPE_CORE, NO_ERRNO,_("unable to assemble webp image"));
+            /* free the memory used by webp mux object */
+            WebPMuxDelete(webp_mux);
+            /* free the memory used by webp for output data */
+            WebPDataClear(&webp_output);
+        } else {
+            MOTION_LOG(ERR, TYPE_CORE, NO_ERRNO,_("unable to assemble webp image"));
+        }
+    } else {
+        MOTION_LOG(WRN, TYPE_CORE, NO_ERRNO,_("libwebp image compression error"));
     }
 
-    /* Write the webp final bitstream to the file */
-    if (fwrite(webp_output.bytes, sizeof(uint8_t), webp_output.size, fp) != webp_output.size)
-        MOTION_LOG(ERR, TYPE_CORE, NO_ERRNO,_("unable to save webp image to file"));
-
 #if WEBP_ENCODER_ABI_VERSION > 0x0202
     /* writer.mem must be freed by calling WebPMemoryWriterClear */
     WebPMemoryWriterClear(&webp_writer);
@@ -461,106 +549,41 @@ static void put_webp_yuv420p_file(FILE *fp,
     free(webp_writer.mem);
 #endif /* WEBP_ENCODER_ABI_VERSION */
 
-    /* free the memory used by webp for image data */
+    /* The planes are not owned by the picture, this only frees what the encoder kept */
     WebPPictureFree(&webp_image);
-    /* free the memory used by webp mux object */
-    WebPMuxDelete(webp_mux);
-    /* free the memory used by webp for output data */
-    WebPDataClear(&webp_output);
 }
 #endif /* HAVE_WEBP */
 
 /**
- * put_jpeg_yuv420p_file
- *      Converts an YUV420P coded image to a jpeg image and writes
- *      it to an already open file.
- *
+ * put_ppm_bgr24_memory
+ *      Converts an YUV420P image to a PPM image in memory.
  * Inputs:
  * - image is the image in YUV420P format.
  * - width and height are the dimensions of the image
- * - quality is the jpeg encoding quality 0-100%
  *
  * Output:
- * - The jpeg is written directly to the file given by the file pointer fp
+ * - The PPM is put in dest, which holds at least PPM_HEADER_MAX plus
+ *   3 bytes per pixel
  *
- * Returns nothing
+ * Returns the size of the PPM image
  */
-static void put_jpeg_yuv420p_file(FILE *fp,
-                  unsigned char *image, int width, int height,
-                  int quality,
-                  struct context *cnt, struct timeval *tv1, struct coord *box)
+static int put_ppm_bgr24_memory(unsigned char *dest, unsigned char *image, int width, int height)
 {
-    int sz = 0;
-    int image_size = cnt->imgs.size_norm;
-    unsigned char *buf = mymalloc(image_size);
-
-    sz = jpgutl_put_yuv420p(buf, image_size, image, width, height, quality, cnt ,tv1, box);
-    fwrite(buf, sz, 1, fp);
-
-    free(buf);
-
-}
-
-
-/**
- * put_jpeg_grey_file
- *      Converts an greyscale image to a jpeg image and writes
- *      it to an already open file.
- *
- * Inputs:
- * - image is the image in greyscale format.
- * - width and height are the dimensions of the image
- * - quality is the jpeg encoding quality 0-100%
- * Output:
- * - The jpeg is written directly to the file given by the file pointer fp
- *
- * Returns nothing
- */
-static void put_jpeg_grey_file(FILE *picture, unsigned char *image, int width, int height,
-                  int quality, struct context *cnt, struct timeval *tv1, struct coord *box)
-
-{
-    int sz = 0;
-    int image_size = cnt->imgs.size_norm;
-    unsigned char *buf = mymalloc(image_size);
-
-    sz = jpgutl_put_grey(buf, image_size, image, width, height, quality, cnt ,tv1, box);
-    fwrite(buf, sz, 1, picture);
-
-    free(buf);
-}
-
-
-/**
- * put_ppm_bgr24_file
- *      Converts an greyscale image to a PPM image and writes
- *      it to an already open file.
- * Inputs:
- * - image is the image in YUV420P format.
- * - width and height are the dimensions of the image
- *
- * Output:
- * - The PPM is written directly to the file given by the file pointer fp
- *
- * Returns nothing
- */
-static void put_ppm_bgr24_file(FILE *picture, unsigned char *image, int width, int height)
-{
-    int x, y;
+    int x, y, len;
     unsigned char *l = image;
     unsigned char *u = image + width * height;
     unsigned char *v = u + (width * height) / 4;
+    unsigned char *rgb;
     int r, g, b;
-    unsigned char rgb[3];
 
     /*
      *  ppm header
      *  width height
      *  maxval
      */
-    fprintf(picture, "P6\n");
-    fprintf(picture, "%d %d\n", width, height);
-    fprintf(picture, "%d\n", 255);
+    len = snprintf((char *)dest, PPM_HEADER_MAX, "P6\n%d %d\n%d\n", width, height, 255);
+    rgb = dest + len;
+
     for (y = 0; y < height; y++) {
 
         for (x = 0; x < width; x++) {
@@ -583,23 +606,25 @@ static void put_ppm_bgr24_file(FILE *picture, unsigned char *image, int width, i
             else if (b > 255)
                 b = 255;
 
+            /* ppm is rgb not bgr */
             rgb[0] = b;
             rgb[1] = g;
             rgb[2] = r;
+            rgb += 3;
 
             l++;
             if (x%2 != 0) {
                 u++;
                 v++;
             }
-            /* ppm is rgb not bgr */
-            fwrite(rgb, 1, 3, picture);
         }
         if (y%2 == 0) {
             u -= width / 2;
             v -= width / 2;
         }
     }
+
+    return len + width * height * 3;
 }
 
 /**
@@ -753,34 +778,25 @@ void overlay_largest_label(struct context *cnt, unsigned char *out)
 int put_picture_memory(struct context *cnt, unsigned char* dest_image, int image_size, unsigned char *image,
         int quality, int width, int height)
 {
-    struct timeval tv1;
-
-    /*
-     * Reset the time for the current image since it is not reliable
-     * for putting images to memory.
-     */
-    gettimeofday(&tv1, NULL);
-
+    /* Stream frames are compressed without a context so they get no EXIF data */
     if (!cnt->conf.stream_grey){
         return jpgutl_put_yuv420p(dest_image, image_size, image,
-                                       width, height, quality, cnt ,&tv1,NULL);
+                                       width, height, quality, NULL, NULL, NULL);
     } else {
         return jpgutl_put_grey(dest_image, image_size, image,
-                                       width, height, quality, cnt,&tv1,NULL);
+                                       width, height, quality, NULL, NULL, NULL);
     }
 
     return 0;
 }
 
-static void put_picture_fd(struct context *cnt, FILE *picture, unsigned char *image, int quality, int ftype){
-    int width, height;
-    int passthrough;
-    int dummy = 1;
-
-    /* See comment in put_picture_memory regarding dummy*/
+void put_picture(struct context *cnt, char *file, unsigned char *image, int ftype)
+{
+    int width, height, size, len;
+    unsigned char *buf;
+    struct image_data *img_data;
 
-    passthrough = util_check_passthrough(cnt);
-    if ((ftype == FTYPE_IMAGE) && (cnt->imgs.size_high > 0) && (!passthrough)) {
+    if ((ftype == FTYPE_IMAGE) && (cnt->imgs.size_high > 0) && (!util_check_passthrough(cnt))) {
         width = cnt->imgs.width_high;
         height = cnt->imgs.height_high;
     } else {
@@ -788,48 +804,67 @@ static void put_picture_fd(struct context *cnt, FILE *picture, unsigned char *im
         height = cnt->imgs.height;
     }
 
+    /* Image of the event being written, used for the exif data */
+    img_data = outpool_image(cnt);
+
+    #ifdef HAVE_WEBP
+    if (cnt->imgs.picture_type == IMAGE_TYPE_WEBP) {
+        put_webp_yuv420p_file(file, image, width, height, cnt->conf.picture_quality
+            , cnt->conf.picture_webp_method, cnt, &(img_data->timestamp_tv), &(img_data->location));
+        return;
+    }
+    #endif /* HAVE_WEBP */
+
     if (cnt->imgs.picture_type == IMAGE_TYPE_PPM) {
-        put_ppm_bgr24_file(picture, image, width, height);
+        size = PPM_HEADER_MAX + width * height * 3;
+        buf = mymalloc(size);
+        len = put_ppm_bgr24_memory(buf, image, width, height);
     } else {
-        if (dummy == 1){
-            #ifdef HAVE_WEBP
-            if (cnt->imgs.picture_type == IMAGE_TYPE_WEBP)
-                put_webp_yuv420p_file(picture, image, width, height, quality, cnt, &(cnt->current_image->timestamp_tv), &(cnt->current_image->location));
-            #endif /* HAVE_WEBP */
-            if (cnt->imgs.picture_type == IMAGE_TYPE_JPEG)
-                put_jpeg_yuv420p_file(picture, image, width, height, quality, cnt, &(cnt->current_image->timestamp_tv), &(cnt->current_image->location));
-        } else {
-            put_jpeg_grey_file(picture, image, width, height, quality, cnt, &(cnt->current_image->timestamp_tv), &(cnt->current_image->location));
-       }
+        size = (width * height * 3) / 2;
+        buf = mymalloc(size);
+        len = jpgutl_put_yuv420p(buf, size, image, width, height, cnt->conf.picture_quality
+            , cnt, &(img_data->timestamp_tv), &(img_data->location));
     }
-}
 
+    if (len > 0) put_picture_write(cnt, file, buf, len);
 
-void put_picture(struct context *cnt, char *file, unsigned char *image, int ftype)
+    free(buf);
+}
+
+/**
+ * put_picture_image
+ *      Writes a picture of a frame with the overlay items of the output.
+ *      Pictures of type FTYPE_IMAGE use the high resolution image when
+ *      there is one.  JPEG pictures come from the JPEG images kept for the
+ *      frame so a picture compressed like a stream or an earlier picture
+ *      of the same frame is not compressed again.
+ *
+ * Returns nothing
+ */
+void put_picture_image(struct context *cnt, char *file, struct image_data *img, int items, int ftype)
 {
-    FILE *picture;
+    unsigned char *buf;
+    int high, size, len;
 
-    picture = myfopen(file, "w");
-    if (!picture) {
-        /* Report to syslog - suggest solution if the problem is access rights to target dir. */
-        if (errno ==  EACCES) {
-            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
-                ,_("Can't write picture to file %s - check access rights to target directory\n"
-                "Thread is going to finish due to this fatal error"), file);
-            cnt->finish = 1;
-            cnt->restart = 0;
-            return;
+    high = ((ftype == FTYPE_IMAGE) && (cnt->imgs.size_high > 0) && (!util_check_passthrough(cnt)));
+
+    if (cnt->imgs.picture_type != IMAGE_TYPE_JPEG) {
+        if (high) {
+            put_picture(cnt, file, img->image_high, ftype);
         } else {
-            /* If target dir is temporarily unavailable we may survive. */
-            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
-                ,_("Can't write picture to file %s"), file);
-            return;
+            put_picture(cnt, file, overlay_image(cnt, img, items), ftype);
         }
+        return;
     }
 
-    put_picture_fd(cnt, picture, image, cnt->conf.picture_quality, ftype);
+    size = (high ? cnt->imgs.size_high : cnt->imgs.size_norm);
+    buf = mymalloc(size);
+    len = overlay_jpeg(cnt, img, items, (high ? OVERLAY_JPEG_HIGH : OVERLAY_JPEG_NORM)
+        , cnt->conf.picture_quality, FALSE, TRUE, buf, size);
 
-    myfclose(picture);
+    if (len > 0) put_picture_write(cnt, file, buf, len);
+
+    free(buf);
 }
 
 /**
@@ -969,20 +1004,139 @@ void put_fixed_mask(struct context *cnt, const char *file)
         "re-run motion to enable mask feature"), cnt->conf.mask_file);
 }
 
-void pic_scale_img(int width_src, int height_src, unsigned char *img_src, unsigned char *img_dst){
+static void pic_scale_half(const unsigned char *src, int width_src
+            , unsigned char *dst, int width_dst, int height_dst){
+    /* Average each 2x2 block of a plane, 16 pixels at a time where the
+     * processor has vector instructions
+     */
+    const unsigned char *row0, *row1;
+    unsigned char *out;
+    int x, y;
+
+    for (y = 0; y < height_dst; y++) {
+        row0 = src + (2 * y) * width_src;
+        row1 = row0 + width_src;
+        out = dst + y * width_dst;
+        x = 0;
+
+        #if defined(__SSE2__)
+            __m128i mask = _mm_set1_epi16(0x00ff);
+            __m128i two = _mm_set1_epi16(2);
+            __m128i pix0, pix1, sum0, sum1;
+            for (; x + 16 <= width_dst; x += 16) {
+                pix0 = _mm_loadu_si128((const __m128i *)(row0 + 2 * x));
+                pix1 = _mm_loadu_si128((const __m128i *)(row1 + 2 * x));
+                sum0 = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(pix0, mask), _mm_srli_epi16(pix0, 8)),
+                    _mm_add_epi16(_mm_and_si128(pix1, mask), _mm_srli_epi16(pix1, 8)));
+                pix0 = _mm_loadu_si128((const __m128i *)(row0 + 2 * x + 16));
+                pix1 = _mm_loadu_si128((const __m128i *)(row1 + 2 * x + 16));
+                sum1 = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(pix0, mask), _mm_srli_epi16(pix0, 8)),
+                    _mm_add_epi16(_mm_and_si128(pix1, mask), _mm_srli_epi16(pix1, 8)));
+                sum0 = _mm_srli_epi16(_mm_add_epi16(sum0, two), 2);
+                sum1 = _mm_srli_epi16(_mm_add_epi16(sum1, two), 2);
+                _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(sum0, sum1));
+            }
+        #elif defined(__ARM_NEON)
+            uint16x8_t sum0, sum1;
+            for (; x + 16 <= width_dst; x += 16) {
+                sum0 = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x))
+                    , vpaddlq_u8(vld1q_u8(row1 + 2 * x)));
+                sum1 = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x + 16))
+                    , vpaddlq_u8(vld1q_u8(row1 + 2 * x + 16)));
+                vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(sum0, 2), vrshrn_n_u16(sum1, 2)));
+            }
+        #endif
+
+        for (; x < width_dst; x++) {
+            out[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+        }
+    }
+
+}
+
+static void pic_scale_box(const unsigned char *src, int width_src, int height_src
+            , unsigned char *dst, int width_dst, int height_dst){
+    /* Average the block of source pixels covered by each pixel of a plane.
+     * The rows of a block are summed per column first, a loop the compiler
+     * can vectorize, then the columns of each block are added up.
+     */
+    const unsigned char *row;
+    unsigned int *colsum;
+    unsigned int sum, count;
+    int x, y, sx, sy, x0, x1, y0, y1;
+
+    colsum = mymalloc(width_src * sizeof(unsigned int));
+
+    for (y = 0; y < height_dst; y++) {
+        y0 = (y * height_src) / height_dst;
+        y1 = ((y + 1) * height_src) / height_dst;
+        if (y1 <= y0) y1 = y0 + 1;
+
+        memset(colsum, 0, width_src * sizeof(unsigned int));
+        for (sy = y0; sy < y1; sy++) {
+            row = src + sy * width_src;
+            for (sx = 0; sx < width_src; sx++) colsum[sx] += row[sx];
+        }
+
+        for (x = 0; x < width_dst; x++) {
+            x0 = (x * width_src) / width_dst;
+            x1 = ((x + 1) * width_src) / width_dst;
+            if (x1 <= x0) x1 = x0 + 1;
+            sum = 0;
+            for (sx = x0; sx < x1; sx++) sum += colsum[sx];
+            count = (x1 - x0) * (y1 - y0);
+            dst[y * width_dst + x] = (sum + count / 2) / count;
+        }
+    }
+
+    free(colsum);
+
+}
+
+static void pic_scale_plane(const unsigned char *src, int width_src, int height_src
+            , unsigned char *dst, int width_dst, int height_dst){
+
+    if ((width_src == 2 * width_dst) && (height_src == 2 * height_dst)) {
+        pic_scale_half(src, width_src, dst, width_dst, height_dst);
+    } else {
+        pic_scale_box(src, width_src, height_src, dst, width_dst, height_dst);
+    }
+
+}
+
+/**
+ * pic_scale_img
+ *
+ *   Scales a YUV 4:2:0 image down with a box filter, each pixel being the
+ *   average of the block of the image it covers.
+ *
+ * Parameters:
+ *
+ *      width_src   Width of the image
+ *      height_src  Height of the image
+ *      img_src     The image
+ *      width_dst   Width of the scaled image, at most width_src and even
+ *      height_dst  Height of the scaled image, at most height_src and even
+ *      img_dst     Memory receiving the scaled image
+ *
+ * Returns:     nothing
+ */
+void pic_scale_img(int width_src, int height_src, unsigned char *img_src
+            , int width_dst, int height_dst, unsigned char *img_dst){
+
+    int size_src, size_dst;
 
-    int i = 0, x, y;
-    for (y = 0; y < height_src; y+=2)
-        for (x = 0; x < width_src; x+=2)
-            img_dst[i++] = img_src[y * width_src + x];
+    size_src = width_src * height_src;
+    size_dst = width_dst * height_dst;
 
-    for (y = 0; y < height_src / 2; y+=2)
-       for (x = 0; x < width_src; x += 4)
-       {
-          img_dst[i++] = img_src[(width_src * height_src) + (y * width_src) + x];
-          img_dst[i++] = img_src[(width_src * height_src) + (y * width_src) + (x + 1)];
-       }
+    pic_scale_plane(img_src, width_src, height_src
+        , img_dst, width_dst, height_dst);
+    pic_scale_plane(img_src + size_src, width_src / 2, height_src / 2
+        , img_dst + size_dst, width_dst / 2, height_dst / 2);
+    pic_scale_plane(img_src + size_src + (size_src / 4), width_src / 2, height_src / 2
+        , img_dst + size_dst + (size_dst / 4), width_dst / 2, height_dst / 2);
 
-    return;
 }
 
@@ -18,9 +18,11 @@ void put_fixed_mask(struct context *, const char *);
 void overlay_largest_label(struct context *, unsigned char *);
 int put_picture_memory(struct context *, unsigned char*, int, unsigned char *, int, int, int);
 void put_picture(struct context *, char *, unsigned char *, int);
+void put_picture_image(struct context *, char *, struct image_data *, int, int);
 unsigned char *get_pgm(FILE *, int, int);
 void preview_save(struct context *);
-void pic_scale_img(int width_src, int height_src, unsigned char *img_src, unsigned char *img_dst);
+void pic_scale_img(int width_src, int height_src, unsigned char *img_src
+    , int width_dst, int height_dst, unsigned char *img_dst);
 
 unsigned prepare_exif(unsigned char **, const struct context *, const struct timeval *, const struct coord *);
 
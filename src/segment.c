@@ -0,0 +1,384 @@
+/*
+ *    segment.c
+ *
+ *    Continuous recording in segments for Motion
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ *    With movie_segment_time set every frame of the camera goes to a single
+ *    MPEG-TS muxer that stays open, fed with the packets of the camera when
+ *    they are passed through or else by one codec that is never restarted.
+ *    The recording is split into files of about movie_segment_time seconds
+ *    which each start with a key frame.  An index records the segments and
+ *    where each event starts and ends in them, so the movie of an event can
+ *    be cut out of the segments without encoding and with all its frames.
+ *
+ *    The index is a text file with a line appended per record:
+ *      segment <number> <time> <file>
+ *      start <event> <time> <number> <offset>
+ *      end <event> <time> <number> <offset>
+ *    The start of an event is the last key frame at or before its first
+ *    frame, the end is the end of the data written when the event ended.
+ *    Segments are numbered from 1 each time the recording is opened and a
+ *    number refers to the latest segment line with that number.
+ *
+ *    With movie_segment_files set the recording is a store of that many
+ *    files kept next to the index, 000.ts and so on, which are reused in
+ *    turn starting with the oldest.  Disk use stays fixed and nothing has to
+ *    delete old recordings.  Each file gets movie_segment_prealloc MiB of
+ *    disk reserved when it is started so it is written without growing the
+ *    file piece by piece.  The index is moved to <index>.old and started
+ *    over after a round of the files, the two of them cover all the files.
+ *    It is also moved when the recording is opened again, as the store
+ *    then resumes at its oldest file.
+ */
+
+#include "motion.h"
+#include "translate.h"
+#include "event.h"
+#include "segment.h"
+
+#define SEGMENT_KEYS    64      /* Key frames kept to find the start of an event */
+
+struct segment_key {
+    int             nbr;            /* Segment of the key frame */
+    int64_t         offset;         /* Offset of the key frame in its segment */
+    struct timeval  tv;
+};
+
+struct segment_recorder {
+    struct ffmpeg      *ffmpeg;             /* Muxer of the recording, NULL when not open */
+    time_t              fail;               /* When the muxer last failed to open */
+    FILE               *index;
+    int                 nbr;                /* Number of the segment being written */
+    time_t              start;              /* When the segment being written was due */
+    char                filename[PATH_MAX]; /* File of the segment being written */
+    char                nextname[PATH_MAX]; /* File of the segment due at the next key frame */
+    struct segment_key  keys[SEGMENT_KEYS]; /* Latest key frames written */
+    int                 key_count;
+    int                 key_next;
+    int                 in_event;           /* The start of the event in progress was recorded */
+    int                 slot;               /* File of the store being written */
+    int                 index_count;        /* Segments recorded in the index */
+    char                indexname[PATH_MAX];
+};
+
+static void segment_path(struct context *cnt, char *dst, const char *fmt
+            , const struct timeval *tv1){
+    /* Name of a file of the recording, relative to the target directory */
+    char tmp[PATH_MAX];
+
+    mystrftime(cnt, tmp, sizeof(tmp), fmt, tv1, NULL, 0);
+
+    /* PATH_MAX - 4 to allow for .ts to be appended without overflow */
+    snprintf(dst, PATH_MAX - 4, "%.*s/%.*s"
+        , (int)(PATH_MAX-5-strlen(tmp))
+        , cnt->conf.target_dir
+        , (int)(PATH_MAX-5-strlen(cnt->conf.target_dir))
+        , tmp);
+}
+
+static void segment_index_file(struct segment_recorder *seg, const struct timeval *tv1){
+
+    if (seg->index == NULL) return;
+
+    fprintf(seg->index, "segment %d %ld.%06ld %s\n", seg->nbr
+        , (long)tv1->tv_sec, (long)tv1->tv_usec, seg->filename);
+    seg->index_count++;
+}
+
+static void segment_index_open(struct segment_recorder *seg){
+
+    seg->index = myfopen(seg->indexname, "a");
+    if (seg->index == NULL) {
+        MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO
+            ,_("Recording without an index of the events"));
+        return;
+    }
+
+    /* Each record is written out as soon as its line is complete */
+    setvbuf(seg->index, NULL, _IOLBF, 0);
+    seg->index_count = 0;
+}
+
+static void segment_index_rotate(struct segment_recorder *seg){
+    /* After a round of the store the index starts over, keeping the last one */
+    char oldname[PATH_MAX];
+
+    if (seg->index != NULL) myfclose(seg->index);
+    seg->index = NULL;
+
+    snprintf(oldname, PATH_MAX, "%.*s.old", PATH_MAX - 5, seg->indexname);
+    if (rename(seg->indexname, oldname) != 0) {
+        MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
+            ,_("Error moving index %s to %s"), seg->indexname, oldname);
+    }
+
+    segment_index_open(seg);
+}
+
+static void segment_store_path(struct segment_recorder *seg, char *dst, int slot, const char *ext){
+    /* Name of a file of the store, next to the index */
+    const char *sep;
+    int dirlen;
+
+    sep = strrchr(seg->indexname, '/');
+    dirlen = (sep == NULL) ? 0 : (int)(sep - seg->indexname + 1);
+
+    snprintf(dst, PATH_MAX - 4, "%.*s%03d%s", dirlen, seg->indexname, slot, ext);
+}
+
+static int segment_store_first(struct context *cnt, struct segment_recorder *seg){
+    /* The store starts over at its first missing file or else its oldest one */
+    char path[PATH_MAX];
+    struct stat statbuf;
+    time_t oldest = 0;
+    int slot, first = 0;
+
+    for (slot = 0; slot < cnt->conf.movie_segment_files; slot++) {
+        segment_store_path(seg, path, slot, ".ts");
+        if (stat(path, &statbuf) != 0) return slot;
+        if ((slot == 0) || (statbuf.st_mtime < oldest)) {
+            oldest = statbuf.st_mtime;
+            first = slot;
+        }
+    }
+
+    return first;
+}
+
+static void segment_prealloc(struct context *cnt, const char *path){
+    /*
+     * Reserve the disk of a file that was just started.  The size of the file
+     * is left to what is written so the reservation never shows as data.
+     */
+#ifdef FALLOC_FL_KEEP_SIZE
+    int fd;
+
+    if (cnt->conf.movie_segment_prealloc <= 0) return;
+
+    fd = open(path, O_WRONLY);
+    if (fd < 0) return;
+
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0
+            , (off_t)cnt->conf.movie_segment_prealloc * 1024 * 1024) != 0) {
+        MOTION_LOG(WRN, TYPE_EVENTS, SHOW_ERRNO
+            ,_("Could not reserve %d MiB for %s")
+            , cnt->conf.movie_segment_prealloc, path);
+    }
+    close(fd);
+#else
+    if (cnt->conf.movie_segment_prealloc > 0) {
+        MOTION_LOG(DBG, TYPE_EVENTS, NO_ERRNO
+            ,_("Reserving the disk of %s is not supported"), path);
+    }
+#endif
+}
+
+static int segment_open(struct context *cnt, struct segment_recorder *seg, struct timeval *tv1){
+    struct ffmpeg *ffmpeg;
+    struct stat statbuf;
+
+    segment_path(cnt, seg->indexname, cnt->conf.movie_segment_index, tv1);
+    if (cnt->conf.movie_segment_files > 0) {
+        seg->slot = segment_store_first(cnt, seg);
+        segment_store_path(seg, seg->filename, seg->slot, "");
+    } else {
+        segment_path(cnt, seg->filename, cnt->conf.movie_segment_filename, tv1);
+    }
+
+    ffmpeg = mymalloc(sizeof(struct ffmpeg));
+    if (cnt->imgs.size_high > 0){
+        ffmpeg->width  = cnt->imgs.width_high;
+        ffmpeg->height = cnt->imgs.height_high;
+        ffmpeg->high_resolution = TRUE;
+        ffmpeg->rtsp_data = cnt->rtsp_high;
+    } else {
+        ffmpeg->width  = cnt->imgs.width;
+        ffmpeg->height = cnt->imgs.height;
+        ffmpeg->high_resolution = FALSE;
+        ffmpeg->rtsp_data = cnt->rtsp;
+    }
+    ffmpeg->tlapse = TIMELAPSE_NONE;
+    ffmpeg->fps = cnt->lastrate;
+    if (ffmpeg->fps < 2) ffmpeg->fps = 2;
+    ffmpeg->bps = cnt->conf.movie_bps;
+    ffmpeg->filename = seg->filename;
+    ffmpeg->quality = cnt->conf.movie_quality;
+    ffmpeg->start_time.tv_sec = tv1->tv_sec;
+    ffmpeg->start_time.tv_usec = tv1->tv_usec;
+    ffmpeg->last_pts = -1;
+    ffmpeg->base_pts = 0;
+    ffmpeg->gop_cnt = 0;
+    ffmpeg->codec_name = "mpegts";
+    ffmpeg->test_mode = FALSE;
+    ffmpeg->motion_images = 0;
+    ffmpeg->passthrough = util_check_passthrough(cnt);
+    ffmpeg->segment = TRUE;
+    /* Encoded in the caller so the key frames are known when the put returns */
+    ffmpeg->encoder_queue = 0;
+    ffmpeg->encoder_threads = cnt->conf.movie_encoder_threads;
+    ffmpeg->encoder_params = cnt->conf.movie_encoder_params;
+
+    if (ffmpeg_open(ffmpeg) < 0){
+        MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO
+            ,_("Error opening context for the recording %s"), seg->filename);
+        free(ffmpeg);
+        return -1;
+    }
+
+    seg->ffmpeg = ffmpeg;
+    seg->nbr = 1;
+    seg->start = tv1->tv_sec;
+    seg->key_count = 0;
+    seg->key_next = 0;
+
+    segment_prealloc(cnt, seg->filename);
+
+    if (seg->index == NULL) {
+        /* The store resumes at its oldest file, the index starts over with it */
+        if ((cnt->conf.movie_segment_files > 0) && (stat(seg->indexname, &statbuf) == 0)) {
+            segment_index_rotate(seg);
+        } else {
+            segment_index_open(seg);
+        }
+    }
+    segment_index_file(seg, tv1);
+
+    event(cnt, EVENT_FILECREATE, NULL, seg->filename, (void *)FTYPE_MPEG, tv1);
+
+    return 0;
+}
+
+static void segment_key_add(struct segment_recorder *seg){
+    /* Remember the key frame written by the last put */
+    struct segment_key *key;
+
+    key = &seg->keys[seg->key_next];
+    key->nbr = seg->nbr;
+    key->offset = seg->ffmpeg->key_offset;
+    key->tv = seg->ffmpeg->key_tv;
+
+    seg->key_next = (seg->key_next + 1) % SEGMENT_KEYS;
+    if (seg->key_count < SEGMENT_KEYS) seg->key_count++;
+}
+
+void segment_put(struct context *cnt, struct image_data *img_data, struct timeval *tv1){
+    struct segment_recorder *seg;
+    struct image_data img_movie;
+
+    if (cnt->conf.movie_segment_time <= 0) {
+        segment_close(cnt, tv1);
+        return;
+    }
+
+    if (cnt->segment == NULL) cnt->segment = mymalloc(sizeof(struct segment_recorder));
+    seg = cnt->segment;
+
+    if (seg->ffmpeg == NULL) {
+        if (tv1->tv_sec < seg->fail + 10) return;
+        if (segment_open(cnt, seg, tv1) < 0) {
+            seg->fail = tv1->tv_sec;
+            return;
+        }
+    } else if ((seg->ffmpeg->segment_next == NULL) &&
+        ((tv1->tv_sec - seg->start) >= cnt->conf.movie_segment_time)) {
+        /* The muxer switches to the next file at its next key frame */
+        if (cnt->conf.movie_segment_files > 0) {
+            segment_store_path(seg, seg->nextname
+                , (seg->slot + 1) % cnt->conf.movie_segment_files, ".ts");
+        } else {
+            segment_path(cnt, seg->nextname, cnt->conf.movie_segment_filename, tv1);
+            strcat(seg->nextname, ".ts");
+        }
+        seg->ffmpeg->segment_next = seg->nextname;
+        seg->start = tv1->tv_sec;
+    }
+
+    if (!seg->ffmpeg->passthrough) {
+        memcpy(&img_movie, img_data, sizeof(struct image_data));
+        img_movie.image_norm = overlay_image(cnt, img_data, cnt->overlay_movie);
+        img_data = &img_movie;
+    }
+
+    seg->ffmpeg->segment_split = FALSE;
+    if (ffmpeg_put_image(seg->ffmpeg, img_data, tv1) == -1){
+        MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
+    }
+
+    if (seg->ffmpeg->segment_split) {
+        event(cnt, EVENT_FILECLOSE, NULL, seg->filename, (void *)FTYPE_MPEG, tv1);
+        snprintf(seg->filename, PATH_MAX, "%s", seg->nextname);
+        seg->nbr++;
+        segment_prealloc(cnt, seg->filename);
+        if (cnt->conf.movie_segment_files > 0) {
+            seg->slot = (seg->slot + 1) % cnt->conf.movie_segment_files;
+            if (seg->index_count >= cnt->conf.movie_segment_files) segment_index_rotate(seg);
+        }
+        segment_index_file(seg, &seg->ffmpeg->key_tv);
+        event(cnt, EVENT_FILECREATE, NULL, seg->filename, (void *)FTYPE_MPEG, tv1);
+    }
+
+    if (seg->ffmpeg->live_key) segment_key_add(seg);
+}
+
+void segment_event_start(struct context *cnt, struct timeval *tv1){
+    /* Record the last key frame at or before the first frame of the event */
+    struct segment_recorder *seg = cnt->segment;
+    struct segment_key *key;
+    int indx, count;
+
+    if ((seg == NULL) || (seg->ffmpeg == NULL) || (seg->index == NULL)) return;
+    if (seg->key_count == 0) return;
+
+    /* Newest first, falling back on the oldest kept */
+    indx = seg->key_next;
+    count = 0;
+    do {
+        indx = (indx + SEGMENT_KEYS - 1) % SEGMENT_KEYS;
+        key = &seg->keys[indx];
+        count++;
+    } while ((count < seg->key_count) && timercmp(&key->tv, tv1, >));
+
+    seg->in_event = TRUE;
+    fprintf(seg->index, "start %d %ld.%06ld %d %lld\n", outpool_event_nr(cnt)
+        , (long)tv1->tv_sec, (long)tv1->tv_usec, key->nbr, (long long)key->offset);
+}
+
+void segment_event_end(struct context *cnt, struct timeval *tv1){
+    /* Record the end of the data written up to the end of the event */
+    struct segment_recorder *seg = cnt->segment;
+    struct timeval tv_now;
+
+    if ((seg == NULL) || (seg->ffmpeg == NULL) || (seg->index == NULL)) return;
+    if (!seg->in_event) return;
+
+    if (tv1 == NULL) {
+        gettimeofday(&tv_now, NULL);
+        tv1 = &tv_now;
+    }
+
+    fprintf(seg->index, "end %d %ld.%06ld %d %lld\n", outpool_event_nr(cnt)
+        , (long)tv1->tv_sec, (long)tv1->tv_usec, seg->nbr
+        , (long long)ffmpeg_segment_offset(seg->ffmpeg));
+    seg->in_event = FALSE;
+}
+
+void segment_close(struct context *cnt, struct timeval *tv1){
+    struct segment_recorder *seg = cnt->segment;
+
+    if (seg == NULL) return;
+
+    if (seg->ffmpeg != NULL) {
+        ffmpeg_close(seg->ffmpeg);
+        free(seg->ffmpeg);
+        seg->ffmpeg = NULL;
+        event(cnt, EVENT_FILECLOSE, NULL, seg->filename, (void *)FTYPE_MPEG, tv1);
+    }
+
+    if (seg->index != NULL) myfclose(seg->index);
+
+    free(seg);
+    cnt->segment = NULL;
+}
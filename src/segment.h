@@ -0,0 +1,21 @@
+/*
+ *    segment.h
+ *
+ *    Include file for segment.c
+ *
+ *    This software is distributed under the GNU Public License Version 2
+ *    See also the file 'COPYING'.
+ *
+ */
+#ifndef _INCLUDE_SEGMENT_H_
+#define _INCLUDE_SEGMENT_H_
+
+struct context;
+struct image_data;
+
+void segment_put(struct context *cnt, struct image_data *img_data, struct timeval *tv1);
+void segment_event_start(struct context *cnt, struct timeval *tv1);
+void segment_event_end(struct context *cnt, struct timeval *tv1);
+void segment_close(struct context *cnt, struct timeval *tv1);
+
+#endif /* _INCLUDE_SEGMENT_H_ */
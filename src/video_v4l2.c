@@ -1126,6 +1126,21 @@ static int v4l2_capture(struct context *cnt, struct video_dev *curdev, unsigned
     return 1;
 }
 
+static void v4l2_capture_source(struct context *cnt, struct video_dev *curdev, struct image_data *img_data) {
+
+    /* Keep the JPEG of a MJPEG camera with the frame decoded from it */
+
+    src_v4l2_t *vid_source = (src_v4l2_t *) curdev->v4l2_private;
+    video_buff *the_buffer;
+
+    if ((curdev->pixfmt_src != V4L2_PIX_FMT_MJPEG) &&
+        (curdev->pixfmt_src != V4L2_PIX_FMT_JPEG)) return;
+
+    the_buffer = &vid_source->buffers[vid_source->buf.index];
+    overlay_set_source(cnt, img_data, the_buffer->ptr, the_buffer->content_length);
+
+}
+
 static int v4l2_device_init(struct context *cnt, struct video_dev *curdev) {
 
     src_v4l2_t *vid_source;
@@ -1554,6 +1569,7 @@ int v4l2_next(struct context *cnt, struct image_data *img_data) {
 
     v4l2_device_select(cnt, dev, img_data->image_norm);
     ret = v4l2_capture(cnt, dev, img_data->image_norm);
+    if (ret == 0) v4l2_capture_source(cnt, dev, img_data);
 
     if (--dev->frames <= 0) {
         dev->owner = -1;
@@ -54,6 +54,8 @@ struct mhdstart_ctx {
     struct MHD_OptionItem   *mhd_ops;
     int                     mhd_opt_nbr;
     unsigned int            mhd_flags;
+    int                     pool;       /* Threads of the stream event loop, 0 for a thread per connection */
+    int                     epoll;
     int                     ipv6;
     struct sockaddr_in      lpbk_ipv4;
     struct sockaddr_in6     lpbk_ipv6;
@@ -86,6 +88,15 @@ static void webu_context_init(struct context **cntlst, struct context *cnt, stru
     webui->resp_size     = WEBUI_LEN_RESP * 10; /* The size of the resp_page buffer.  May get adjusted */
     webui->resp_used     = 0;                   /* How many bytes used so far in resp_page*/
     webui->stream_pos    = 0;                   /* Stream position of image being sent */
+    webui->stream_jpeg   = NULL;                /* Image being sent */
+    webui->stream_chunk  = NULL;                /* MPEG-TS chunk being sent */
+    webui->stream_data   = NULL;                /* Stream of the image being sent */
+    webui->stream_seq    = 0;                   /* No image of the stream sent yet */
+    webui->stream_joined = FALSE;               /* MPEG-TS header not sent yet */
+    webui->stream_size   = 0;                   /* First substream */
+    webui->stream_next   = NULL;                /* Not waiting on a stream */
+    webui->stream_suspended = FALSE;
+    timerclear(&webui->stream_due);             /* Resumed by the next image */
     webui->stream_fps    = 1;                   /* Stream rate */
     webui->resp_page     = mymalloc(webui->resp_size);      /* The response being constructed */
     webui->cntlst        = cntlst;  /* The list of context's for all cameras */
@@ -136,6 +147,10 @@ static void webu_context_null(struct webui_ctx *webui) {
     webui->auth_realm    = NULL;
     webui->clientip      = NULL;
     webui->text_eol      = NULL;
+    webui->stream_jpeg   = NULL;
+    webui->stream_chunk  = NULL;
+    webui->stream_data   = NULL;
+    webui->stream_next   = NULL;
 
     return;
 }
@@ -1169,6 +1184,19 @@ static int webu_mhd_send(struct webui_ctx *webui, int ctrl) {
     return retcd;
 }
 
+static int webu_answer_strm_size(const char *uri_size) {
+    /* Substream number of the uri, substream alone is the first one */
+    char *endptr;
+    long size;
+
+    if (strlen(uri_size) == 0) return 0;
+
+    size = strtol(uri_size, &endptr, 10);
+    if ((*endptr != '\0') || (size < 0) || (size >= STREAM_SCALED_MAX)) return -1;
+
+    return (int)size;
+}
+
 static void webu_answer_strm_type(struct webui_ctx *webui) {
     /* Assign the type of stream that is being answered*/
 
@@ -1179,7 +1207,17 @@ static void webu_answer_strm_type(struct webui_ctx *webui) {
 
     } else if ((strcmp(webui->uri_cmd1,"substream") == 0) ||
         (strcmp(webui->uri_camid,"substream") == 0)){
-        webui->cnct_type = WEBUI_CNCT_SUB;
+        if (strcmp(webui->uri_cmd1,"substream") == 0) {
+            webui->stream_size = webu_answer_strm_size(webui->uri_cmd2);
+        } else {
+            webui->stream_size = webu_answer_strm_size(webui->uri_cmd1);
+        }
+        if (webui->stream_size < 0) {
+            webui->stream_size = 0;
+            webui->cnct_type = WEBUI_CNCT_UNKNOWN;
+        } else {
+            webui->cnct_type = WEBUI_CNCT_SUB;
+        }
 
     } else if ((strcmp(webui->uri_cmd1,"motion") == 0) ||
         (strcmp(webui->uri_camid,"motion") == 0)){
@@ -1193,6 +1231,14 @@ static void webu_answer_strm_type(struct webui_ctx *webui) {
         (strcmp(webui->uri_camid,"current") == 0)){
         webui->cnct_type = WEBUI_CNCT_STATIC;
 
+    } else if ((strcmp(webui->uri_cmd1,"mpegts") == 0) ||
+        (strcmp(webui->uri_camid,"mpegts") == 0)){
+        webui->cnct_type = WEBUI_CNCT_MPEGTS;
+
+    } else if ((strcmp(webui->uri_camid,"mosaic") == 0) &&
+        (strlen(webui->uri_cmd1) == 0)){
+        webui->cnct_type = WEBUI_CNCT_MOSAIC;
+
     } else if ((strlen(webui->uri_camid) > 0) &&
         (strlen(webui->uri_cmd1) == 0)){
         webui->cnct_type = WEBUI_CNCT_FULL;
@@ -1317,8 +1363,12 @@ static int webu_answer_strm(void *cls
         return retcd;
     }
 
-    /* Do not answer a request until the motion loop has completed at least once */
-    if (webui->cnt->passflag == 0) return MHD_NO;
+    webu_answer_strm_type(webui);
+
+    /* Do not answer a request until the motion loop has completed at least once.
+     * The mosaic is drawn by its own thread and not by a motion loop.
+     */
+    if ((webui->cnt->passflag == 0) && (webui->cnct_type != WEBUI_CNCT_MOSAIC)) return MHD_NO;
 
     if (webui->cnt->webcontrol_finish) return MHD_NO;
 
@@ -1333,8 +1383,6 @@ static int webu_answer_strm(void *cls
         if (!webui->authenticated) return retcd;
     }
 
-    webu_answer_strm_type(webui);
-
     retcd = 0;
     if (webui->cnct_type == WEBUI_CNCT_STATIC){
         retcd = webu_stream_static(webui);
@@ -1342,6 +1390,12 @@ static int webu_answer_strm(void *cls
             webu_badreq(webui);
             retcd = webu_mhd_send(webui, FALSE);
         }
+    } else if (webui->cnct_type == WEBUI_CNCT_MPEGTS){
+        retcd = webu_stream_mpegts(webui);
+        if (retcd == MHD_NO){
+            webu_badreq(webui);
+            retcd = webu_mhd_send(webui, FALSE);
+        }
     } else if (webui->cnct_type != WEBUI_CNCT_UNKNOWN) {
         retcd = webu_stream_mjpeg(webui);
         if (retcd == MHD_NO){
@@ -1447,6 +1501,8 @@ static void webu_mhd_deinit(void *cls
     (void)cls;
     (void)toe;
 
+    webu_stream_release(webui);
+
     if (webui->cnct_type == WEBUI_CNCT_FULL ){
         pthread_mutex_lock(&webui->cnt->mutex_stream);
             webui->cnt->stream_norm.cnct_count--;
@@ -1454,7 +1510,7 @@ static void webu_mhd_deinit(void *cls
 
     } else if (webui->cnct_type == WEBUI_CNCT_SUB ){
         pthread_mutex_lock(&webui->cnt->mutex_stream);
-            webui->cnt->stream_sub.cnct_count--;
+            webui->cnt->stream_scaled[webui->stream_size].stream.cnct_count--;
         pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
     } else if (webui->cnct_type == WEBUI_CNCT_MOTION ){
@@ -1467,11 +1523,21 @@ static void webu_mhd_deinit(void *cls
             webui->cnt->stream_source.cnct_count--;
         pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
+    } else if (webui->cnct_type == WEBUI_CNCT_MOSAIC ){
+        pthread_mutex_lock(&webui->cnt->mutex_stream);
+            webui->cnt->stream_mosaic.cnct_count--;
+        pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
     } else if (webui->cnct_type == WEBUI_CNCT_STATIC ){
         pthread_mutex_lock(&webui->cnt->mutex_stream);
             webui->cnt->stream_norm.cnct_count--;
         pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
+    } else if (webui->cnct_type == WEBUI_CNCT_MPEGTS ){
+        pthread_mutex_lock(&webui->cnt->mutex_stream);
+            webui->cnt->stream_mpegts.cnct_count--;
+        pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
     }
 
     webu_context_free(webui);
@@ -1579,6 +1645,32 @@ static void webu_mhd_features_tls(struct mhdstart_ctx *mhdst){
     #endif
 }
 
+static void webu_mhd_features_pool(struct mhdstart_ctx *mhdst){
+    /* The streams are served by a pool of event loop threads when MHD can
+     * suspend connections.  Otherwise each connection gets its own thread.
+     * The webcontrol always uses a thread per connection.
+     */
+    mhdst->pool = 0;
+    mhdst->epoll = FALSE;
+
+    if ((mhdst->ctrl) || (mhdst->cnt[0]->conf.stream_threads <= 0)) return;
+
+    #if MHD_VERSION < 0x00094400
+        MOTION_LOG(INF, TYPE_STREAM, NO_ERRNO
+            ,_("libmicrohttpd libary too old, stream_threads disabled"));
+    #else
+        int retcd;
+        mhdst->pool = mhdst->cnt[0]->conf.stream_threads;
+        retcd = MHD_is_feature_supported (MHD_FEATURE_EPOLL);
+        if (retcd == MHD_YES){
+            MOTION_LOG(DBG, TYPE_STREAM, NO_ERRNO ,_("epoll: available"));
+            mhdst->epoll = TRUE;
+        } else {
+            MOTION_LOG(INF, TYPE_STREAM, NO_ERRNO ,_("epoll: disabled"));
+        }
+    #endif
+}
+
 static void webu_mhd_features(struct mhdstart_ctx *mhdst){
     /* This function goes through at least a few of the MHD features
      * and adjusts the user parameters from the configuration as
@@ -1593,6 +1685,8 @@ static void webu_mhd_features(struct mhdstart_ctx *mhdst){
 
     webu_mhd_features_tls(mhdst);
 
+    webu_mhd_features_pool(mhdst);
+
 }
 
 static char *webu_mhd_loadfile(const char *fname){
@@ -1805,6 +1899,17 @@ static void webu_mhd_opts_tls(struct mhdstart_ctx *mhdst){
 
 }
 
+static void webu_mhd_opts_pool(struct mhdstart_ctx *mhdst){
+    /* Set the number of threads running the stream event loop */
+    if (mhdst->pool > 0){
+        mhdst->mhd_ops[mhdst->mhd_opt_nbr].option = MHD_OPTION_THREAD_POOL_SIZE;
+        mhdst->mhd_ops[mhdst->mhd_opt_nbr].value = mhdst->pool;
+        mhdst->mhd_ops[mhdst->mhd_opt_nbr].ptr_value = NULL;
+        mhdst->mhd_opt_nbr++;
+    }
+
+}
+
 static void webu_mhd_opts(struct mhdstart_ctx *mhdst){
     /* Set all the options we need based upon the motion configuration parameters*/
 
@@ -1822,6 +1927,8 @@ static void webu_mhd_opts(struct mhdstart_ctx *mhdst){
 
     webu_mhd_opts_tls(mhdst);
 
+    webu_mhd_opts_pool(mhdst);
+
     mhdst->mhd_ops[mhdst->mhd_opt_nbr].option = MHD_OPTION_END;
     mhdst->mhd_ops[mhdst->mhd_opt_nbr].value = 0;
     mhdst->mhd_ops[mhdst->mhd_opt_nbr].ptr_value = NULL;
@@ -1832,7 +1939,20 @@ static void webu_mhd_opts(struct mhdstart_ctx *mhdst){
 static void webu_mhd_flags(struct mhdstart_ctx *mhdst){
 
     /* This sets the MHD startup flags based upon what user put into configuration */
-    mhdst->mhd_flags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_POLL| MHD_USE_SELECT_INTERNALLY;
+    if (mhdst->pool == 0){
+        mhdst->mhd_flags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_POLL| MHD_USE_SELECT_INTERNALLY;
+    } else {
+        #if MHD_VERSION < 0x00095300
+            mhdst->mhd_flags = MHD_USE_SUSPEND_RESUME;
+        #else
+            mhdst->mhd_flags = MHD_ALLOW_SUSPEND_RESUME;
+        #endif
+        if (mhdst->epoll){
+            mhdst->mhd_flags = mhdst->mhd_flags | MHD_USE_EPOLL_INTERNALLY;
+        } else {
+            mhdst->mhd_flags = mhdst->mhd_flags | MHD_USE_POLL | MHD_USE_SELECT_INTERNALLY;
+        }
+    }
 
     if (mhdst->ipv6) mhdst->mhd_flags = mhdst->mhd_flags | MHD_USE_DUAL_STACK;
 
@@ -1943,6 +2063,8 @@ static void webu_start_strm(struct context **cnt){
     mhdst.indxthrd = 0;
     mhdst.cnt = cnt;
     mhdst.ipv6 = cnt[0]->conf.webcontrol_ipv6;
+    mhdst.pool = 0;
+    mhdst.epoll = FALSE;
 
     /* Set the rand number for webcontrol digest if needed */
     srand(time(NULL));
@@ -1994,6 +2116,20 @@ static void webu_start_strm(struct context **cnt){
         }
         mhdst.indxthrd++;
     }
+
+    /* All stream daemons use the same mode so every camera can tell how
+     * its clients wait for images, whichever port they connected to.
+     */
+    mhdst.indxthrd = 0;
+    while (cnt[mhdst.indxthrd] != NULL){
+        cnt[mhdst.indxthrd]->webstream_suspend = (mhdst.pool > 0);
+        mhdst.indxthrd++;
+    }
+    if (mhdst.pool > 0){
+        MOTION_LOG(NTC, TYPE_STREAM, NO_ERRNO
+            ,_("Streams served by %d threads per port using %s")
+            ,mhdst.pool, mhdst.epoll ? "epoll" : "poll");
+    }
     if (mhdst.tls_cert != NULL) free(mhdst.tls_cert);
     if (mhdst.tls_key  != NULL) free(mhdst.tls_key);
 
@@ -2052,6 +2188,20 @@ void webu_stop(struct context **cnt) {
      */
     int indxthrd;
 
+    /* Stop the stream clients first.  Suspended clients are resumed so they
+     * can see they must finish, MHD can not stop with suspended connections.
+     */
+    indxthrd = 0;
+    while (cnt[indxthrd] != NULL){
+        cnt[indxthrd]->webcontrol_finish = TRUE;
+        indxthrd++;
+    }
+    indxthrd = 0;
+    while (cnt[indxthrd] != NULL){
+        if (cnt[indxthrd]->webstream_suspend) webu_stream_resume_all(cnt[indxthrd]);
+        indxthrd++;
+    }
+
     if (cnt[0]->webcontrol_daemon != NULL){
         cnt[0]->webcontrol_finish = TRUE;
         MHD_stop_daemon (cnt[0]->webcontrol_daemon);
@@ -15,7 +15,7 @@
 #define WEBUI_LEN_PARM 512          /* Parameters specified */
 #define WEBUI_LEN_URLI 512          /* Maximum URL permitted */
 #define WEBUI_LEN_RESP 1024         /* Initial response size */
-#define WEBUI_MHD_OPTS 10           /* Maximum number of options permitted for MHD */
+#define WEBUI_MHD_OPTS 12           /* Maximum number of options permitted for MHD */
 #define WEBUI_LEN_LNK  15           /* Maximum length for chars in strminfo */
 
 enum WEBUI_CNCT{
@@ -25,6 +25,8 @@ enum WEBUI_CNCT{
   WEBUI_CNCT_MOTION      = 3,
   WEBUI_CNCT_SOURCE      = 4,
   WEBUI_CNCT_STATIC      = 5,
+  WEBUI_CNCT_MPEGTS      = 6,
+  WEBUI_CNCT_MOSAIC      = 7,
   WEBUI_CNCT_UNKNOWN     = 99
 };
 
@@ -60,6 +62,15 @@ struct webui_ctx {
     size_t          resp_size;         /* The allocated size of the response */
     size_t          resp_used;         /* The amount of the response page used */
     uint64_t        stream_pos;        /* Stream position of sent image */
+    struct stream_jpeg *stream_jpeg;   /* Image being sent, a reference is held */
+    struct stream_chunk *stream_chunk; /* MPEG-TS chunk being sent, a reference is held */
+    struct stream_data *stream_data;   /* Stream the image belongs to */
+    unsigned int    stream_seq;        /* Number of the last image taken from the stream */
+    int             stream_joined;     /* MPEG-TS header was taken, chunks follow */
+    int             stream_size;       /* Substream number, index of stream_scaled */
+    struct webui_ctx *stream_next;     /* Next client waiting on the stream */
+    int             stream_suspended;  /* Connection is suspended until the next image */
+    struct timeval  stream_due;        /* Suspended MJPEG client is not resumed before */
     int             stream_fps;        /* Stream rate per second */
     struct timeval  time_last;         /* Keep track of processing time for stream thread*/
     int             mhd_first;         /* Boolean for whether it is the first connection*/
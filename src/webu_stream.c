@@ -10,6 +10,7 @@
  *    webu_stream*      - All functions in this module
  *    webu_stream_mjpeg*    - Create the motion-jpeg stream for the user
  *    webu_stream_static*   - Create the static jpg image for the user.
+ *    webu_stream_mpegts*   - Create the MPEG-TS stream for the user
  *    webu_stream_checks    - Edit/validate request from user
  */
 
@@ -18,21 +19,368 @@
 #include "webu_stream.h"
 #include "translate.h"
 
-static void webu_stream_mjpeg_checkbuffers(struct webui_ctx *webui) {
-    /* Allocate buffers if needed */
-    if (webui->resp_size < (size_t)webui->cnt->imgs.size_norm){
-        if (webui->resp_page   != NULL) free(webui->resp_page);
-        webui->resp_page   = mymalloc(webui->cnt->imgs.size_norm);
-        memset(webui->resp_page,'\0',webui->cnt->imgs.size_norm);
-        webui->resp_size = webui->cnt->imgs.size_norm;
-        webui->resp_used = 0;
+/* Room kept in front of the jpg of a stream image for the multipart header */
+#define WEBU_STREAM_HEAD    80
+
+/* Bytes MHD asks for at a time when sending a stream */
+#define WEBU_STREAM_BLOCK   (32 * 1024)
+
+/* Bytes of MPEG-TS chunks kept past the latest key frame for new clients */
+#define WEBU_STREAM_KEPT    (8 * 1024 * 1024)
+
+static void webu_stream_jpeg_destroy(struct stream_jpeg *jpeg) {
+    /* The part moves inside the allocation with the length of the header */
+    free(jpeg->data - WEBU_STREAM_HEAD);
+    free(jpeg);
+
+}
+
+static void webu_stream_jpeg_unref(struct stream_data *stream, struct stream_jpeg *jpeg) {
+    /* Release a reference to an image.  Called with mutex_stream held */
+
+    if (jpeg == NULL) return;
+
+    jpeg->refcnt--;
+    if (jpeg->refcnt > 0) return;
+
+    /* Once the stream was freed the last client frees the image */
+    if ((stream->spare == NULL) && (stream->jpeg != NULL)) {
+        stream->spare = jpeg;
+    } else {
+        webu_stream_jpeg_destroy(jpeg);
     }
 
 }
 
-static void webu_stream_mjpeg_delay(struct webui_ctx *webui) {
-    /* Sleep required time to get to the user requested frame
-     * rate for the stream
+static void webu_stream_resume(struct stream_data *stream) {
+    /* Resume the clients suspended until the next image of the stream.
+     * Called with mutex_stream held
+     */
+    struct webui_ctx *webui;
+
+    while (stream->waiting != NULL) {
+        webui = stream->waiting;
+        stream->waiting = webui->stream_next;
+        webui->stream_next = NULL;
+        webui->stream_suspended = FALSE;
+        MHD_resume_connection(webui->connection);
+    }
+
+}
+
+static void webu_stream_resume_due(struct stream_data *stream) {
+    /* Resume the MJPEG clients that may be sent the new image of the stream.
+     * The others stay suspended until a later image so a client with a low
+     * frame rate is not woken for every image of the camera.
+     * Called with mutex_stream held
+     */
+    struct webui_ctx **waiting, *webui;
+    struct timeval time_curr;
+
+    gettimeofday(&time_curr, NULL);
+
+    waiting = &stream->waiting;
+    while (*waiting != NULL) {
+        webui = *waiting;
+        if (timercmp(&webui->stream_due, &time_curr, >)) {
+            waiting = &webui->stream_next;
+            continue;
+        }
+        *waiting = webui->stream_next;
+        webui->stream_next = NULL;
+        webui->stream_suspended = FALSE;
+        MHD_resume_connection(webui->connection);
+    }
+
+}
+
+void webu_stream_resume_all(struct context *cnt) {
+    /* Resume all the suspended clients of the camera */
+    int indx;
+
+    pthread_mutex_lock(&cnt->mutex_stream);
+        webu_stream_resume(&cnt->stream_norm);
+        for (indx = 0; indx < cnt->stream_scaled_count; indx++)
+            webu_stream_resume(&cnt->stream_scaled[indx].stream);
+        webu_stream_resume(&cnt->stream_motion);
+        webu_stream_resume(&cnt->stream_source);
+        webu_stream_resume(&cnt->stream_mpegts);
+        webu_stream_resume(&cnt->stream_mosaic);
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+}
+
+/**
+ * webu_stream_jpeg_claim
+ *
+ *   Returns an image the motion thread compresses the next frame of the
+ *   stream into.  The image is not visible to the clients until it is
+ *   handed to webu_stream_jpeg_publish so no lock is held while it is
+ *   written.
+ *
+ * Parameters:
+ *
+ *      cnt      The context of the camera
+ *      stream   The stream the image is for
+ *      alloc    Bytes needed for the JPEG, the size of the uncompressed image
+ *
+ * Returns:     the image, with room at data for a JPEG of alloc bytes
+ */
+struct stream_jpeg *webu_stream_jpeg_claim(struct context *cnt, struct stream_data *stream, int alloc) {
+
+    struct stream_jpeg *jpeg;
+
+    pthread_mutex_lock(&cnt->mutex_stream);
+        jpeg = stream->spare;
+        stream->spare = NULL;
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+    /* The size of the images changes when the camera is restarted */
+    if ((jpeg != NULL) && (jpeg->alloc < alloc)) {
+        webu_stream_jpeg_destroy(jpeg);
+        jpeg = NULL;
+    }
+
+    if (jpeg == NULL) {
+        jpeg = mymalloc(sizeof(struct stream_jpeg));
+        jpeg->alloc = alloc;
+        jpeg->part = mymalloc(WEBU_STREAM_HEAD + jpeg->alloc + 2);
+        jpeg->data = jpeg->part + WEBU_STREAM_HEAD;
+    }
+    jpeg->size = 0;
+    jpeg->part_size = 0;
+    jpeg->refcnt = 1;
+
+    return jpeg;
+}
+
+void webu_stream_jpeg_publish(struct context *cnt, struct stream_data *stream, struct stream_jpeg *jpeg) {
+    /*
+     * Write the multipart header and terminator around the jpg, then make
+     * the image the latest of the stream and drop the previous one
+     */
+    struct stream_jpeg *prev;
+    char resp_head[WEBU_STREAM_HEAD];
+    int  header_len;
+
+    header_len = snprintf(resp_head, WEBU_STREAM_HEAD
+        ,"--BoundaryString\r\n"
+        "Content-type: image/jpeg\r\n"
+        "Content-Length: %9ld\r\n\r\n"
+        ,jpeg->size);
+    jpeg->part = jpeg->data - header_len;
+    memcpy(jpeg->part, resp_head, header_len);
+    memcpy(jpeg->data + jpeg->size, "\r\n", 2);
+    jpeg->part_size = header_len + jpeg->size + 2;
+
+    pthread_mutex_lock(&cnt->mutex_stream);
+        prev = stream->jpeg;
+        stream->jpeg = jpeg;
+        stream->seq++;
+        if (stream->seq == 0) stream->seq = 1;
+        webu_stream_jpeg_unref(stream, prev);
+        pthread_cond_broadcast(&cnt->cond_stream);
+        webu_stream_resume_due(stream);
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+}
+
+void webu_stream_jpeg_free(struct context *cnt, struct stream_data *stream) {
+    /*
+     * Drop the images of a stream when the camera stops.  An image still
+     * being sent is freed by the client when it releases it and clients
+     * waiting for an image are let go.
+     */
+    pthread_mutex_lock(&cnt->mutex_stream);
+        webu_stream_resume(stream);
+        if (stream->spare != NULL) {
+            webu_stream_jpeg_destroy(stream->spare);
+            stream->spare = NULL;
+        }
+        if (stream->jpeg != NULL) {
+            stream->jpeg->refcnt--;
+            if (stream->jpeg->refcnt == 0) webu_stream_jpeg_destroy(stream->jpeg);
+            stream->jpeg = NULL;
+        }
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+}
+
+static void webu_stream_chunk_unref(struct stream_chunk *chunk) {
+    /* Release a reference to a chunk.  Called with mutex_stream held */
+
+    if (chunk == NULL) return;
+
+    chunk->refcnt--;
+    if (chunk->refcnt > 0) return;
+
+    free(chunk->data);
+    free(chunk);
+
+}
+
+static void webu_stream_mpegts_drop(struct stream_data *stream) {
+    /* Drop the oldest chunk kept.  Called with mutex_stream held */
+    struct stream_chunk *chunk;
+
+    chunk = stream->first;
+    stream->first = chunk->next;
+    stream->kept -= chunk->size;
+    chunk->next = NULL;
+    webu_stream_chunk_unref(chunk);
+
+}
+
+/**
+ * webu_stream_mpegts_write
+ *
+ *   Output function of the muxer of the MPEG-TS stream.  The bytes are added
+ *   to the chunk of the frame being written, which the clients can not see
+ *   until it is published.  Only used by the motion thread.
+ *
+ * Parameters:
+ *
+ *      opaque   The stream_data of the MPEG-TS stream
+ *      buf      Bytes written by the muxer
+ *      buf_size The number of bytes
+ *
+ * Returns:     the number of bytes taken
+ */
+int webu_stream_mpegts_write(void *opaque, const unsigned char *buf, int buf_size) {
+
+    struct stream_data *stream = opaque;
+    struct stream_chunk *chunk;
+
+    if (stream->build == NULL) {
+        chunk = mymalloc(sizeof(struct stream_chunk));
+        chunk->alloc = WEBU_STREAM_BLOCK;
+        chunk->data = mymalloc(chunk->alloc);
+        chunk->refcnt = 1;
+        stream->build = chunk;
+    }
+    chunk = stream->build;
+
+    if (chunk->size + buf_size > chunk->alloc) {
+        while (chunk->size + buf_size > chunk->alloc) chunk->alloc *= 2;
+        chunk->data = myrealloc(chunk->data, chunk->alloc, "webu_stream_mpegts_write");
+    }
+    memcpy(chunk->data + chunk->size, buf, buf_size);
+    chunk->size += buf_size;
+
+    return buf_size;
+}
+
+void webu_stream_mpegts_header(struct context *cnt, struct stream_data *stream) {
+    /* Keep what the muxer wrote when it was opened to start each client with */
+    struct stream_chunk *prev;
+
+    pthread_mutex_lock(&cnt->mutex_stream);
+        prev = stream->head;
+        stream->head = stream->build;
+        webu_stream_chunk_unref(prev);
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+    stream->build = NULL;
+
+}
+
+void webu_stream_mpegts_publish(struct context *cnt, struct stream_data *stream, int iskey) {
+    /*
+     * Add the chunk written for a frame to the stream.  A key frame drops the
+     * chunks before it since new clients start at the latest key frame.  When
+     * the key frames are far apart the oldest chunks are dropped past
+     * WEBU_STREAM_KEPT bytes and new clients wait for the next key frame.
+     */
+    struct stream_chunk *chunk, *last;
+
+    chunk = stream->build;
+    if (chunk == NULL) return;
+    stream->build = NULL;
+
+    pthread_mutex_lock(&cnt->mutex_stream);
+        stream->seq++;
+        if (stream->seq == 0) stream->seq = 1;
+        chunk->seq = stream->seq;
+        chunk->iskey = iskey;
+
+        if (iskey) {
+            while (stream->first != NULL) webu_stream_mpegts_drop(stream);
+        }
+
+        if (stream->first == NULL) {
+            stream->first = chunk;
+        } else {
+            last = stream->first;
+            while (last->next != NULL) last = last->next;
+            last->next = chunk;
+        }
+        stream->kept += chunk->size;
+
+        while ((stream->kept > WEBU_STREAM_KEPT) && (stream->first != chunk)) {
+            webu_stream_mpegts_drop(stream);
+        }
+
+        pthread_cond_broadcast(&cnt->cond_stream);
+        webu_stream_resume(stream);
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+}
+
+void webu_stream_mpegts_free(struct context *cnt, struct stream_data *stream) {
+    /*
+     * Drop the chunks of the stream when its muxer is closed.  Chunks still
+     * being sent are freed by the clients when they release them.
+     */
+    pthread_mutex_lock(&cnt->mutex_stream);
+        webu_stream_resume(stream);
+        while (stream->first != NULL) webu_stream_mpegts_drop(stream);
+        webu_stream_chunk_unref(stream->head);
+        stream->head = NULL;
+    pthread_mutex_unlock(&cnt->mutex_stream);
+
+    if (stream->build != NULL) {
+        free(stream->build->data);
+        free(stream->build);
+        stream->build = NULL;
+    }
+
+}
+
+void webu_stream_release(struct webui_ctx *webui) {
+    /* Release the image the client was sending or its place in the
+     * list of clients waiting for an image
+     */
+    struct webui_ctx **waiting;
+
+    if ((webui->stream_jpeg == NULL) && (webui->stream_chunk == NULL) &&
+        (!webui->stream_suspended)) return;
+
+    pthread_mutex_lock(&webui->cnt->mutex_stream);
+        if (webui->stream_jpeg != NULL) {
+            webu_stream_jpeg_unref(webui->stream_data, webui->stream_jpeg);
+        }
+        if (webui->stream_chunk != NULL) {
+            webu_stream_chunk_unref(webui->stream_chunk);
+        }
+        if (webui->stream_suspended) {
+            waiting = &webui->stream_data->waiting;
+            while ((*waiting != NULL) && (*waiting != webui)) {
+                waiting = &(*waiting)->stream_next;
+            }
+            if (*waiting != NULL) *waiting = webui->stream_next;
+            webui->stream_next = NULL;
+            webui->stream_suspended = FALSE;
+        }
+    pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
+    webui->stream_jpeg = NULL;
+    webui->stream_chunk = NULL;
+    webui->stream_data = NULL;
+}
+
+static long webu_stream_mjpeg_remaining(struct webui_ctx *webui) {
+    /* Nanoseconds left until the client may be sent its next image at
+     * the user requested frame rate for the stream
      */
 
     long   stream_rate;
@@ -49,132 +397,335 @@ static void webu_stream_mjpeg_delay(struct webui_ctx *webui) {
     if (stream_delay < 0)  stream_delay = 0;
     if (stream_delay > 1000000000 ) stream_delay = 1000000000;
 
+    stream_rate = 0;
     if (webui->stream_fps >= 1){
         stream_rate = ( (1000000000 / webui->stream_fps) - stream_delay);
-        if ((stream_rate > 0) && (stream_rate < 1000000000)){
-            SLEEP(0,stream_rate);
-        } else if (stream_rate == 1000000000) {
-            SLEEP(1,0);
-        }
+        if (stream_rate < 0) stream_rate = 0;
     }
-    gettimeofday(&webui->time_last, NULL);
 
+    return stream_rate;
 }
 
-static void webu_stream_mjpeg_getimg(struct webui_ctx *webui) {
-    long jpeg_size;
-    char resp_head[80];
-    int  header_len;
-    struct stream_data *local_stream;
+static void webu_stream_mjpeg_delay(struct webui_ctx *webui) {
+    /* Sleep required time since the last image sent to keep to the
+     * user requested frame rate for the stream
+     */
+
+    long   stream_rate;
+
+    stream_rate = webu_stream_mjpeg_remaining(webui);
+    if ((stream_rate > 0) && (stream_rate < 1000000000)){
+        SLEEP(0,stream_rate);
+    } else if (stream_rate == 1000000000) {
+        SLEEP(1,0);
+    }
+
+}
 
-    memset(webui->resp_page, '\0', webui->resp_size);
+static struct stream_data *webu_stream_mjpeg_stream(struct webui_ctx *webui) {
+    /* The stream the client wants */
 
-    /* Assign to a local pointer the stream we want */
     if (webui->cnct_type == WEBUI_CNCT_FULL){
-        local_stream = &webui->cnt->stream_norm;
+        return &webui->cnt->stream_norm;
 
     } else if (webui->cnct_type == WEBUI_CNCT_SUB){
-        local_stream = &webui->cnt->stream_sub;
+        return &webui->cnt->stream_scaled[webui->stream_size].stream;
 
     } else if (webui->cnct_type == WEBUI_CNCT_MOTION){
-        local_stream = &webui->cnt->stream_motion;
+        return &webui->cnt->stream_motion;
 
     } else if (webui->cnct_type == WEBUI_CNCT_SOURCE){
-        local_stream = &webui->cnt->stream_source;
+        return &webui->cnt->stream_source;
+
+    } else if (webui->cnct_type == WEBUI_CNCT_MOSAIC){
+        return &webui->cnt->stream_mosaic;
 
     } else {
-        return;
+        return NULL;
     }
 
-    /* Copy jpg from the motion loop thread */
+}
+
+static void webu_stream_mjpeg_fps(struct webui_ctx *webui) {
+    /* Frame rate for the client.  Called with mutex_stream held */
+
+    if (webui->cnct_type == WEBUI_CNCT_MOSAIC) {
+        /* No point in asking for the mosaic faster than it is made */
+        webui->stream_fps = webui->cnt->conf.stream_mosaic_rate;
+    } else if ((!webui->cnt->detecting_motion) && (webui->cnt->conf.stream_motion)) {
+        webui->stream_fps = 1;
+    } else {
+        webui->stream_fps = webui->cnt->conf.stream_maxrate;
+    }
+
+}
+
+static void webu_stream_mjpeg_take(struct webui_ctx *webui, struct stream_data *local_stream) {
+    /* Take a reference to the latest image.  Called with mutex_stream held */
+
+    webui->stream_jpeg = local_stream->jpeg;
+    webui->stream_jpeg->refcnt++;
+    webui->stream_data = local_stream;
+    webui->stream_seq = local_stream->seq;
+
+}
+
+static void webu_stream_mjpeg_getimg(struct webui_ctx *webui) {
+    /* Take a reference to the next image of the stream the client wants.
+     * When the client already has the latest image we wait for the motion
+     * loop to publish a new one so each image is sent at most once.  The
+     * wait is limited so the connection can notice webcontrol_finish.
+     */
+    struct stream_data *local_stream;
+    struct timeval curtime;
+    struct timespec waittime;
+    int retcd;
+
+    local_stream = webu_stream_mjpeg_stream(webui);
+    if (local_stream == NULL) return;
+
+    gettimeofday(&curtime, NULL);
+    waittime.tv_sec = curtime.tv_sec + 1;
+    waittime.tv_nsec = 1000L * curtime.tv_usec;
+
     pthread_mutex_lock(&webui->cnt->mutex_stream);
-        if ((!webui->cnt->detecting_motion) && (webui->cnt->conf.stream_motion)){
-            webui->stream_fps = 1;
-        } else {
-            webui->stream_fps = webui->cnt->conf.stream_maxrate;
+        retcd = 0;
+        while ((retcd != ETIMEDOUT) && (!webui->cnt->webcontrol_finish) &&
+               ((local_stream->jpeg == NULL) || (local_stream->seq == webui->stream_seq))) {
+            retcd = pthread_cond_timedwait(&webui->cnt->cond_stream
+                , &webui->cnt->mutex_stream, &waittime);
+        }
+        webu_stream_mjpeg_fps(webui);
+        if ((local_stream->jpeg != NULL) && (local_stream->seq != webui->stream_seq)) {
+            webu_stream_mjpeg_take(webui, local_stream);
         }
-        if (local_stream->jpeg_data == NULL) {
-            pthread_mutex_unlock(&webui->cnt->mutex_stream);
-            return;
+    pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
+    if (webui->stream_jpeg != NULL) gettimeofday(&webui->time_last, NULL);
+
+}
+
+static void webu_stream_mjpeg_getimg_suspend(struct webui_ctx *webui) {
+    /* Take a reference to the next image of the stream when the client may
+     * be sent one.  Otherwise the connection is suspended, freeing the event
+     * loop thread, until the motion loop publishes the next image.  An image
+     * due within a quarter of the frame interval of the client is taken so
+     * the client does not miss every other image of a camera running at
+     * about the stream rate.  The client is only resumed by the images
+     * published from that time on.
+     */
+    struct stream_data *local_stream;
+    long remaining, usec;
+
+    local_stream = webu_stream_mjpeg_stream(webui);
+    if (local_stream == NULL) return;
+
+    remaining = webu_stream_mjpeg_remaining(webui);
+
+    pthread_mutex_lock(&webui->cnt->mutex_stream);
+        webu_stream_mjpeg_fps(webui);
+        if ((local_stream->jpeg != NULL) && (local_stream->seq != webui->stream_seq) &&
+            ((webui->stream_fps < 1) || (remaining <= (1000000000L / webui->stream_fps) / 4))) {
+            webu_stream_mjpeg_take(webui, local_stream);
+        } else if (!webui->cnt->webcontrol_finish) {
+            usec = webui->time_last.tv_usec;
+            if (webui->stream_fps >= 1) usec += ((1000000L / webui->stream_fps) * 3) / 4;
+            webui->stream_due.tv_sec = webui->time_last.tv_sec + (usec / 1000000L);
+            webui->stream_due.tv_usec = usec % 1000000L;
+            webui->stream_data = local_stream;
+            webui->stream_next = local_stream->waiting;
+            local_stream->waiting = webui;
+            webui->stream_suspended = TRUE;
+            MHD_suspend_connection(webui->connection);
         }
-        jpeg_size = local_stream->jpeg_size;
-        header_len = snprintf(resp_head, 80
-            ,"--BoundaryString\r\n"
-            "Content-type: image/jpeg\r\n"
-            "Content-Length: %9ld\r\n\r\n"
-            ,jpeg_size);
-        memcpy(webui->resp_page, resp_head, header_len);
-        memcpy(webui->resp_page + header_len
-            ,local_stream->jpeg_data
-            ,jpeg_size);
-        /* Copy in the terminator after the jpg data at the end*/
-        memcpy(webui->resp_page + header_len + jpeg_size,"\r\n",2);
-        webui->resp_used = header_len + jpeg_size + 2;
     pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
+    if (webui->stream_jpeg != NULL) gettimeofday(&webui->time_last, NULL);
+
 }
 
 static ssize_t webu_stream_mjpeg_response (void *cls, uint64_t pos, char *buf, size_t max){
     /* This is the callback response function for MHD streams.  It is kept "open" and
      * in process during the entire time that the user has the stream open in the web
      * browser.  We sleep the requested amount of time between fetching images to match
-     * the user configuration parameters.  This function may be called multiple times for
-     * a single image so we can write what we can to the buffer and pick up remaining bytes
-     * to send based upon the stream position
+     * the user configuration parameters and then wait for an image not sent yet.  When
+     * the streams run in the MHD event loop the connection is suspended instead of
+     * sleeping or waiting.  This function may be called multiple times for a single
+     * image so we can write what we can to the buffer and pick up remaining bytes
+     * to send based upon the stream position.  The bytes are sent straight from the
+     * image shared by all the clients of the stream.
      */
     struct webui_ctx *webui = cls;
+    struct stream_jpeg *jpeg;
     size_t sent_bytes;
 
     (void)pos;  /*Remove compiler warning */
 
     if (webui->cnt->webcontrol_finish) return -1;
 
-    if ((webui->stream_pos == 0) || (webui->resp_used == 0)){
-
-        webu_stream_mjpeg_delay(webui);
+    if (webui->stream_jpeg == NULL){
 
         webui->stream_pos = 0;
-        webui->resp_used = 0;
 
-        webu_stream_mjpeg_getimg(webui);
+        if (webui->cnt->webstream_suspend){
+            webu_stream_mjpeg_getimg_suspend(webui);
+        } else {
+            webu_stream_mjpeg_delay(webui);
+            webu_stream_mjpeg_getimg(webui);
+        }
 
-        if (webui->resp_used == 0) return 0;
+        if (webui->stream_jpeg == NULL) return 0;
     }
 
-    if ((webui->resp_used - webui->stream_pos) > max) {
+    jpeg = webui->stream_jpeg;
+
+    if ((jpeg->part_size - webui->stream_pos) > max) {
         sent_bytes = max;
     } else {
-        sent_bytes = webui->resp_used - webui->stream_pos;
+        sent_bytes = jpeg->part_size - webui->stream_pos;
     }
 
-    memcpy(buf, webui->resp_page + webui->stream_pos, sent_bytes);
+    memcpy(buf, jpeg->part + webui->stream_pos, sent_bytes);
 
     webui->stream_pos = webui->stream_pos + sent_bytes;
-    if (webui->stream_pos >= webui->resp_used){
+    if (webui->stream_pos >= (uint64_t)jpeg->part_size){
         webui->stream_pos = 0;
+        webu_stream_release(webui);
     }
 
     return sent_bytes;
 
 }
 
-static void webu_stream_static_getimg(struct webui_ctx *webui) {
-    /* Obtain the current image, compress it to a JPG and put into webui->resp_page
-     * for MHD to send back to user
+static struct stream_chunk *webu_stream_mpegts_next(struct webui_ctx *webui
+        , struct stream_data *stream) {
+    /* The chunk to send the client next or NULL when it has to wait.  A new
+     * client is sent the header and then the latest key frame, as is a client
+     * that fell behind the chunks kept.  Called with mutex_stream held
+     */
+    struct stream_chunk *chunk, *key;
+
+    if (stream->head == NULL) return NULL;
+
+    if (webui->stream_seq != 0) {
+        for (chunk = stream->first; chunk != NULL; chunk = chunk->next) {
+            if (chunk->seq == webui->stream_seq + 1) return chunk;
+        }
+        if (webui->stream_seq == stream->seq) return NULL;
+    }
+
+    key = NULL;
+    for (chunk = stream->first; chunk != NULL; chunk = chunk->next) {
+        if (chunk->iskey) key = chunk;
+    }
+    if (key == NULL) return NULL;
+
+    if (!webui->stream_joined) return stream->head;
+
+    return key;
+}
+
+static void webu_stream_mpegts_getchunk(struct webui_ctx *webui) {
+    /* Take a reference to the next chunk of the stream.  When the client
+     * has sent the latest chunk it waits for the motion loop to publish the
+     * next one, or the connection is suspended when the streams run in the
+     * MHD event loop.  The wait is limited so the connection can notice
+     * webcontrol_finish.
      */
-    webui->resp_used = 0;
+    struct stream_data *stream;
+    struct stream_chunk *chunk;
+    struct timeval curtime;
+    struct timespec waittime;
+    int retcd;
+
+    stream = &webui->cnt->stream_mpegts;
 
-    memset(webui->resp_page, '\0', webui->resp_size);
+    gettimeofday(&curtime, NULL);
+    waittime.tv_sec = curtime.tv_sec + 1;
+    waittime.tv_nsec = 1000L * curtime.tv_usec;
 
     pthread_mutex_lock(&webui->cnt->mutex_stream);
-        if (webui->cnt->stream_norm.jpeg_data == NULL){
-            pthread_mutex_unlock(&webui->cnt->mutex_stream);
-            return;
+        chunk = webu_stream_mpegts_next(webui, stream);
+        if (webui->cnt->webstream_suspend) {
+            if ((chunk == NULL) && (!webui->cnt->webcontrol_finish)) {
+                webui->stream_data = stream;
+                webui->stream_next = stream->waiting;
+                stream->waiting = webui;
+                webui->stream_suspended = TRUE;
+                MHD_suspend_connection(webui->connection);
+            }
+        } else {
+            retcd = 0;
+            while ((chunk == NULL) && (retcd != ETIMEDOUT) && (!webui->cnt->webcontrol_finish)) {
+                retcd = pthread_cond_timedwait(&webui->cnt->cond_stream
+                    , &webui->cnt->mutex_stream, &waittime);
+                chunk = webu_stream_mpegts_next(webui, stream);
+            }
+        }
+        if (chunk != NULL) {
+            chunk->refcnt++;
+            webui->stream_chunk = chunk;
+            webui->stream_data = stream;
+            if (chunk == stream->head) {
+                webui->stream_joined = TRUE;
+            } else {
+                webui->stream_seq = chunk->seq;
+            }
+        }
+    pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
+}
+
+static ssize_t webu_stream_mpegts_response (void *cls, uint64_t pos, char *buf, size_t max){
+    /* Callback response function for the MPEG-TS stream.  Like the mjpeg
+     * stream it is kept open while the user has the stream open and sends
+     * the chunks of the stream in order straight from the chunks shared by
+     * all the clients.  There is no frame rate of its own, every chunk the
+     * muxer writes is sent.
+     */
+    struct webui_ctx *webui = cls;
+    struct stream_chunk *chunk;
+    size_t sent_bytes;
+
+    (void)pos;  /*Remove compiler warning */
+
+    if (webui->cnt->webcontrol_finish) return -1;
+
+    if (webui->stream_chunk == NULL){
+        webui->stream_pos = 0;
+        webu_stream_mpegts_getchunk(webui);
+        if (webui->stream_chunk == NULL) return 0;
+    }
+
+    chunk = webui->stream_chunk;
+
+    if ((chunk->size - webui->stream_pos) > max) {
+        sent_bytes = max;
+    } else {
+        sent_bytes = chunk->size - webui->stream_pos;
+    }
+
+    memcpy(buf, chunk->data + webui->stream_pos, sent_bytes);
+
+    webui->stream_pos = webui->stream_pos + sent_bytes;
+    if (webui->stream_pos >= (uint64_t)chunk->size){
+        webui->stream_pos = 0;
+        webu_stream_release(webui);
+    }
+
+    return sent_bytes;
+
+}
+
+static void webu_stream_static_getimg(struct webui_ctx *webui) {
+    /* Take a reference to the latest image of the stream for MHD to send back to user */
+
+    pthread_mutex_lock(&webui->cnt->mutex_stream);
+        webui->stream_jpeg = webui->cnt->stream_norm.jpeg;
+        if (webui->stream_jpeg != NULL) {
+            webui->stream_jpeg->refcnt++;
+            webui->stream_data = &webui->cnt->stream_norm;
         }
-        memcpy(webui->resp_page
-            ,webui->cnt->stream_norm.jpeg_data
-            ,webui->cnt->stream_norm.jpeg_size);
-        webui->resp_used = webui->cnt->stream_norm.jpeg_size;
     pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
 }
@@ -183,6 +734,17 @@ static int webu_stream_checks(struct webui_ctx *webui) {
     /* Perform edits to determine whether the user specified a valid URL
      * for the particular port
      */
+    if (webui->cnct_type == WEBUI_CNCT_MOSAIC) {
+        /* The mosaic belongs to the port of motion.conf rather than a camera */
+        if (!mosaic_running(webui->cnt)) {
+            MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+                , _("The mosaic is only provided on the stream port of motion.conf"
+                    " with camera config files: %s"),webui->url);
+            return -1;
+        }
+        return 0;
+    }
+
     if ((webui->cntlst != NULL) && (webui->thread_nbr >= webui->cam_threads)){
         MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
             , _("Invalid thread specified: %s"),webui->url);
@@ -210,13 +772,24 @@ static int webu_stream_checks(struct webui_ctx *webui) {
         return -1;
     }
 
-    /* Thread numbers are not used for context specific ports. */
-    if ((webui->cntlst == NULL) && (strlen(webui->uri_cmd1) > 0)) {
+    /* Thread numbers are not used for context specific ports.  The number
+     * of a substream is the only thing that may follow the stream name.
+     */
+    if ((webui->cntlst == NULL) && (strlen(webui->uri_cmd1) > 0) &&
+        (webui->cnct_type != WEBUI_CNCT_SUB)) {
         MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
             , _("Bad URL for a camera specific port: %s"),webui->url);
         return -1;
     }
 
+    if ((webui->cnct_type == WEBUI_CNCT_SUB) &&
+        (webui->stream_size >= webui->cnt->stream_scaled_count)) {
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            , _("Substream %d is not set up in stream_sizes: %s")
+            ,webui->stream_size, webui->url);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -227,8 +800,8 @@ static void webu_stream_cnct_count(struct webui_ctx *webui) {
     cnct_count = 0;
     if (webui->cnct_type == WEBUI_CNCT_SUB) {
         pthread_mutex_lock(&webui->cnt->mutex_stream);
-            webui->cnt->stream_sub.cnct_count++;
-            cnct_count = webui->cnt->stream_sub.cnct_count;
+            webui->cnt->stream_scaled[webui->stream_size].stream.cnct_count++;
+            cnct_count = webui->cnt->stream_scaled[webui->stream_size].stream.cnct_count;
         pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
     } else if (webui->cnct_type == WEBUI_CNCT_MOTION) {
@@ -243,6 +816,18 @@ static void webu_stream_cnct_count(struct webui_ctx *webui) {
             cnct_count = webui->cnt->stream_source.cnct_count;
         pthread_mutex_unlock(&webui->cnt->mutex_stream);
 
+    } else if (webui->cnct_type == WEBUI_CNCT_MPEGTS) {
+        pthread_mutex_lock(&webui->cnt->mutex_stream);
+            webui->cnt->stream_mpegts.cnct_count++;
+            cnct_count = webui->cnt->stream_mpegts.cnct_count;
+        pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
+    } else if (webui->cnct_type == WEBUI_CNCT_MOSAIC) {
+        pthread_mutex_lock(&webui->cnt->mutex_stream);
+            webui->cnt->stream_mosaic.cnct_count++;
+            cnct_count = webui->cnt->stream_mosaic.cnct_count;
+        pthread_mutex_unlock(&webui->cnt->mutex_stream);
+
     } else {
         /* Stream, Static */
         pthread_mutex_lock(&webui->cnt->mutex_stream);
@@ -251,9 +836,10 @@ static void webu_stream_cnct_count(struct webui_ctx *webui) {
         pthread_mutex_unlock(&webui->cnt->mutex_stream);
     }
 
-    if (cnct_count == 1){
+    if ((cnct_count == 1) && (webui->cnct_type == WEBUI_CNCT_STATIC)){
         /* This is the first connection so we need to wait half a sec
-         * so that the motion loop on the other thread can update image
+         * so that the motion loop on the other thread can update image.
+         * The mjpeg streams wait for the image in webu_stream_mjpeg_getimg.
          */
         SLEEP(0,500000000L);
     }
@@ -269,11 +855,9 @@ int webu_stream_mjpeg(struct webui_ctx *webui) {
 
     webu_stream_cnct_count(webui);
 
-    webu_stream_mjpeg_checkbuffers(webui);
-
     gettimeofday(&webui->time_last, NULL);
 
-    response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, 1024
+    response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, WEBU_STREAM_BLOCK
         ,&webu_stream_mjpeg_response, webui, NULL);
     if (!response){
         MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Invalid response"));
@@ -304,17 +888,17 @@ int webu_stream_static(struct webui_ctx *webui) {
 
     webu_stream_cnct_count(webui);
 
-    webu_stream_mjpeg_checkbuffers(webui);
-
     webu_stream_static_getimg(webui);
 
-    if (webui->resp_used == 0) {
+    if (webui->stream_jpeg == NULL) {
         MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Could not get image to stream."));
         return MHD_NO;
     }
 
-    response = MHD_create_response_from_buffer (webui->resp_size
-        ,(void *)webui->resp_page, MHD_RESPMEM_MUST_COPY);
+    webui->resp_used = webui->stream_jpeg->size;
+    response = MHD_create_response_from_buffer (webui->resp_used
+        ,(void *)webui->stream_jpeg->data, MHD_RESPMEM_MUST_COPY);
+    webu_stream_release(webui);
     if (!response){
         MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Invalid response"));
         return MHD_NO;
@@ -334,3 +918,40 @@ int webu_stream_static(struct webui_ctx *webui) {
 
     return retcd;
 }
+
+int webu_stream_mpegts(struct webui_ctx *webui) {
+    /* Create the MPEG-TS stream of the movie encoded or passed through
+     * by the motion loop
+     */
+    int retcd;
+    struct MHD_Response *response;
+
+    if (webu_stream_checks(webui) == -1) return MHD_NO;
+
+    #ifndef HAVE_FFMPEG
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            , _("MPEG-TS stream requires ffmpeg: %s"),webui->url);
+        return MHD_NO;
+    #endif
+
+    webu_stream_cnct_count(webui);
+
+    response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, WEBU_STREAM_BLOCK
+        ,&webu_stream_mpegts_response, webui, NULL);
+    if (!response){
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Invalid response"));
+        return MHD_NO;
+    }
+
+    if (webui->cnt->conf.stream_cors_header != NULL){
+        MHD_add_response_header (response, MHD_HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN
+            , webui->cnt->conf.stream_cors_header);
+    }
+
+    MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, "video/mp2t");
+
+    retcd = MHD_queue_response (webui->connection, MHD_HTTP_OK, response);
+    MHD_destroy_response (response);
+
+    return retcd;
+}
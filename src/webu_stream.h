@@ -2,7 +2,17 @@
 #define _INCLUDE_WEBU_STREAM_H_
 
 
+struct stream_jpeg *webu_stream_jpeg_claim(struct context *cnt, struct stream_data *stream, int alloc);
+void webu_stream_jpeg_publish(struct context *cnt, struct stream_data *stream, struct stream_jpeg *jpeg);
+void webu_stream_jpeg_free(struct context *cnt, struct stream_data *stream);
+int webu_stream_mpegts_write(void *opaque, const unsigned char *buf, int buf_size);
+void webu_stream_mpegts_header(struct context *cnt, struct stream_data *stream);
+void webu_stream_mpegts_publish(struct context *cnt, struct stream_data *stream, int iskey);
+void webu_stream_mpegts_free(struct context *cnt, struct stream_data *stream);
+void webu_stream_release(struct webui_ctx *webui);
+void webu_stream_resume_all(struct context *cnt);
 int webu_stream_mjpeg(struct webui_ctx *webui);
 int webu_stream_static(struct webui_ctx *webui);
+int webu_stream_mpegts(struct webui_ctx *webui);
 
 #endif
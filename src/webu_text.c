@@ -14,7 +14,7 @@
  *          get:    Returns the value of a parameter.
  *          quit:   Terminates motion
  *          list:   Lists all the configuration parameters and values
- *          status  Whether the camera is in pause mode.
+ *          status  Whether the camera is in pause mode and the queue of its movie_extpipe.
  *          connection  Whether the camera connection is working
  *
  */
@@ -940,6 +940,22 @@ void webu_text_get_query(struct webui_ctx *webui) {
 
 }
 
+static void webu_text_status_extpipe(struct webui_ctx *webui, struct context *cnt) {
+    /* Write out the queue of the movie_extpipe while the pipe is open */
+    char response[WEBUI_LEN_RESP];
+    int depth, depth_max;
+    unsigned long drops;
+
+    if (!extpipe_status(cnt, &depth, &depth_max, &drops)) return;
+
+    snprintf(response, sizeof(response),
+        "Camera %d Pipe queue %d max %d dropped %lu %s\n"
+        ,cnt->camera_id, depth, depth_max, drops
+        ,webui->text_eol
+    );
+    webu_write(webui, response);
+}
+
 void webu_text_status(struct webui_ctx *webui) {
     /* Write out the pause/active status */
 
@@ -963,6 +979,7 @@ void webu_text_status(struct webui_ctx *webui) {
                 ,webui->text_eol
             );
             webu_write(webui, response);
+            webu_text_status_extpipe(webui, webui->cntlst[indx]);
         }
     } else {
         snprintf(response, sizeof(response),
@@ -973,6 +990,7 @@ void webu_text_status(struct webui_ctx *webui) {
             ,webui->text_eol
         );
         webu_write(webui, response);
+        webu_text_status_extpipe(webui, webui->cnt);
     }
     webu_text_trailer(webui);
 }